@@ -0,0 +1,284 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "BatchRunner.h"
+#include "HeaderCsv.h"
+
+#include <cstring>
+
+bool BatchRunner::isBatchMode(int argc, char *argv[]) {
+
+    for (int i = 1; i < argc; ++i) {
+        if (0 == strcmp(argv[i], "--batch")) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QMap<QString, QString> BatchRunner::loadManifest(const QString &path) {
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw runtime_error("Can't open manifest " + path.toStdString());
+    }
+
+    QJsonParseError error{};
+    auto json = QJsonDocument::fromJson(file.readAll(), &error);
+    if (error.error != QJsonParseError::NoError || !json.isObject()) {
+        throw runtime_error("Wrong manifest " + path.toStdString() + ": " + error.errorString().toStdString());
+    }
+
+    QMap<QString, QString> manifest;
+    auto base_dir = QFileInfo(path).absoluteDir();
+    auto object = json.object();
+    for (auto it = object.begin(); it != object.end(); ++it) {
+        manifest[it.key()] = base_dir.absoluteFilePath(it.value().toString());
+    }
+
+    return manifest;
+}
+
+QStringList BatchRunner::processVbf(const QString &vbf_path, const sOptions &options) {
+
+    QStringList errors;
+    auto stem = QFileInfo(vbf_path).completeBaseName();
+
+    ThemeDocument doc;
+    doc.setMaxThreads(options.document_threads);
+    doc.setCompressionProfile(options.compression);
+    doc.setVerifyCompression(options.verify);
+    doc.setPaletteMapper(options.palette_mapper);
+
+    auto save_trace = qScopeGuard([&doc, &options, &stem]() {
+        if (options.trace_dir.isEmpty()) return;
+        QFile file(QDir(options.trace_dir).absoluteFilePath(stem + "_trace.json"));
+        if (file.open(QIODevice::WriteOnly)) {
+            file.write(doc.profiler().chromeTrace());
+        }
+    });
+
+    auto res = doc.unpackVBF(vbf_path);
+    if (!res.isEmpty()) {
+        return {res};
+    }
+
+    if (!options.export_csv_dir.isEmpty()) {
+        auto csv_path = QDir(options.export_csv_dir).absoluteFilePath(stem + "_objects.csv");
+        auto csv_res = HeaderCsv::write(doc.getHeaderLines(), csv_path, options.csv_format);
+        if (!csv_res.isEmpty()) {
+            return {csv_res};
+        }
+    }
+
+    if (!options.import_csv.isEmpty()) {
+        auto csv = HeaderCsv::read(options.import_csv);
+        if (!csv.errors.isEmpty()) {
+            return csv.errors;
+        }
+        auto csv_res = doc.setHeaderLines(csv.rows);
+        if (!csv_res.isEmpty()) {
+            return {csv_res};
+        }
+    }
+
+    if (!options.export_dir.isEmpty()) {
+        auto dest_dir = QDir(options.export_dir).absoluteFilePath(stem);
+        QDir().mkpath(dest_dir);
+        errors << doc.exportAll(dest_dir, options.export_format);
+    }
+
+    // every mismatch is reported at once, nothing is replaced then
+    if (!options.manifest.isEmpty()) {
+        errors << doc.ReplacePictures(options.manifest).errors;
+    }
+    if (!options.replace_dir.isEmpty()) {
+        errors << doc.ReplaceFromDirectory(options.replace_dir).errors;
+    }
+    if (options.patch) {
+        auto applied = doc.applyPatch(*options.patch);
+        errors << applied.errors;
+        for (const auto &warning : applied.warnings) {
+            qWarning().noquote() << vbf_path + ": " + warning;
+        }
+    }
+
+    if (!errors.isEmpty()) {
+        return errors;
+    }
+
+    if (!options.out_dir.isEmpty()) {
+        res = doc.packVBF(QDir(options.out_dir).absoluteFilePath(QFileInfo(vbf_path).fileName()));
+        if (!res.isEmpty()) {
+            return {res};
+        }
+
+        const auto &stats = doc.lastPackStats();
+        qInfo().noquote() << QString("%1: saved %2 images in %3 ms, %4 -> %5 bytes, palette dE %6, %7 groups by FTools")
+                .arg(vbf_path).arg(stats.items).arg(stats.elapsed_ms).arg(stats.bytes_in).arg(stats.bytes_out)
+                .arg(stats.palette_delta_e, 0, 'f', 2).arg(stats.palette_fallbacks);
+    }
+
+    // the VBF as saved is the theme, the base is what it's compared to
+    if (!options.diff_base.isEmpty()) {
+        ThemeDocument base;
+        auto base_res = base.unpackVBF(options.diff_base);
+        if (!base_res.isEmpty()) {
+            return {options.diff_base + ": " + base_res};
+        }
+        try {
+            auto patch = ThemePatch::diff(base, doc);
+            auto patch_path = QDir(options.patch_dir).absoluteFilePath(stem + ThemePatch::fileSuffix);
+            patch.save(patch_path);
+            qInfo().noquote() << QString("%1: %2 images, %3 header rows, %4 bytes")
+                    .arg(patch_path).arg(patch.items.size()).arg(patch.rows.size()).arg(patch.itemsBytes());
+        } catch (const std::runtime_error &ex) {
+            return {ex.what()};
+        }
+    }
+
+    return {};
+}
+
+int BatchRunner::run(const QStringList &arguments) {
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Ford focus mk 3.* IPC theme editor, batch mode");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"batch", "Run without GUI."},
+        {{"o", "out-dir"}, "Write packed VBFs to <dir>.", "dir"},
+        {{"e", "export-dir"}, "Export all images to <dir>/<vbf name>/.", "dir"},
+        {"export-format", "Exported images format: bmp or png.", "format", "bmp"},
+        {{"m", "manifest"}, "JSON manifest of replaced images, all of them are replaced or none.", "file"},
+        {"replace-dir", "Replace images with same named BMPs from <dir>, all of them or none.", "dir"},
+        {"apply-patch", "Apply a theme patch.", "file"},
+        {"diff-base", "Write changes against the base VBF to <patch dir>/<vbf name>.vbfpatch.", "vbf"},
+        {"patch-dir", "Directory of patches made with --diff-base.", "dir", "."},
+        {"import-csv", "Replace header objects from <file>.", "file"},
+        {"export-csv", "Export header objects to <dir>/<vbf name>_objects.csv.", "dir"},
+        {"csv-format", "Exported objects CSV: ftools, as earlier versions wrote it, or named, "
+                       "with a line of column names.", "format", "ftools"},
+        {{"c", "compression"}, "Compression profile: fast, default or max.", "profile", "default"},
+        {"verify", "Verify every compressed image."},
+        {"palette-mapper", "Shared palettes of 16-bit pictures: median-cut or ftools.", "mapper", "median-cut"},
+        {"trace", "Write Chrome traces of the stages to <dir>/<vbf name>_trace.json.", "dir"},
+        {{"j", "jobs"}, "Number of VBFs processed at once.", "count"},
+    });
+    parser.addPositionalArgument("vbf", "VBF files to process.", "<vbf>...");
+    parser.process(arguments);
+
+    QTextStream err(stderr);
+
+    auto inputs = parser.positionalArguments();
+    if (inputs.isEmpty()) {
+        err << "No VBF files given" << '\n';
+        return 1;
+    }
+
+    sOptions options;
+    options.out_dir = parser.value("out-dir");
+    options.export_dir = parser.value("export-dir");
+    options.import_csv = parser.value("import-csv");
+    options.replace_dir = parser.value("replace-dir");
+    options.export_csv_dir = parser.value("export-csv");
+    options.verify = parser.isSet("verify");
+    options.trace_dir = parser.value("trace");
+    options.diff_base = parser.value("diff-base");
+    options.patch_dir = parser.value("patch-dir");
+
+    auto export_format = parser.value("export-format");
+    if (export_format == "png") {
+        options.export_format = ThemeDocument::EXPORT_PNG;
+    } else if (export_format != "bmp") {
+        err << "Unknown export format " << export_format << '\n';
+        return 1;
+    }
+
+    auto csv_format = parser.value("csv-format");
+    if (csv_format == "named") {
+        options.csv_format = HeaderCsv::FORMAT_NAMED;
+    } else if (csv_format != "ftools") {
+        err << "Unknown CSV format " << csv_format << '\n';
+        return 1;
+    }
+
+    auto palette_mapper = parser.value("palette-mapper");
+    if (palette_mapper == "ftools") {
+        options.palette_mapper = ThemeDocument::PALETTE_MAPPER_FTOOLS;
+    } else if (palette_mapper != "median-cut") {
+        err << "Unknown palette mapper " << palette_mapper << '\n';
+        return 1;
+    }
+
+    auto compression = parser.value("compression");
+    if (compression == "fast") {
+        options.compression = ThemeDocument::COMPRESSION_FAST;
+    } else if (compression == "max") {
+        options.compression = ThemeDocument::COMPRESSION_MAX;
+    } else if (compression != "default") {
+        err << "Unknown compression profile " << compression << '\n';
+        return 1;
+    }
+
+    try {
+        if (parser.isSet("manifest")) {
+            options.manifest = loadManifest(parser.value("manifest"));
+        }
+        if (parser.isSet("apply-patch")) {
+            options.patch = std::make_shared<const ThemePatch>(ThemePatch::load(parser.value("apply-patch")));
+        }
+    } catch (const std::runtime_error &ex) {
+        err << ex.what() << '\n';
+        return 1;
+    }
+
+    if ((!options.manifest.isEmpty() || !options.replace_dir.isEmpty() || !options.import_csv.isEmpty() ||
+         options.patch) && options.out_dir.isEmpty()) {
+        err << "Changes requested, but no --out-dir given" << '\n';
+        return 1;
+    }
+    for (const auto &dir : {options.out_dir, options.export_dir, options.export_csv_dir, options.trace_dir,
+                            options.diff_base.isEmpty() ? QString() : options.patch_dir}) {
+        if (!dir.isEmpty()) {
+            QDir().mkpath(dir);
+        }
+    }
+
+    // outputs are named after the inputs, same named VBFs from different directories would overwrite each other
+    QMap<QString, QString> names;
+    for (const auto &input : inputs) {
+        const auto name = QFileInfo(input).fileName().toLower();
+        if (names.contains(name)) {
+            err << "Same file name, the outputs would collide: " << names[name] << ", " << input << '\n';
+            return 1;
+        }
+        names[name] = input;
+    }
+
+    // this pool only limits how many VBFs are open at once, every document
+    // runs its work on a pool of its own, so they split the cores between them
+    QThreadPool pool;
+    if (parser.isSet("jobs")) {
+        pool.setMaxThreadCount(std::max(1, parser.value("jobs").toInt()));
+    }
+    const int concurrent = std::min(pool.maxThreadCount(), (int) inputs.size());
+    options.document_threads = std::max(1, QThread::idealThreadCount() / concurrent);
+
+    QList<QFuture<QStringList>> futures;
+    for (const auto &input : inputs) {
+        futures << QtConcurrent::run(&pool, &BatchRunner::processVbf, input, options);
+    }
+
+    int failed = 0;
+    for (int i = 0; i < inputs.size(); ++i) {
+        const auto errors = futures[i].result();
+        for (const auto &error : errors) {
+            err << inputs[i] << ": " << error << '\n';
+        }
+        failed += errors.isEmpty() ? 0 : 1;
+    }
+
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,53 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_BATCHRUNNER_H
+#define FOCUSIPC_BATCHRUNNER_H
+
+#include <QtCore>
+
+#include "HeaderCsv.h"
+#include "ThemeDocument.h"
+#include "ThemePatch.h"
+
+/*
+ * Headless mode: unpack, export, replace and pack a set of VBFs from the command line.
+ *
+ * Manifest is a JSON object mapping image names to replacement BMPs,
+ * relative BMP paths are resolved against the manifest directory:
+ *   { "speedo_needle.eif": "needles/speedo.bmp", ... }
+ *
+ * A patch made with --diff-base rolls the same changes onto other bases with --apply-patch.
+ */
+class BatchRunner {
+
+public:
+    static bool isBatchMode(int argc, char *argv[]);
+    static int run(const QStringList &arguments);
+
+private:
+    struct sOptions {
+        QString out_dir;
+        QString export_dir;
+        ThemeDocument::enExportFormat export_format = ThemeDocument::EXPORT_BMP;
+        QString import_csv;
+        QString export_csv_dir;
+        HeaderCsv::enFormat csv_format = HeaderCsv::FORMAT_FTOOLS;
+        QString trace_dir;
+        QMap<QString, QString> manifest;
+        QString replace_dir;
+        std::shared_ptr<const ThemePatch> patch; // loaded once for all VBFs
+        QString diff_base;
+        QString patch_dir;
+        ThemeDocument::enCompressionProfile compression = ThemeDocument::COMPRESSION_DEFAULT;
+        bool verify = false;
+        ThemeDocument::enPaletteMapper palette_mapper = ThemeDocument::PALETTE_MAPPER_MEDIAN_CUT;
+        int document_threads = 1; // share of the cores for each VBF processed at once
+    };
+
+    static QMap<QString, QString> loadManifest(const QString &path);
+    static QStringList processVbf(const QString &vbf_path, const sOptions &options);
+};
+
+#endif //FOCUSIPC_BATCHRUNNER_H
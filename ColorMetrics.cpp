@@ -0,0 +1,81 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "ColorMetrics.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+    struct sLab {
+        double L, a, b;
+    };
+
+    const std::array<double, 256> &srgbToLinear() {
+        static const auto table = [] {
+            std::array<double, 256> t{};
+            for (int i = 0; i < 256; ++i) {
+                double c = i / 255.0;
+                t[i] = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    inline double labF(double t) {
+        return t > 0.008856 ? std::cbrt(t) : 7.787 * t + 16.0 / 116.0;
+    }
+
+    // sRGB (D65) to CIE Lab
+    sLab toLab(const uint8_t *px) {
+        const auto &lin = srgbToLinear();
+        double r = lin[px[0]], g = lin[px[1]], b = lin[px[2]];
+
+        double x = (0.4124 * r + 0.3576 * g + 0.1805 * b) / 0.95047;
+        double y = (0.2126 * r + 0.7152 * g + 0.0722 * b);
+        double z = (0.0193 * r + 0.1192 * g + 0.9505 * b) / 1.08883;
+
+        double fx = labF(x), fy = labF(y), fz = labF(z);
+        return {116 * fy - 16, 500 * (fx - fy), 200 * (fy - fz)};
+    }
+}
+
+ColorMetrics::sDeltaE &ColorMetrics::sDeltaE::operator+=(const sDeltaE &other) {
+    sum += other.sum;
+    pixels += other.pixels;
+    max = std::max(max, other.max);
+    return *this;
+}
+
+ColorMetrics::sDeltaE ColorMetrics::deltaE(const std::vector<uint8_t> &rgba_ref, const std::vector<uint8_t> &rgba) {
+
+    if (rgba_ref.size() != rgba.size()) {
+        throw std::runtime_error("Compared bitmaps size mismatch");
+    }
+
+    sDeltaE res;
+    for (size_t i = 0; i + 3 < rgba.size(); i += 4) {
+        if (0 == rgba_ref[i + 3] && 0 == rgba[i + 3]) continue;
+
+        // same colour, skip the Lab math
+        if (std::equal(&rgba_ref[i], &rgba_ref[i + 3], &rgba[i])) {
+            res.pixels++;
+            continue;
+        }
+
+        auto l1 = toLab(&rgba_ref[i]);
+        auto l2 = toLab(&rgba[i]);
+        double d = std::sqrt((l1.L - l2.L) * (l1.L - l2.L) + (l1.a - l2.a) * (l1.a - l2.a) +
+                             (l1.b - l2.b) * (l1.b - l2.b));
+        res.sum += d;
+        res.max = std::max(res.max, d);
+        res.pixels++;
+    }
+
+    return res;
+}
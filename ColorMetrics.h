@@ -0,0 +1,27 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_COLORMETRICS_H
+#define FOCUSIPC_COLORMETRICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ColorMetrics {
+
+    struct sDeltaE {
+        double sum = 0;     // sum of CIE76 dE over compared pixels
+        size_t pixels = 0;  // pixels visible in any of the bitmaps
+        double max = 0;
+
+        [[nodiscard]] double mean() const { return pixels ? sum / (double) pixels : 0; }
+        sDeltaE &operator+=(const sDeltaE &other);
+    };
+
+    /* colour error between two RGBA8888 bitmaps of the same size, fully transparent pixels are skipped */
+    sDeltaE deltaE(const std::vector<uint8_t> &rgba_ref, const std::vector<uint8_t> &rgba);
+}
+
+#endif //FOCUSIPC_COLORMETRICS_H
@@ -0,0 +1,116 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "DecodeCache.h"
+
+#include <CRC.h>
+
+#include <cstring>
+
+DecodeCache::DecodeCache(QString dir) : m_dir(std::move(dir)) {
+}
+
+QString DecodeCache::defaultDir() {
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/decoded";
+}
+
+QString DecodeCache::key(std::span<const uint8_t> zipped_eif) {
+
+    // zip keeps CRC-32 of the EIF, but the whole archive is hashed to tell apart
+    // different compressions of one picture and broken copies
+    static const CRC::Table<crcpp_uint64, 64> table(CRC::CRC_64());
+    auto crc = CRC::Calculate(zipped_eif.data(), zipped_eif.size(), table);
+    return QString("%1-%2").arg((qulonglong) crc, 16, 16, QChar('0')).arg(zipped_eif.size());
+}
+
+void DecodeCache::setEnabled(bool enabled) {
+    m_enabled = enabled;
+}
+
+void DecodeCache::setBudget(qint64 bytes) {
+    m_budget = bytes;
+    trim();
+}
+
+QImage DecodeCache::load(const QString &key) const {
+
+    if (!isEnabled()) return {};
+
+    QFile file(m_dir + "/" + key);
+    if (!file.open(QIODevice::ReadOnly)) return {};
+
+    // [magic][u32 width][u32 height][u32 QImage::Format][pixels, bytesPerLine * height]
+    QDataStream in(&file);
+    in.setByteOrder(QDataStream::LittleEndian);
+    char file_magic[sizeof(magic)];
+    quint32 width, height, format;
+    if (in.readRawData(file_magic, sizeof(file_magic)) != sizeof(file_magic) ||
+        0 != memcmp(file_magic, magic, sizeof(magic))) {
+        return {};
+    }
+    in >> width >> height >> format;
+    if (in.status() != QDataStream::Ok || format != QImage::Format_ARGB32_Premultiplied) {
+        return {};
+    }
+
+    QImage image((int) width, (int) height, QImage::Format_ARGB32_Premultiplied);
+    if (image.isNull() || file.size() - file.pos() != image.sizeInBytes()) {
+        return {};
+    }
+    if (in.readRawData((char *) image.bits(), (int) image.sizeInBytes()) != image.sizeInBytes()) {
+        return {};
+    }
+
+    // last use decides what is evicted
+    file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+
+    return image;
+}
+
+void DecodeCache::store(const QString &key, const QImage &image) {
+
+    if (!isEnabled() || image.isNull()) return;
+
+    auto argb = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    QDir().mkpath(m_dir);
+
+    // written aside and renamed, so a concurrent reader sees the old entry or the complete new one
+    QSaveFile file(m_dir + "/" + key);
+    if (!file.open(QIODevice::WriteOnly)) return;
+
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData(magic, sizeof(magic));
+    out << (quint32) argb.width() << (quint32) argb.height() << (quint32) argb.format();
+    out.writeRawData((const char *) argb.constBits(), (int) argb.sizeInBytes());
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        qWarning() << "Can't store decoded image" << key;
+        return;
+    }
+
+    if (0 == m_stores++ % trimInterval) {
+        trim();
+    }
+}
+
+void DecodeCache::trim() {
+
+    QMutexLocker locker(&m_trimMutex);
+
+    // newest first, everything past the budget goes
+    auto entries = QDir(m_dir).entryInfoList(QDir::Files, QDir::Time);
+    qint64 total = 0;
+    const qint64 budget = m_budget;
+    for (const auto &entry : entries) {
+        total += entry.size();
+        if (total > budget) {
+            QFile::remove(entry.filePath());
+        }
+    }
+}
+
+void DecodeCache::clear() {
+    QMutexLocker locker(&m_trimMutex);
+    QDir(m_dir).removeRecursively();
+}
@@ -0,0 +1,52 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_DECODECACHE_H
+#define FOCUSIPC_DECODECACHE_H
+
+#include <QtCore>
+#include <QImage>
+
+#include <atomic>
+#include <span>
+
+/*
+ * Decoded pictures kept on disk between sessions.
+ *
+ * Entries are addressed by a hash of the zipped EIF, so another theme
+ * built from the same firmware base hits the pictures it shares.
+ * The oldest entries are evicted once the cache grows over its budget.
+ * Safe to use from several threads, entries are replaced atomically.
+ */
+class DecodeCache {
+
+public:
+    explicit DecodeCache(QString dir = defaultDir());
+
+    static QString defaultDir();
+    static QString key(std::span<const uint8_t> zipped_eif);
+
+    void setEnabled(bool enabled);
+    [[nodiscard]] bool isEnabled() const { return m_enabled; }
+    void setBudget(qint64 bytes);
+
+    /* null image on a miss */
+    [[nodiscard]] QImage load(const QString &key) const;
+    void store(const QString &key, const QImage &image);
+    void clear();
+
+private:
+    void trim();
+
+    static constexpr char magic[8] = {'F', 'I', 'P', 'C', 'D', 'C', '0', '1'};
+    static constexpr int trimInterval = 64; // stores between eviction scans
+
+    QString m_dir;
+    std::atomic<bool> m_enabled = true;
+    std::atomic<qint64> m_budget = 512ll * 1024 * 1024;
+    std::atomic<int> m_stores = 0;
+    QMutex m_trimMutex;
+};
+
+#endif //FOCUSIPC_DECODECACHE_H
@@ -0,0 +1,87 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "DiagnosticsDialog.h"
+
+DiagnosticsDialog::DiagnosticsDialog(Profiler &profiler, QWidget *parent) :
+        QDialog(parent), m_profiler(profiler) {
+
+    setWindowTitle("Diagnostics");
+    resize(820, 360);
+
+    m_table = new QTableWidget(0, COL_COUNT, this);
+    m_table->setHorizontalHeaderLabels({"Stage", "Calls", "Total, ms", "Max, ms", "Slowest", "MB", "Allocations"});
+    m_table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_table->verticalHeader()->hide();
+    m_table->horizontalHeader()->setSectionResizeMode(COL_SLOWEST, QHeaderView::Stretch);
+
+    m_summary = new QLabel(this);
+
+    auto buttons = new QDialogButtonBox(QDialogButtonBox::Close, this);
+    buttons->addButton("Refresh", QDialogButtonBox::ActionRole)->setObjectName("refresh");
+    buttons->addButton("Clear", QDialogButtonBox::ResetRole)->setObjectName("clear");
+    buttons->addButton("Export trace...", QDialogButtonBox::ActionRole)->setObjectName("trace");
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+    connect(buttons, &QDialogButtonBox::clicked, this, [this](QAbstractButton *button) {
+        if (button->objectName() == "refresh") {
+            refresh();
+        } else if (button->objectName() == "clear") {
+            m_profiler.clear();
+            refresh();
+        } else if (button->objectName() == "trace") {
+            exportTrace();
+        }
+    });
+
+    auto layout = new QVBoxLayout(this);
+    layout->addWidget(m_table);
+    layout->addWidget(m_summary);
+    layout->addWidget(buttons);
+
+    refresh();
+}
+
+void DiagnosticsDialog::refresh() {
+
+    const auto stages = m_profiler.stages();
+    m_table->setRowCount((int) stages.size());
+
+    auto number = [](double value, int precision = 0) {
+        auto item = new QTableWidgetItem(QString::number(value, 'f', precision));
+        item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+        return item;
+    };
+
+    for (int row = 0; row < (int) stages.size(); ++row) {
+        const auto &stage = stages[row];
+        m_table->setItem(row, COL_STAGE, new QTableWidgetItem(stage.name));
+        m_table->setItem(row, COL_CALLS, number((double) stage.calls));
+        m_table->setItem(row, COL_TOTAL, number((double) stage.total_us / 1000, 1));
+        m_table->setItem(row, COL_MAX, number((double) stage.max_us / 1000, 1));
+        m_table->setItem(row, COL_SLOWEST, new QTableWidgetItem(QString::fromStdString(stage.slowest)));
+        m_table->setItem(row, COL_MBYTES, number((double) stage.bytes / (1024 * 1024), 2));
+        m_table->setItem(row, COL_ALLOCATIONS, number((double) stage.allocations));
+    }
+    // only counted where an allocation counter is installed, see Profiler::setAllocationCounter()
+    m_table->setColumnHidden(COL_ALLOCATIONS, std::none_of(stages.begin(), stages.end(), [](const auto &stage) {
+        return stage.allocations != 0;
+    }));
+    m_table->resizeColumnsToContents();
+
+    m_summary->setText(QString("%1 events recorded, totals include time of nested stages")
+                               .arg(m_profiler.eventsCount()));
+}
+
+void DiagnosticsDialog::exportTrace() {
+
+    auto path = QFileDialog::getSaveFileName(this, "Export Chrome trace", "focusipc_trace.json",
+                                             "Chrome trace (*.json)");
+    if (path.isEmpty()) return;
+
+    QFile file(path);
+    auto trace = m_profiler.chromeTrace();
+    if (!file.open(QIODevice::WriteOnly) || file.write(trace) != trace.size()) {
+        QMessageBox(QMessageBox::Warning, "", "Can't write " + path, QMessageBox::Ok, this).exec();
+    }
+}
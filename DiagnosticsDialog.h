@@ -0,0 +1,43 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_DIAGNOSTICSDIALOG_H
+#define FOCUSIPC_DIAGNOSTICSDIALOG_H
+
+#include <QtWidgets>
+
+#include "Profiler.h"
+
+/*
+ * Per-stage timings collected by the document profiler,
+ * with export to a Chrome trace file for a closer look.
+ */
+class DiagnosticsDialog : public QDialog {
+
+    Q_OBJECT
+
+public:
+    explicit DiagnosticsDialog(Profiler &profiler, QWidget *parent = nullptr);
+
+private:
+    enum enColumns {
+        COL_STAGE,
+        COL_CALLS,
+        COL_TOTAL,
+        COL_MAX,
+        COL_SLOWEST,
+        COL_MBYTES,
+        COL_ALLOCATIONS,
+        COL_COUNT
+    };
+
+    void refresh();
+    void exportTrace();
+
+    Profiler &m_profiler;
+    QTableWidget *m_table;
+    QLabel *m_summary;
+};
+
+#endif //FOCUSIPC_DIAGNOSTICSDIALOG_H
@@ -0,0 +1,104 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "EifZip.h"
+
+#include <miniz_zip.h>
+#include <EifConverter.h>
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+vector<uint8_t> EifZip::unzip(span<const uint8_t> zipped_data, string *p_eif_name) {
+
+    mz_zip_archive zip_archive{};
+    if (!mz_zip_reader_init_mem(&zip_archive,
+                                (const void *) zipped_data.data(), zipped_data.size(), 0)) {
+        throw runtime_error("Can't get image name form archive");
+    }
+    mz_zip_archive_file_stat file_stat;
+    mz_zip_reader_file_stat(&zip_archive, 0, &file_stat);
+    vector<uint8_t> eif(file_stat.m_uncomp_size);
+    mz_zip_reader_extract_to_mem(&zip_archive, 0, (void *) eif.data(), eif.size(), 0);
+    mz_zip_reader_end(&zip_archive);
+
+    if (nullptr != p_eif_name) {
+        *p_eif_name = file_stat.m_filename;
+    }
+
+    return eif;
+}
+
+vector<uint8_t> EifZip::peek(span<const uint8_t> zipped_data, string *p_eif_name) {
+
+    mz_zip_archive zip_archive{};
+    if (!mz_zip_reader_init_mem(&zip_archive,
+                                (const void *) zipped_data.data(), zipped_data.size(), 0)) {
+        throw runtime_error("Can't get image name form archive");
+    }
+    mz_zip_archive_file_stat file_stat;
+    mz_zip_reader_file_stat(&zip_archive, 0, &file_stat);
+
+    auto iter = mz_zip_reader_extract_iter_new(&zip_archive, 0, 0);
+    if (nullptr == iter) {
+        mz_zip_reader_end(&zip_archive);
+        throw runtime_error("Can't inflate image header");
+    }
+    vector<uint8_t> head(min<size_t>(peekSize, file_stat.m_uncomp_size));
+    head.resize(mz_zip_reader_extract_iter_read(iter, (void *) head.data(), head.size()));
+    mz_zip_reader_extract_iter_free(iter);
+    mz_zip_reader_end(&zip_archive);
+
+    if (head.size() < sizeof(EIF::EifBaseHeader)) {
+        throw runtime_error("Broken image header");
+    }
+
+    if (nullptr != p_eif_name) {
+        *p_eif_name = file_stat.m_filename;
+    }
+
+    return head;
+}
+
+static size_t zipWriteToVector(void *pOpaque, mz_uint64 file_ofs, const void *pBuf, size_t n) {
+
+    auto &out = *static_cast<vector<uint8_t> *>(pOpaque);
+    if (out.size() < file_ofs + n) {
+        out.resize(file_ofs + n);
+    }
+    memcpy(out.data() + file_ofs, pBuf, n);
+
+    return n;
+}
+
+vector<uint8_t> EifZip::compress(const vector<uint8_t> &data, const string &data_name, unsigned level) {
+
+    mz_zip_archive zip_archive = {};
+    unsigned flags = level | MZ_ZIP_FLAG_ASCII_FILENAME;
+
+    // archive is written straight to the output vector
+    vector<uint8_t> compressed_data;
+    compressed_data.reserve(data.size() / 2);
+    zip_archive.m_pWrite = zipWriteToVector;
+    zip_archive.m_pIO_opaque = &compressed_data;
+
+    if (!mz_zip_writer_init(&zip_archive, 0)) {
+        throw runtime_error("mz_zip_writer_init failed for " + data_name);
+    }
+
+    if (!mz_zip_writer_add_mem_ex(&zip_archive, data_name.c_str(), (void *) data.data(), data.size(),
+                                  "", 0, flags, 0, 0) ||
+        !mz_zip_writer_finalize_archive(&zip_archive)) {
+        mz_zip_writer_end(&zip_archive);
+        throw runtime_error("Can't compress resource " + data_name);
+    }
+
+    if (!mz_zip_writer_end(&zip_archive)) {
+        throw runtime_error("mz_zip_writer_end failed for " + data_name);
+    }
+
+    return compressed_data;
+}
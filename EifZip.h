@@ -0,0 +1,33 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_EIFZIP_H
+#define FOCUSIPC_EIFZIP_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <miniz.h>
+
+/*
+ * Single-file zip archives holding EIFs in the image section.
+ * All functions throw runtime_error on a broken archive.
+ */
+namespace EifZip {
+
+    /* EIF header is followed by the palette, that's all needed to list a picture */
+    constexpr size_t peekSize = 0x10 + 768;
+
+    std::vector<uint8_t> unzip(std::span<const uint8_t> zipped_data, std::string *p_eif_name = nullptr);
+
+    /* inflate only the first peekSize bytes of EIF */
+    std::vector<uint8_t> peek(std::span<const uint8_t> zipped_data, std::string *p_eif_name = nullptr);
+
+    std::vector<uint8_t> compress(const std::vector<uint8_t> &data, const std::string &data_name,
+                                  unsigned level = MZ_DEFAULT_LEVEL);
+}
+
+#endif //FOCUSIPC_EIFZIP_H
@@ -0,0 +1,323 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "HeaderCsv.h"
+#include "JobScheduler.h"
+#include "Progress.h"
+
+#include <charconv>
+#include <limits>
+
+using Record = ImageSection::HeaderRecord;
+
+template<class T>
+static uint32_t limitOf() {
+    return (uint32_t) std::min<uint64_t>(std::numeric_limits<T>::max(), std::numeric_limits<uint32_t>::max());
+}
+
+const char *HeaderCsv::columnName(int column) {
+    switch (column) {
+        case COL_WIDTH: return "width";
+        case COL_HEIGHT: return "height";
+        case COL_X: return "X";
+        case COL_Y: return "Y";
+        case COL_TYPE: return "type";
+        case COL_Z: return "Z";
+        case COL_INTENSITY: return "intensity";
+        case COL_R: return "R";
+        case COL_G: return "G";
+        case COL_B: return "B";
+        case COL_PALETTE: return "palette_id";
+        default: return "";
+    }
+}
+
+uint32_t HeaderCsv::field(const Record &record, int column) {
+    switch (column) {
+        case COL_WIDTH: return record.width;
+        case COL_HEIGHT: return record.height;
+        case COL_X: return record.X;
+        case COL_Y: return record.Y;
+        case COL_TYPE: return record.type;
+        case COL_Z: return record.Z;
+        case COL_INTENSITY: return record.intensity;
+        case COL_R: return record.R;
+        case COL_G: return record.G;
+        case COL_B: return record.B;
+        case COL_PALETTE: return record.palette_id;
+        default: return 0;
+    }
+}
+
+uint32_t HeaderCsv::maxValue(int column) {
+    switch (column) {
+        case COL_WIDTH: return limitOf<decltype(Record::width)>();
+        case COL_HEIGHT: return limitOf<decltype(Record::height)>();
+        case COL_X: return limitOf<decltype(Record::X)>();
+        case COL_Y: return limitOf<decltype(Record::Y)>();
+        case COL_MAX: return 0;
+        default: return std::numeric_limits<uint8_t>::max(); // the firmware keeps the rest in a byte
+    }
+}
+
+bool HeaderCsv::setField(Record &record, int column, uint32_t value) {
+
+    if (column < 0 || column >= COL_MAX || value > maxValue(column)) {
+        return false;
+    }
+    switch (column) {
+        case COL_WIDTH: record.width = (decltype(record.width)) value; break;
+        case COL_HEIGHT: record.height = (decltype(record.height)) value; break;
+        case COL_X: record.X = (decltype(record.X)) value; break;
+        case COL_Y: record.Y = (decltype(record.Y)) value; break;
+        case COL_TYPE: record.type = (decltype(record.type)) value; break;
+        case COL_Z: record.Z = (decltype(record.Z)) value; break;
+        case COL_INTENSITY: record.intensity = (decltype(record.intensity)) value; break;
+        case COL_R: record.R = (decltype(record.R)) value; break;
+        case COL_G: record.G = (decltype(record.G)) value; break;
+        case COL_B: record.B = (decltype(record.B)) value; break;
+        default: record.palette_id = (decltype(record.palette_id)) value; break;
+    }
+    return true;
+}
+
+/* [begin, end) of the fields of one line, quotes and spaces around values are dropped */
+static std::vector<std::pair<const char *, const char *>> splitLine(const char *p, const char *end, char separator) {
+
+    std::vector<std::pair<const char *, const char *>> fields;
+    while (true) {
+        auto next = std::find(p, end, separator);
+        auto b = p, e = next;
+        while (b < e && (*b == ' ' || *b == '\t' || *b == '"')) ++b;
+        while (e > b && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '"')) --e;
+        fields.emplace_back(b, e);
+        if (next == end) break;
+        p = next + 1;
+    }
+    return fields;
+}
+
+static bool parseUInt(const char *begin, const char *end, uint32_t &value) {
+    auto [p, ec] = std::from_chars(begin, end, value);
+    return begin != end && ec == std::errc() && p == end;
+}
+
+static int columnByName(QString name) {
+
+    // names of the table headers are taken as well
+    name = name.toLower();
+    if (name == "z index") return HeaderCsv::COL_Z;
+    if (name == "palette") return HeaderCsv::COL_PALETTE;
+    for (int column = 0; column < HeaderCsv::COL_MAX; ++column) {
+        if (name == QString(HeaderCsv::columnName(column)).toLower()) {
+            return column;
+        }
+    }
+    return -1;
+}
+
+/* [begin, end) of a line without the line break and the BOM of the first one, empty for blanks and comments */
+static std::pair<const char *, const char *> lineContent(const QByteArray &line, bool first) {
+
+    const char *begin = line.constData();
+    const char *end = begin + line.size();
+    if (first && line.startsWith("\xEF\xBB\xBF")) {
+        begin += 3;
+    }
+    while (end > begin && (end[-1] == '\n' || end[-1] == '\r')) --end;
+    if (begin == end || *begin == '#') return {end, end};
+    return {begin, end};
+}
+
+static char separatorOf(const char *begin, const char *end) {
+    return std::count(begin, end, ';') > std::count(begin, end, ',') ? ';' : ',';
+}
+
+/* the first line of a named file names at least one of the columns */
+static bool isNamesLine(const char *begin, const char *end) {
+
+    for (auto [b, e] : splitLine(begin, end, separatorOf(begin, end))) {
+        if (columnByName(QString::fromUtf8(b, (int) (e - b))) >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+HeaderCsv::sResult HeaderCsv::read(QIODevice &device) {
+
+    sResult result;
+    auto job = JobContext::current();
+    ProgressMeter progress("csv", 1, std::max<qint64>(0, device.size()), [job](const sProgress &snapshot) {
+        if (job) job->setProgress(snapshot);
+    });
+
+    // field position -> column, -1 for the skipped ones
+    std::vector<int> columns;
+    char separator = ',';
+    int bad_rows = 0;
+    int line_no = 0;
+    QByteArray line;
+
+    while (!device.atEnd()) {
+        line = device.readLine();
+        line_no++;
+        progress.advance(0, line.size());
+        if (line_no % cancelCheckLines == 0) {
+            if (job && job->isCancelled()) {
+                result.errors = QStringList{JobCancelled().what()};
+                return result;
+            }
+        }
+
+        auto [begin, end] = lineContent(line, line_no == 1);
+        if (begin == end) continue;
+
+        if (columns.empty()) {
+            // the names line tells the separator and the order of the columns
+            if (!isNamesLine(begin, end)) {
+                result.errors << QString("Line %1: no column names, a file without them is read by FTools")
+                        .arg(line_no);
+                return result;
+            }
+            separator = separatorOf(begin, end);
+            std::vector<bool> found(COL_MAX);
+            for (auto [b, e] : splitLine(begin, end, separator)) {
+                auto column = columnByName(QString::fromUtf8(b, (int) (e - b)));
+                columns.push_back(column);
+                if (column >= 0) found[column] = true;
+            }
+            QStringList missing;
+            for (int column = 0; column < COL_MAX; ++column) {
+                if (!found[column]) missing << columnName(column);
+            }
+            result.named = true;
+            if (!missing.isEmpty()) {
+                result.errors << QString("Line %1: no %2 columns").arg(line_no).arg(missing.join(", "));
+                return result;
+            }
+            continue;
+        }
+
+        auto fields = splitLine(begin, end, separator);
+        Record record{};
+        QStringList problems;
+        if (fields.size() < columns.size()) {
+            problems << QString("%1 values of %2").arg(fields.size()).arg(columns.size());
+        } else {
+            for (size_t i = 0; i < columns.size(); ++i) {
+                const int column = columns[i];
+                if (column < 0) continue;
+                auto [b, e] = fields[i];
+                uint32_t value;
+                if (!parseUInt(b, e, value)) {
+                    problems << QString("%1 \"%2\" isn't a number").arg(columnName(column))
+                            .arg(QString::fromUtf8(b, (int) (e - b)));
+                } else if (!setField(record, column, value)) {
+                    problems << QString("%1 %2 is over %3").arg(columnName(column)).arg(value).arg(maxValue(column));
+                }
+            }
+        }
+
+        if (!problems.isEmpty()) {
+            if (++bad_rows <= maxErrors) {
+                result.errors << QString("Line %1: %2").arg(line_no).arg(problems.join(", "));
+            }
+            continue;
+        }
+        result.rows.push_back(record);
+    }
+
+    if (bad_rows > maxErrors) {
+        result.errors << QString("%1 more bad rows").arg(bad_rows - maxErrors);
+    }
+    if (result.rows.empty() && result.errors.isEmpty()) {
+        result.errors << "No objects in the file";
+    }
+    progress.advance(1);
+    return result;
+}
+
+HeaderCsv::sResult HeaderCsv::read(const QString &path) {
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        sResult result;
+        result.errors << QString("Can't open %1: %2").arg(path, file.errorString());
+        return result;
+    }
+
+    // the first line that isn't blank or a comment tells the format
+    bool named = false;
+    for (bool first = true; !file.atEnd(); first = false) {
+        auto line = file.readLine();
+        auto [begin, end] = lineContent(line, first);
+        if (begin != end) {
+            named = isNamesLine(begin, end);
+            break;
+        }
+    }
+    if (!named) {
+        file.close();
+        return readFtools(path);
+    }
+    file.seek(0);
+    return read(file);
+}
+
+HeaderCsv::sResult HeaderCsv::readFtools(const QString &path) {
+
+    sResult ftools;
+    try {
+        ftools.rows = ImageSection::HeaderFromCsv(path.toStdWString());
+    } catch (const std::exception &ex) {
+        ftools.errors << QString("Can't read %1: %2").arg(path, ex.what());
+        return ftools;
+    }
+    if (ftools.rows.empty()) {
+        ftools.errors << "No objects in the file";
+        return ftools;
+    }
+    for (size_t row = 0; row < ftools.rows.size(); ++row) {
+        for (int column = 0; column < COL_MAX; ++column) {
+            auto value = field(ftools.rows[row], column);
+            if (value > maxValue(column) && ftools.errors.size() < maxErrors) {
+                ftools.errors << QString("Row %1: %2 %3 is over %4").arg(row + 1).arg(columnName(column))
+                        .arg(value).arg(maxValue(column));
+            }
+        }
+    }
+    return ftools;
+}
+
+QString HeaderCsv::write(const std::vector<Record> &rows, const QString &path, enFormat format) {
+
+    if (format == FORMAT_FTOOLS) {
+        try {
+            ImageSection::HeaderToCsv(rows, path.toStdWString());
+        } catch (const std::exception &ex) {
+            return QString("Can't write %1: %2").arg(path, ex.what());
+        }
+        return "";
+    }
+
+    QByteArray csv;
+    csv.reserve((int) (rows.size() + 1) * 48);
+    for (int column = 0; column < COL_MAX; ++column) {
+        csv += columnName(column);
+        csv += column + 1 < COL_MAX ? ',' : '\n';
+    }
+    for (const auto &row : rows) {
+        for (int column = 0; column < COL_MAX; ++column) {
+            csv += QByteArray::number(field(row, column));
+            csv += column + 1 < COL_MAX ? ',' : '\n';
+        }
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(csv) != csv.size() || !file.commit()) {
+        return QString("Can't write %1: %2").arg(path, file.errorString());
+    }
+    return "";
+}
@@ -0,0 +1,77 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_HEADERCSV_H
+#define FOCUSIPC_HEADERCSV_H
+
+#include <QtCore>
+
+#include <vector>
+
+#include <ImageSection.h>
+
+/*
+ * Header objects as CSV, one record per line.
+ *
+ * Files are written the way FTools' ImageSection::HeaderToCsv writes them
+ * unless the named format is asked for, which starts with a line of column
+ * names. The first line tells which one a file is: one naming any of the
+ * columns starts a named file, its columns are matched by name, so extra
+ * ones (an index, notes) are skipped. Lines are parsed as they are read,
+ * every value is checked against its field and each bad row is reported
+ * with its line number. Any other file is left to FTools' HeaderFromCsv
+ * and its rows are checked the same way. Run as a JobScheduler job the read
+ * reports the "csv" stage and stops once the job is cancelled.
+ */
+class HeaderCsv {
+
+public:
+    /* in the order of the objects table */
+    enum enColumn {
+        COL_WIDTH,
+        COL_HEIGHT,
+        COL_X,
+        COL_Y,
+        COL_TYPE,
+        COL_Z,
+        COL_INTENSITY,
+        COL_R,
+        COL_G,
+        COL_B,
+        COL_PALETTE,
+        COL_MAX
+    };
+
+    enum enFormat {
+        FORMAT_FTOOLS, // as ImageSection::HeaderToCsv, what earlier versions and other tools read
+        FORMAT_NAMED,  // a line of column names first
+    };
+
+    struct sResult {
+        std::vector<ImageSection::HeaderRecord> rows;
+        QStringList errors; // one per bad row, the rows can't be used if there are any
+        bool named = false; // the file had the names line
+    };
+
+    static const char *columnName(int column);
+    static uint32_t field(const ImageSection::HeaderRecord &record, int column);
+    static uint32_t maxValue(int column);
+    /* false if the value doesn't fit the field, the record isn't changed then */
+    static bool setField(ImageSection::HeaderRecord &record, int column, uint32_t value);
+
+    /* named files only, FTools reads its files from a path */
+    static sResult read(QIODevice &device);
+    static sResult read(const QString &path);
+    /* returns an error message or an empty string */
+    static QString write(const std::vector<ImageSection::HeaderRecord> &rows, const QString &path,
+                         enFormat format = FORMAT_FTOOLS);
+
+private:
+    static sResult readFtools(const QString &path);
+
+    static constexpr int maxErrors = 100;  // the rest are only counted
+    static constexpr int cancelCheckLines = 4096;
+};
+
+#endif //FOCUSIPC_HEADERCSV_H
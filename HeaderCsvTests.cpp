@@ -0,0 +1,128 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include <QtTest>
+
+#include "HeaderCsv.h"
+
+using Record = ImageSection::HeaderRecord;
+
+/*
+ * Objects CSV in both formats, the format told by the first line and the rows reported bad.
+ */
+class HeaderCsvTests : public QObject {
+
+    Q_OBJECT
+
+private slots:
+    void namedRoundTrip();
+    void ftoolsRoundTrip();
+    void namesNeeded();
+    void reportsBadRows();
+
+private:
+    static std::vector<Record> sampleRows();
+    static void compareRows(const std::vector<Record> &actual, const std::vector<Record> &expected);
+};
+
+std::vector<Record> HeaderCsvTests::sampleRows() {
+
+    // every field at 0 and at its limit, and a value of its own in every field so a swap of columns shows
+    std::vector<Record> rows(3);
+    for (int column = 0; column < HeaderCsv::COL_MAX; ++column) {
+        HeaderCsv::setField(rows[1], column, 7 * column + 1);
+        HeaderCsv::setField(rows[2], column, HeaderCsv::maxValue(column) - column);
+    }
+    return rows;
+}
+
+void HeaderCsvTests::compareRows(const std::vector<Record> &actual, const std::vector<Record> &expected) {
+
+    QCOMPARE(actual.size(), expected.size());
+    for (size_t row = 0; row < expected.size(); ++row) {
+        for (int column = 0; column < HeaderCsv::COL_MAX; ++column) {
+            QCOMPARE(HeaderCsv::field(actual[row], column), HeaderCsv::field(expected[row], column));
+        }
+    }
+}
+
+void HeaderCsvTests::namedRoundTrip() {
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto path = dir.filePath("objects.csv");
+    const auto rows = sampleRows();
+
+    QCOMPARE(HeaderCsv::write(rows, path, HeaderCsv::FORMAT_NAMED), QString());
+    auto result = HeaderCsv::read(path);
+    QCOMPARE(result.errors, QStringList());
+    QVERIFY(result.named);
+    compareRows(result.rows, rows);
+
+    // columns go by name, unknown ones are skipped
+    QBuffer buffer;
+    buffer.setData("\xEF\xBB\xBF# exported by hand\n"
+                   "index;palette_id;B;G;R;intensity;Z;type;Y;X;height;width\n"
+                   "7;1;2;3;4;5;6;8;9;10;11;12\n");
+    buffer.open(QIODevice::ReadOnly);
+    result = HeaderCsv::read(buffer);
+    QCOMPARE(result.errors, QStringList());
+    QCOMPARE(result.rows.size(), (size_t) 1);
+    const uint32_t expected[HeaderCsv::COL_MAX] = {12, 11, 10, 9, 8, 6, 5, 4, 3, 2, 1};
+    for (int column = 0; column < HeaderCsv::COL_MAX; ++column) {
+        QCOMPARE(HeaderCsv::field(result.rows[0], column), expected[column]);
+    }
+}
+
+void HeaderCsvTests::ftoolsRoundTrip() {
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto path = dir.filePath("objects.csv");
+    const auto rows = sampleRows();
+
+    QCOMPARE(HeaderCsv::write(rows, path), QString());
+    auto result = HeaderCsv::read(path);
+    QCOMPARE(result.errors, QStringList());
+    QVERIFY(!result.named);
+    compareRows(result.rows, rows);
+}
+
+void HeaderCsvTests::namesNeeded() {
+
+    // rows without the names line are FTools' to read, a device can't be given to it
+    QBuffer buffer;
+    buffer.setData("\n1,2,3,4,5,6,7,8,9,10,11\n");
+    buffer.open(QIODevice::ReadOnly);
+    auto result = HeaderCsv::read(buffer);
+    QVERIFY(!result.named);
+    QVERIFY(result.rows.empty());
+    QCOMPARE(result.errors, QStringList({"Line 2: no column names, a file without them is read by FTools"}));
+}
+
+void HeaderCsvTests::reportsBadRows() {
+
+    QBuffer buffer;
+    buffer.setData("width,height,X,Y,type,Z,intensity,R,G,B,palette_id\n"
+                   "1,2,3,4,5,6,7,8,9,10,11\n"
+                   "1,2,3,4,5,6,7,8,9,256,11\n"
+                   "1,2,3,x,5,6,7,8,9,10,11\n"
+                   "1,2,3\n");
+    buffer.open(QIODevice::ReadOnly);
+    auto result = HeaderCsv::read(buffer);
+    QCOMPARE(result.errors, QStringList({"Line 3: B 256 is over 255",
+                                         "Line 4: Y \"x\" isn't a number",
+                                         "Line 5: 3 values of 11"}));
+
+    buffer.close();
+    buffer.setData("width,height\n1,2\n");
+    buffer.open(QIODevice::ReadOnly);
+    result = HeaderCsv::read(buffer);
+    QCOMPARE(result.errors.size(), 1);
+    QVERIFY(result.errors[0].startsWith("Line 1: no X, Y"));
+}
+
+QTEST_GUILESS_MAIN(HeaderCsvTests)
+
+#include "HeaderCsvTests.moc"
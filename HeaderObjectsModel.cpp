@@ -3,6 +3,7 @@
 //
 
 #include "HeaderObjectsModel.h"
+#include "ThemePatch.h"
 
 int HeaderObjectsModel::rowCount(const QModelIndex &parent) const {
     return (int) m_lines.size();
@@ -14,38 +15,12 @@ int HeaderObjectsModel::columnCount(const QModelIndex &parent) const {
 
 QVariant HeaderObjectsModel::data(const QModelIndex &index, int role) const {
 
-    if (role == Qt::DisplayRole) {
+    if (role == Qt::DisplayRole || role == Qt::EditRole) {
 
         if ((index.row() >= m_lines.size()) || (index.column() >= COL_MAX))
             return QVariant();
 
-        const auto &line = m_lines[index.row()];
-        switch (index.column()) {
-            case width :
-                return line.width;
-            case height :
-                return line.height;
-            case X :
-                return line.X;
-            case Y :
-                return line.Y;
-            case type :
-                return line.type;
-            case z :
-                return line.Z;
-            case intensity :
-                return line.intensity;
-            case R :
-                return line.R;
-            case G :
-                return line.G;
-            case B :
-                return line.B;
-            case A :
-                return line.palette_id;
-            default:
-                return QVariant();
-        }
+        return HeaderCsv::field(m_lines[index.row()], index.column());
     }
 
     return QVariant();
@@ -78,69 +53,42 @@ bool HeaderObjectsModel::setData(const QModelIndex &index, const QVariant &value
         if (!ok)
             return false;
 
-        switch (index.column()) {
-            case width :
-                m_lines[index.row()].width = v;
-                break;
-            case height :
-                m_lines[index.row()].height = v;
-                break;
-            case X :
-                m_lines[index.row()].X = v;
-                break;
-            case Y :
-                m_lines[index.row()].Y = v;
-                break;
-            case type :
-                if(v > std::numeric_limits<uint8_t>::max())
-                    return false;
-                m_lines[index.row()].type = v;
-                break;
-            case z :
-                if(v > std::numeric_limits<uint8_t>::max())
-                    return false;
-                m_lines[index.row()].Z = v;
-                break;
-            case intensity :
-                if(v > std::numeric_limits<uint8_t>::max())
-                    return false;
-                m_lines[index.row()].intensity = v;
-                break;
-            case R :
-                if(v > std::numeric_limits<uint8_t>::max())
-                    return false;
-                m_lines[index.row()].R = v;
-                break;
-            case G :
-                if(v > std::numeric_limits<uint8_t>::max())
-                    return false;
-                m_lines[index.row()].G = v;
-                break;
-            case B :
-                if(v > std::numeric_limits<uint8_t>::max())
-                    return false;
-                m_lines[index.row()].B = v;
-                break;
-            case A :
-                if(v > std::numeric_limits<uint8_t>::max())
-                    return false;
-                m_lines[index.row()].palette_id = v;
-                break;
-            default:
-                return false;
-        }
+        // same ranges as the CSV import
+        if (!HeaderCsv::setField(m_lines[index.row()], index.column(), v))
+            return false;
 
+        emit dataChanged(index, index, {role});
+        emit lineEdited(index.row());
         return true;
 
     }
     return false;
 }
 
-void HeaderObjectsModel::importLines(const vector<ImageSection::HeaderRecord> &data) {
+void HeaderObjectsModel::importLines(vector<ImageSection::HeaderRecord> data) {
 
-    m_lines = data;
-    beginResetModel();
-    endResetModel();
+    if (data.size() != m_lines.size()) {
+        beginResetModel();
+        m_lines = std::move(data);
+        endResetModel();
+        return;
+    }
+
+    // only the runs of changed rows are repainted
+    const int rows = (int) data.size();
+    for (int row = 0; row < rows;) {
+        if (ThemePatch::sameRecord(m_lines[row], data[row])) {
+            ++row;
+            continue;
+        }
+        int last = row;
+        while (last + 1 < rows && !ThemePatch::sameRecord(m_lines[last + 1], data[last + 1])) {
+            ++last;
+        }
+        std::copy(data.begin() + row, data.begin() + last + 1, m_lines.begin() + row);
+        emit dataChanged(index(row, 0), index(last, COL_MAX - 1), {Qt::DisplayRole, Qt::EditRole});
+        row = last + 1;
+    }
 }
 
 const vector<ImageSection::HeaderRecord> &HeaderObjectsModel::exportLines() const {
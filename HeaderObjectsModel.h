@@ -8,6 +8,8 @@
 #include <QAbstractTableModel>
 #include <ImageSection.h>
 
+#include "HeaderCsv.h"
+
 class HeaderObjectsModel : public QAbstractTableModel {
 
     Q_OBJECT
@@ -26,6 +28,7 @@ class HeaderObjectsModel : public QAbstractTableModel {
         A,
         COL_MAX
     };
+    static_assert(COL_MAX == HeaderCsv::COL_MAX, "the table shows the CSV columns");
 
     [[nodiscard]] static inline const char *colNamesToString(enColumnsNames n) {
         switch (n) {
@@ -65,9 +68,14 @@ public:
     Qt::ItemFlags flags(const QModelIndex &index) const override;
     bool setData(const QModelIndex &index, const QVariant &value, int role) override;
 
-    void importLines(const vector <ImageSection::HeaderRecord> &data);
+    /* rows changed by the new lines are reported with dataChanged, the model is reset only if the count differs */
+    void importLines(vector <ImageSection::HeaderRecord> data);
     [[nodiscard]] const vector <ImageSection::HeaderRecord> & exportLines() const;
 
+signals:
+    /* a cell was edited in the table, not emitted by importLines() */
+    void lineEdited(int row);
+
 private:
     vector <ImageSection::HeaderRecord> m_lines{};
 
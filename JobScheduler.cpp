@@ -0,0 +1,252 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "JobScheduler.h"
+
+#include <QtConcurrent/QtConcurrent>
+
+#include <exception>
+
+static thread_local std::shared_ptr<JobContext> currentContext;
+
+JobContext::Scope::Scope(std::shared_ptr<JobContext> context) : m_previous(std::move(currentContext)) {
+    currentContext = std::move(context);
+}
+
+JobContext::Scope::~Scope() {
+    currentContext = std::move(m_previous);
+}
+
+void JobContext::setProgress(const sProgress &progress) {
+    QMutexLocker locker(&m_progressMutex);
+    m_progress = progress;
+    m_progressVersion++;
+}
+
+sProgress JobContext::progress() const {
+    QMutexLocker locker(&m_progressMutex);
+    return m_progress;
+}
+
+std::shared_ptr<JobContext> JobContext::current() {
+    return currentContext;
+}
+
+void JobContext::throwIfCancelled() {
+    if (currentContext && currentContext->isCancelled()) {
+        throw JobCancelled();
+    }
+}
+
+class JobScheduler::Runnable : public QRunnable {
+
+public:
+    Runnable(JobScheduler *scheduler, int job_id, std::shared_ptr<JobContext> context, std::function<void()> work)
+            : m_scheduler(scheduler), m_jobId(job_id), m_context(std::move(context)), m_work(std::move(work)) {
+        setAutoDelete(false);
+    }
+
+    void run() override {
+
+        bool completed = false;
+        QString error;
+        if (!m_context->isCancelled()) {
+            JobContext::Scope scope(m_context);
+            try {
+                m_work();
+                completed = true;
+            } catch (const std::exception &ex) {
+                error = ex.what();
+            } catch (...) {
+                error = "unknown error";
+            }
+        }
+        if (!error.isEmpty()) {
+            qWarning() << "Job failed:" << error;
+        }
+
+        // the scheduler waits for its pool on destruction, so it's still alive here
+        QMetaObject::invokeMethod(m_scheduler, [scheduler = m_scheduler, job_id = m_jobId, completed, error]() {
+            scheduler->finish(job_id, completed, error);
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    JobScheduler *m_scheduler;
+    int m_jobId;
+    std::shared_ptr<JobContext> m_context;
+    std::function<void()> m_work;
+};
+
+void JobScheduler::parallelFor(QThreadPool &pool, int count, const std::function<void(int)> &fn) {
+
+    // Helpers may start after all work is taken (or even after return),
+    // so they only touch the shared state until they claim an index.
+    // They run in the caller's job, a cancelled job skips the rest of the items.
+    // An item that throws still counts as done, the first exception is rethrown
+    // by the caller once every item is through, so nothing runs on its locals after that.
+    struct sState {
+        std::function<void(int)> fn;
+        std::shared_ptr<JobContext> job;
+        int count;
+        QAtomicInt next = 0;
+        QMutex mutex;
+        QWaitCondition finished;
+        int done = 0;
+        std::exception_ptr error;
+    };
+    auto state = std::make_shared<sState>();
+    state->fn = fn;
+    state->count = count;
+    state->job = JobContext::current();
+
+    auto worker = [state]() {
+        JobContext::Scope job(state->job);
+        int i;
+        while ((i = state->next.fetchAndAddRelaxed(1)) < state->count) {
+            std::exception_ptr error;
+            if (!state->job || !state->job->isCancelled()) {
+                try {
+                    state->fn(i);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }
+            QMutexLocker locker(&state->mutex);
+            if (error && !state->error) {
+                state->error = error;
+            }
+            if (++state->done == state->count) {
+                state->finished.wakeAll();
+            }
+        }
+    };
+
+    int helpers = std::min(count, pool.maxThreadCount()) - 1;
+    for (int i = 0; i < helpers; ++i) {
+        QtConcurrent::run(&pool, worker);
+    }
+    worker();
+
+    QMutexLocker locker(&state->mutex);
+    while (state->done < count) {
+        state->finished.wait(&state->mutex);
+    }
+    auto error = state->error;
+    locker.unlock();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    JobContext::throwIfCancelled();
+}
+
+JobScheduler::JobScheduler(int threads, QObject *parent) : QObject(parent) {
+
+    qRegisterMetaType<sProgress>();
+    m_pool.setMaxThreadCount(std::max(1, threads));
+    m_progressTimer.setInterval(progressIntervalMs);
+    connect(&m_progressTimer, &QTimer::timeout, this, &JobScheduler::pollProgress);
+}
+
+JobScheduler::~JobScheduler() {
+
+    // the owner is half destroyed already, don't call it back
+    blockSignals(true);
+    cancelAll();
+    m_pool.waitForDone();
+}
+
+int JobScheduler::schedule(const QString &name, enPriority priority,
+                           std::function<void()> work, std::function<void(bool cancelled)> done) {
+
+    const int job_id = m_nextId++;
+    auto &job = m_jobs[job_id];
+    job.name = name;
+    job.priority = priority;
+    job.context = std::make_shared<JobContext>();
+    job.runnable = std::make_unique<Runnable>(this, job_id, job.context, std::move(work));
+    job.done = std::move(done);
+
+    m_pool.start(job.runnable.get(), priority);
+    m_progressTimer.start();
+
+    return job_id;
+}
+
+void JobScheduler::cancel(int job_id) {
+
+    auto it = m_jobs.find(job_id);
+    if (it == m_jobs.end()) return;
+
+    it->second.context->cancel();
+    if (m_pool.tryTake(it->second.runnable.get())) {
+        finish(job_id, false);
+    }
+}
+
+void JobScheduler::cancelAll(enPriority up_to) {
+
+    // a dropped job emits jobFinished() right away and its handlers may change the list
+    for (auto job_id : jobs()) {
+        auto it = m_jobs.find(job_id);
+        if (it != m_jobs.end() && it->second.priority <= up_to) {
+            cancel(job_id);
+        }
+    }
+}
+
+QString JobScheduler::name(int job_id) const {
+
+    auto it = m_jobs.find(job_id);
+    return it == m_jobs.end() ? QString() : it->second.name;
+}
+
+QList<int> JobScheduler::jobs(enPriority from) const {
+
+    QList<int> ids;
+    for (const auto &[job_id, job] : m_jobs) {
+        if (job.priority >= from) {
+            ids << job_id;
+        }
+    }
+    return ids;
+}
+
+void JobScheduler::finish(int job_id, bool completed, const QString &error) {
+
+    auto it = m_jobs.find(job_id);
+    if (it == m_jobs.end()) return;
+
+    // a cancelled job may fail on its way out, that's reported as cancelled
+    if (!completed && !it->second.context->isCancelled() && !error.isEmpty()) {
+        emit jobFailed(job_id, error);
+    }
+
+    // done() may submit new jobs, so forget this one first
+    auto job = std::move(it->second);
+    m_jobs.erase(it);
+    if (m_jobs.empty()) {
+        m_progressTimer.stop();
+    }
+
+    // listeners see the job gone before its callback, which may start the next one
+    const bool cancelled = job.context->isCancelled();
+    emit jobFinished(job_id, cancelled && !completed);
+    if (completed) {
+        job.done(cancelled);
+    }
+}
+
+void JobScheduler::pollProgress() {
+
+    // jobs report from many threads at once, a timer turns it into a steady signal
+    for (auto &[job_id, job] : m_jobs) {
+        auto version = job.context->progressVersion();
+        if (version != job.reported) {
+            job.reported = version;
+            emit jobProgress(job_id, job.context->progress());
+        }
+    }
+}
@@ -0,0 +1,151 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_JOBSCHEDULER_H
+#define FOCUSIPC_JOBSCHEDULER_H
+
+#include <QtCore>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+
+#include "Progress.h"
+
+/* thrown by JobContext::throwIfCancelled(), the usual runtime_error handlers report it as is */
+class JobCancelled : public std::runtime_error {
+public:
+    JobCancelled() : std::runtime_error("Cancelled") {}
+};
+
+/*
+ * Cancellation flag and progress of one job.
+ * The scheduler makes it current on the thread running the job and
+ * JobScheduler::parallelFor() carries it over to its helpers, so the
+ * document checks and reports it without an extra parameter everywhere.
+ */
+class JobContext {
+
+public:
+    class Scope {
+    public:
+        explicit Scope(std::shared_ptr<JobContext> context);
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+        ~Scope();
+
+    private:
+        std::shared_ptr<JobContext> m_previous;
+    };
+
+    void cancel() { m_cancelled = true; }
+    [[nodiscard]] bool isCancelled() const { return m_cancelled; }
+
+    void setProgress(const sProgress &progress);
+    [[nodiscard]] sProgress progress() const;
+    /* changes with every setProgress() */
+    [[nodiscard]] int progressVersion() const { return m_progressVersion; }
+
+    /* context of the job running on this thread, nullptr outside of jobs */
+    static std::shared_ptr<JobContext> current();
+    static void throwIfCancelled();
+
+private:
+    std::atomic<bool> m_cancelled{false};
+    mutable QMutex m_progressMutex;
+    sProgress m_progress;
+    std::atomic<int> m_progressVersion{0};
+};
+
+/*
+ * Runs long document operations on a few threads of its own.
+ *
+ * Queued jobs start by priority, so decoding the picture being looked at
+ * overtakes a background export. A queued job is dropped when cancelled,
+ * a running one stops at the next check of its JobContext.
+ * Jobs are submitted and their callbacks are called on the scheduler's thread.
+ */
+class JobScheduler : public QObject {
+
+    Q_OBJECT
+
+public:
+    enum enPriority {
+        PRIORITY_BACKGROUND = 0,   // export, analysis
+        PRIORITY_NORMAL = 5,       // open, save, replace
+        PRIORITY_INTERACTIVE = 10  // whatever the user waits to see
+    };
+
+    explicit JobScheduler(int threads = 2, QObject *parent = nullptr);
+    ~JobScheduler() override;
+
+    /*
+     * Run work() on the pool, then done(result, cancelled) here.
+     * The result is what work() returned even if it was cancelled meanwhile,
+     * done isn't called for a job dropped before it started or for work() throwing, see jobFailed().
+     */
+    template<class Work, class Done>
+    int submit(const QString &name, enPriority priority, Work work, Done done) {
+        using Result = std::invoke_result_t<Work &>;
+        auto result = std::make_shared<std::optional<Result>>();
+        return schedule(name, priority,
+                        [result, work = std::move(work)]() mutable { result->emplace(work()); },
+                        [result, done = std::move(done)](bool cancelled) mutable { done(**result, cancelled); });
+    }
+
+    /*
+     * Run fn(0..count-1) on the pool, the calling thread takes part, so nested loops can't starve.
+     * Helpers run in the caller's job, a cancelled job skips the rest of the items.
+     * Rethrows the first exception of fn after all items are done,
+     * throws JobCancelled when the caller's job was cancelled meanwhile.
+     */
+    static void parallelFor(QThreadPool &pool, int count, const std::function<void(int)> &fn);
+
+    void cancel(int job_id);
+    /* every job of the priority or lower */
+    void cancelAll(enPriority up_to = PRIORITY_INTERACTIVE);
+
+    [[nodiscard]] bool isActive(int job_id) const { return m_jobs.count(job_id); }
+    [[nodiscard]] QString name(int job_id) const;
+    /* ids of queued and running jobs of the priority or higher */
+    [[nodiscard]] QList<int> jobs(enPriority from = PRIORITY_BACKGROUND) const;
+
+signals:
+    /* latest progress of a running job, at most every progressIntervalMs */
+    void jobProgress(int job_id, const sProgress &progress);
+    /* work() of a job not cancelled threw, emitted while the job is still listed, before jobFinished() */
+    void jobFailed(int job_id, const QString &error);
+    /* emitted for every job before its done(), cancelled if done() won't be called because of cancel() */
+    void jobFinished(int job_id, bool cancelled);
+
+private:
+    class Runnable;
+
+    struct sJob {
+        QString name;
+        enPriority priority;
+        std::shared_ptr<JobContext> context;
+        std::unique_ptr<Runnable> runnable; // owned here, so a queued one can be taken back
+        std::function<void(bool cancelled)> done;
+        int reported = 0; // progress version last emitted
+    };
+
+    int schedule(const QString &name, enPriority priority,
+                 std::function<void()> work, std::function<void(bool cancelled)> done);
+    void finish(int job_id, bool completed, const QString &error = {});
+    void pollProgress();
+
+    static constexpr int progressIntervalMs = 100;
+
+    std::map<int, sJob> m_jobs;
+    int m_nextId = 1;
+    QTimer m_progressTimer;
+    QThreadPool m_pool;
+};
+
+#endif //FOCUSIPC_JOBSCHEDULER_H
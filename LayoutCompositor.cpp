@@ -0,0 +1,261 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "LayoutCompositor.h"
+
+#include <numeric>
+
+using Record = ImageSection::HeaderRecord;
+
+QRect LayoutCompositor::recordRect(const Record &record) {
+    return {(int) record.X, (int) record.Y, (int) record.width, (int) record.height};
+}
+
+static bool shadingChanged(const Record &a, const Record &b) {
+    return a.width != b.width || a.height != b.height || a.intensity != b.intensity ||
+           a.R != b.R || a.G != b.G || a.B != b.B;
+}
+
+void LayoutCompositor::sortByZ() {
+
+    m_order.resize(m_lines.size());
+    std::iota(m_order.begin(), m_order.end(), 0);
+    std::stable_sort(m_order.begin(), m_order.end(), [this](int a, int b) { return m_lines[a].Z < m_lines[b].Z; });
+}
+
+static QSize canvasOf(const std::vector<Record> &lines) {
+
+    QSize canvas(0, 0);
+    for (const auto &record : lines) {
+        auto rect = LayoutCompositor::recordRect(record);
+        canvas = canvas.expandedTo({rect.x() + rect.width(), rect.y() + rect.height()});
+    }
+    return canvas;
+}
+
+void LayoutCompositor::resizeCanvas() {
+
+    const auto canvas = canvasOf(m_lines);
+    m_canvas = canvas;
+    m_columns = (canvas.width() + tileSize - 1) / tileSize;
+    const int rows = (canvas.height() + tileSize - 1) / tileSize;
+    m_tiles.assign(m_columns * rows, QImage());
+    m_dirty.assign(m_tiles.size(), 1);
+}
+
+QRect LayoutCompositor::tileRect(int tile) const {
+    return QRect((tile % m_columns) * tileSize, (tile / m_columns) * tileSize, tileSize, tileSize) &
+           QRect(QPoint(), m_canvas);
+}
+
+QRegion LayoutCompositor::invalidate(const QRegion &area) {
+
+    auto canvas_area = area & QRect(QPoint(), m_canvas);
+    for (const auto &rect : canvas_area) {
+        for (int y = rect.top() / tileSize; y <= rect.bottom() / tileSize; ++y) {
+            for (int x = rect.left() / tileSize; x <= rect.right() / tileSize; ++x) {
+                m_dirty[y * m_columns + x] = 1;
+            }
+        }
+    }
+    return canvas_area;
+}
+
+QRegion LayoutCompositor::invalidateRow(int row) {
+
+    if (row < 0 || row >= (int) m_lines.size()) return {};
+    m_images.remove(shadedKey(row));
+    return invalidate(recordRect(m_lines[row]));
+}
+
+void LayoutCompositor::dropShaded() {
+
+    for (auto key : m_images.keys()) {
+        if (key >> 32) {
+            m_images.remove(key);
+        }
+    }
+}
+
+QRegion LayoutCompositor::setLines(std::vector<Record> lines) {
+
+    m_lines = std::move(lines);
+    dropShaded();
+    sortByZ();
+    resizeCanvas();
+    return QRect(QPoint(), m_canvas);
+}
+
+QRegion LayoutCompositor::updateLines(const std::vector<Record> &lines, int first, int last) {
+
+    if (lines.size() != m_lines.size()) {
+        return setLines(lines);
+    }
+
+    QRegion area;
+    bool z_changed = false;
+    for (int row = std::max(0, first); row <= last && row < (int) lines.size(); ++row) {
+        area += recordRect(m_lines[row]);
+        if (shadingChanged(m_lines[row], lines[row])) {
+            m_images.remove(shadedKey(row));
+        }
+        z_changed |= m_lines[row].Z != lines[row].Z;
+        m_lines[row] = lines[row];
+        area += recordRect(m_lines[row]);
+    }
+    if (z_changed) {
+        sortByZ();
+    }
+
+    if (canvasOf(m_lines) != m_canvas) {
+        // another tile grid, everything is drawn again
+        resizeCanvas();
+        return QRect(QPoint(), m_canvas);
+    }
+    return invalidate(area);
+}
+
+QRegion LayoutCompositor::setPictureCount(int picture_count) {
+
+    m_pictureCount = picture_count;
+    m_images.clear();
+    m_broken.clear();
+    return invalidate(QRect(QPoint(), m_canvas));
+}
+
+QRegion LayoutCompositor::setPicture(int picture_idx, const QImage &image) {
+
+    if (image.isNull()) {
+        m_broken.insert(picture_idx);
+    } else {
+        m_broken.remove(picture_idx);
+        m_images.insert(pictureKey(picture_idx), new QImage(image), costOf(image));
+    }
+    return invalidateRow(picture_idx);
+}
+
+QRegion LayoutCompositor::dropPicture(int picture_idx) {
+
+    m_images.remove(pictureKey(picture_idx));
+    m_broken.remove(picture_idx);
+    return invalidateRow(picture_idx);
+}
+
+QRegion LayoutCompositor::setOptions(const sOptions &options) {
+
+    if (options.intensity == m_options.intensity && options.tint == m_options.tint) return {};
+    m_options = options;
+    dropShaded();
+    return invalidate(QRect(QPoint(), m_canvas));
+}
+
+bool LayoutCompositor::hasPicture(int row) const {
+    return row < m_pictureCount && !m_broken.contains(row);
+}
+
+QImage LayoutCompositor::shade(const Record &record, const QImage &picture) const {
+
+    const QSize size((int) record.width, (int) record.height);
+    auto image = (picture.size() == size ? picture :
+                  picture.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation))
+            .convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    const bool tint = m_options.tint && (record.R || record.G || record.B);
+    const bool dim = m_options.intensity && record.intensity != 255;
+    if (!tint && !dim) return image;
+
+    // premultiplied, so the colours are scaled with the alpha
+    const unsigned alpha_k = dim ? record.intensity : 255;
+    const unsigned r_k = (tint ? record.R : 255) * alpha_k / 255;
+    const unsigned g_k = (tint ? record.G : 255) * alpha_k / 255;
+    const unsigned b_k = (tint ? record.B : 255) * alpha_k / 255;
+    for (int y = 0; y < image.height(); ++y) {
+        auto line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            const QRgb pixel = line[x];
+            line[x] = qRgba((int) ((qRed(pixel) * r_k + 127) / 255), (int) ((qGreen(pixel) * g_k + 127) / 255),
+                            (int) ((qBlue(pixel) * b_k + 127) / 255), (int) ((qAlpha(pixel) * alpha_k + 127) / 255));
+        }
+    }
+    return image;
+}
+
+void LayoutCompositor::rasterise(int tile, const std::vector<QImage> &shaded) {
+
+    const auto rect = tileRect(tile);
+    auto &image = m_tiles[tile];
+    if (image.size() != rect.size()) {
+        image = QImage(rect.size(), QImage::Format_ARGB32_Premultiplied);
+    }
+    image.fill(Qt::black);
+
+    QPainter painter(&image);
+    painter.translate(-rect.topLeft());
+    painter.setPen(QPen(Qt::gray, 0, Qt::DashLine));
+    painter.setBrush(Qt::NoBrush);
+    for (int row : m_order) {
+        const auto record_rect = recordRect(m_lines[row]);
+        const auto part = record_rect & rect;
+        if (part.isEmpty()) continue;
+
+        if (!shaded[row].isNull()) {
+            painter.drawImage(part.topLeft(), shaded[row], part.translated(-record_rect.topLeft()));
+        } else {
+            painter.drawRect(record_rect.adjusted(0, 0, -1, -1));
+        }
+    }
+}
+
+QList<int> LayoutCompositor::render(const QRect &area, QThreadPool &pool) {
+
+    const auto visible = area & QRect(QPoint(), m_canvas);
+    if (visible.isEmpty()) return {};
+
+    std::vector<int> tiles;
+    QRegion tiles_area;
+    for (int y = visible.top() / tileSize; y <= visible.bottom() / tileSize; ++y) {
+        for (int x = visible.left() / tileSize; x <= visible.right() / tileSize; ++x) {
+            const int tile = y * m_columns + x;
+            if (m_dirty[tile]) {
+                tiles.push_back(tile);
+                tiles_area += tileRect(tile);
+            }
+        }
+    }
+    if (tiles.empty()) return {};
+
+    // shade the pictures the tiles show, the ones not decoded yet are outlined for now.
+    // The cache isn't touched by the helpers, they get shared copies of the images
+    QList<int> missing;
+    std::vector<QImage> shaded(m_lines.size());
+    std::vector<int> shading;
+    for (int row = 0; row < (int) m_lines.size(); ++row) {
+        if (!hasPicture(row) || !tiles_area.intersects(recordRect(m_lines[row]))) continue;
+
+        if (auto image = m_images.object(shadedKey(row))) {
+            shaded[row] = *image;
+        } else if (auto picture = m_images.object(pictureKey(row))) {
+            shaded[row] = *picture;
+            shading.push_back(row);
+        } else {
+            missing << row;
+        }
+    }
+    JobScheduler::parallelFor(pool, (int) shading.size(), [this, &shading, &shaded](int i) {
+        const int row = shading[i];
+        shaded[row] = shade(m_lines[row], shaded[row]);
+    });
+    for (int row : shading) {
+        // one larger than the whole budget is only drawn now and shaded again next time
+        m_images.insert(shadedKey(row), new QImage(shaded[row]), costOf(shaded[row]));
+    }
+
+    JobScheduler::parallelFor(pool, (int) tiles.size(), [this, &tiles, &shaded](int i) {
+        rasterise(tiles[i], shaded);
+    });
+    for (int tile : tiles) {
+        m_dirty[tile] = 0;
+    }
+    return missing;
+}
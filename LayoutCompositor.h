@@ -0,0 +1,101 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_LAYOUTCOMPOSITOR_H
+#define FOCUSIPC_LAYOUTCOMPOSITOR_H
+
+#include <QtCore>
+#include <QtGui>
+
+#include <vector>
+
+#include <ImageSection.h>
+
+#include "JobScheduler.h"
+
+/*
+ * Renders the screen from the header objects at its own resolution.
+ *
+ * Record i shows picture i scaled to its width x height at X/Y, records
+ * are stacked by Z (the header order within one Z). Intensity scales the
+ * opacity and a non-black R/G/B tints the colours. Records without a
+ * picture are dashed outlines.
+ *
+ * The canvas is cut into tiles that are kept between frames: every change
+ * returns the canvas area it touched, only the tiles there are drawn again
+ * and they are rasterised in parallel. Pictures are shaded once per record
+ * and reused until the record or the picture changes. Decoded and shaded
+ * pictures share one cache bounded by their size, an evicted one is decoded
+ * or shaded again when a tile needs it.
+ */
+class LayoutCompositor {
+
+public:
+    static constexpr int tileSize = 128;
+
+    struct sOptions {
+        bool intensity = true;
+        bool tint = true;
+    };
+
+    [[nodiscard]] static QRect recordRect(const ImageSection::HeaderRecord &record);
+
+    [[nodiscard]] QSize canvasSize() const { return m_canvas; }
+    [[nodiscard]] const std::vector<ImageSection::HeaderRecord> &lines() const { return m_lines; }
+    /* rows from the lowest Z */
+    [[nodiscard]] const std::vector<int> &order() const { return m_order; }
+    [[nodiscard]] const sOptions &options() const { return m_options; }
+
+    /* these return the canvas area to repaint */
+    QRegion setLines(std::vector<ImageSection::HeaderRecord> lines);
+    /* rows first..last of lines changed, the count is the same */
+    QRegion updateLines(const std::vector<ImageSection::HeaderRecord> &lines, int first, int last);
+    /* another document, all pictures are dropped */
+    QRegion setPictureCount(int picture_count);
+    /* a decoded picture, a null image if it can't be decoded */
+    QRegion setPicture(int picture_idx, const QImage &image);
+    /* the picture changed, it's asked for again by render() */
+    QRegion dropPicture(int picture_idx);
+    QRegion setOptions(const sOptions &options);
+
+    /* draw the changed tiles of the area, the calling thread takes part.
+     * Returns the pictures the area needs, they are outlined until set */
+    QList<int> render(const QRect &area, QThreadPool &pool);
+
+    [[nodiscard]] int tileCount() const { return (int) m_tiles.size(); }
+    [[nodiscard]] QRect tileRect(int tile) const;
+    /* null until the tile is rendered */
+    [[nodiscard]] const QImage &tileImage(int tile) const { return m_tiles[tile]; }
+
+private:
+    void resizeCanvas();
+    void sortByZ();
+    QRegion invalidate(const QRegion &area);
+    QRegion invalidateRow(int row);
+    [[nodiscard]] bool hasPicture(int row) const;
+    [[nodiscard]] QImage shade(const ImageSection::HeaderRecord &record, const QImage &picture) const;
+    /* shaded holds the rows the tile shows, null ones are outlined */
+    void rasterise(int tile, const std::vector<QImage> &shaded);
+
+    /* both kinds in one cache, record i shows picture i */
+    static qint64 pictureKey(int picture_idx) { return picture_idx; }
+    static qint64 shadedKey(int row) { return (qint64) 1 << 32 | (uint32_t) row; }
+    void dropShaded();
+    static int costOf(const QImage &image) { return std::max(1, (int) (image.sizeInBytes() / 1024)); }
+
+    std::vector<ImageSection::HeaderRecord> m_lines;
+    std::vector<int> m_order;
+    QSize m_canvas;
+    sOptions m_options;
+
+    int m_pictureCount = 0;
+    QCache<qint64, QImage> m_images{192 * 1024}; // decoded and shaded, cost is in KiB
+    QSet<int> m_broken;                          // pictures that can't be decoded
+
+    int m_columns = 0;
+    std::vector<QImage> m_tiles;
+    std::vector<char> m_dirty;
+};
+
+#endif //FOCUSIPC_LAYOUTCOMPOSITOR_H
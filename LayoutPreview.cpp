@@ -0,0 +1,214 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "LayoutPreview.h"
+
+#include <QtConcurrent/QtConcurrent>
+
+LayoutPreview::LayoutPreview(ThemeDocument &doc, const HeaderObjectsModel &model, QWidget *parent) :
+        QWidget(parent), m_doc(doc), m_model(model) {
+
+    m_decodePool.setMaxThreadCount(2);
+    // the GUI thread rasterises too
+    m_rasterPool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
+    setMinimumSize(160, 120);
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+
+    LayoutCompositor::sOptions options;
+    options.intensity = QSettings().value("layoutIntensity", true).toBool();
+    options.tint = QSettings().value("layoutTint", true).toBool();
+    m_compositor.setOptions(options);
+
+    connect(&m_model, &QAbstractItemModel::dataChanged, this,
+            [this](const QModelIndex &top_left, const QModelIndex &bottom_right) {
+                linesChanged(top_left.row(), bottom_right.row());
+            });
+    connect(&m_model, &QAbstractItemModel::modelReset, this, &LayoutPreview::reloadLines);
+    reloadLines();
+}
+
+LayoutPreview::~LayoutPreview() {
+    m_decodePool.clear();
+    m_decodePool.waitForDone();
+}
+
+void LayoutPreview::updateTransform() {
+
+    m_transform.reset();
+    const auto canvas = m_compositor.canvasSize();
+    if (canvas.isEmpty()) return;
+
+    const double scale = std::min((double) width() / canvas.width(), (double) height() / canvas.height());
+    m_transform.translate((width() - canvas.width() * scale) / 2, (height() - canvas.height() * scale) / 2);
+    m_transform.scale(scale, scale);
+}
+
+void LayoutPreview::updateCanvas(const QRegion &area) {
+
+    QRegion dirty;
+    for (const auto &rect : area) {
+        dirty += m_transform.mapRect(QRectF(rect)).toAlignedRect().adjusted(-1, -1, 1, 1);
+    }
+    update(dirty);
+}
+
+QRect LayoutPreview::widgetRect(int row) const {
+    const auto &record = m_compositor.lines()[row];
+    return m_transform.mapRect(QRectF(LayoutCompositor::recordRect(record))).toAlignedRect().adjusted(-2, -2, 2, 2);
+}
+
+void LayoutPreview::reloadLines() {
+
+    m_compositor.setLines(m_model.exportLines());
+    if (m_currentRow >= (int) m_compositor.lines().size()) {
+        m_currentRow = -1;
+    }
+    updateTransform();
+    update();
+}
+
+void LayoutPreview::linesChanged(int first, int last) {
+
+    const auto canvas = m_compositor.canvasSize();
+    auto area = m_compositor.updateLines(m_model.exportLines(), first, last);
+    if (canvas != m_compositor.canvasSize()) {
+        // the scale changes, so does every rect
+        updateTransform();
+        update();
+        return;
+    }
+    updateCanvas(area);
+}
+
+void LayoutPreview::setCurrentRow(int row) {
+
+    if (row == m_currentRow) return;
+    if (m_currentRow >= 0) {
+        update(widgetRect(m_currentRow));
+    }
+    m_currentRow = row < (int) m_compositor.lines().size() ? row : -1;
+    if (m_currentRow >= 0) {
+        update(widgetRect(m_currentRow));
+    }
+}
+
+void LayoutPreview::pictureChanged(int picture_idx) {
+
+    if (m_pending.contains(picture_idx)) {
+        m_stale.insert(picture_idx);
+    }
+    updateCanvas(m_compositor.dropPicture(picture_idx));
+}
+
+void LayoutPreview::picturesReset(int picture_count) {
+
+    m_decodePool.clear();
+    m_generation++;
+    m_pending.clear();
+    m_stale.clear();
+    m_compositor.setPictureCount(picture_count);
+    update();
+}
+
+void LayoutPreview::requestPicture(int picture_idx) {
+
+    if (m_pending.contains(picture_idx)) return;
+    m_pending.insert(picture_idx);
+
+    const int generation = m_generation;
+    QtConcurrent::run(&m_decodePool, [this, picture_idx, generation]() {
+        QImage image;
+        try {
+            image = m_doc.decodePicture(picture_idx);
+        } catch (const std::exception &) {
+            // stays an outline then
+        }
+
+        QMetaObject::invokeMethod(this, [this, picture_idx, generation, image]() {
+            if (generation != m_generation) return;
+            m_pending.remove(picture_idx);
+            if (m_stale.remove(picture_idx)) {
+                // changed while it was decoded, the next paint asks again
+                updateCanvas(m_compositor.dropPicture(picture_idx));
+                return;
+            }
+            updateCanvas(m_compositor.setPicture(picture_idx, image));
+        }, Qt::QueuedConnection);
+    });
+}
+
+void LayoutPreview::paintEvent(QPaintEvent *event) {
+
+    QPainter painter(this);
+    painter.fillRect(event->rect(), palette().dark());
+    if (m_compositor.canvasSize().isEmpty()) return;
+
+    const auto area = m_transform.inverted().mapRect(QRectF(event->rect())).toAlignedRect();
+    for (int picture_idx : m_compositor.render(area, m_rasterPool)) {
+        requestPicture(picture_idx);
+    }
+
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    const auto &region = event->region();
+    for (int tile = 0; tile < m_compositor.tileCount(); ++tile) {
+        const auto target = m_transform.mapRect(QRectF(m_compositor.tileRect(tile)));
+        if (!region.intersects(target.toAlignedRect())) continue;
+
+        const auto &image = m_compositor.tileImage(tile);
+        if (!image.isNull()) {
+            painter.drawImage(target, image);
+        }
+    }
+
+    if (m_currentRow >= 0 && region.intersects(widgetRect(m_currentRow))) {
+        const auto &record = m_compositor.lines()[m_currentRow];
+        painter.setPen(QPen(Qt::yellow, 2));
+        painter.setBrush(Qt::NoBrush);
+        painter.drawRect(m_transform.mapRect(QRectF(LayoutCompositor::recordRect(record))));
+    }
+}
+
+void LayoutPreview::resizeEvent(QResizeEvent *event) {
+    QWidget::resizeEvent(event);
+    updateTransform();
+}
+
+void LayoutPreview::mousePressEvent(QMouseEvent *event) {
+
+    if (event->button() != Qt::LeftButton) return;
+
+    bool invertible;
+    auto point = m_transform.inverted(&invertible).map(QPointF(event->pos()));
+    if (!invertible) return;
+
+    // the topmost record under the cursor
+    const auto &order = m_compositor.order();
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        if (QRectF(LayoutCompositor::recordRect(m_compositor.lines()[*it])).contains(point)) {
+            emit rowClicked(*it);
+            return;
+        }
+    }
+}
+
+void LayoutPreview::contextMenuEvent(QContextMenuEvent *event) {
+
+    auto options = m_compositor.options();
+    QMenu menu(this);
+    auto intensity = menu.addAction("Apply intensity");
+    intensity->setCheckable(true);
+    intensity->setChecked(options.intensity);
+    auto tint = menu.addAction("Apply R/G/B tint");
+    tint->setCheckable(true);
+    tint->setChecked(options.tint);
+
+    auto chosen = menu.exec(event->globalPos());
+    if (!chosen) return;
+
+    options.intensity = intensity->isChecked();
+    options.tint = tint->isChecked();
+    QSettings().setValue("layoutIntensity", options.intensity);
+    QSettings().setValue("layoutTint", options.tint);
+    updateCanvas(m_compositor.setOptions(options));
+}
@@ -0,0 +1,73 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_LAYOUTPREVIEW_H
+#define FOCUSIPC_LAYOUTPREVIEW_H
+
+#include <QtCore>
+#include <QtGui>
+#include <QtWidgets>
+
+#include "HeaderObjectsModel.h"
+#include "LayoutCompositor.h"
+#include "ThemeDocument.h"
+
+/*
+ * The screen as the header objects lay it out, scaled to the widget.
+ *
+ * LayoutCompositor renders it at the screen resolution and keeps the
+ * tiles, so an edited row only redraws the tiles under its old and new
+ * rects. Pictures are decoded on a background pool the first time their
+ * rect is shown. The context menu switches intensity and tint.
+ */
+class LayoutPreview : public QWidget {
+
+    Q_OBJECT
+
+public:
+    LayoutPreview(ThemeDocument &doc, const HeaderObjectsModel &model, QWidget *parent = nullptr);
+    ~LayoutPreview() override;
+
+    void setCurrentRow(int row);
+
+public slots:
+    /* the picture's content changed, its rects are repainted once it's decoded again */
+    void pictureChanged(int picture_idx);
+    /* another document or a different number of pictures */
+    void picturesReset(int picture_count);
+
+signals:
+    void rowClicked(int row);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void contextMenuEvent(QContextMenuEvent *event) override;
+
+private:
+    void reloadLines();
+    void linesChanged(int first, int last);
+    void updateTransform();
+    /* repaint the widget over the canvas area */
+    void updateCanvas(const QRegion &area);
+    /* widget rect of the row, a pixel wider for the outline */
+    [[nodiscard]] QRect widgetRect(int row) const;
+    void requestPicture(int picture_idx);
+
+    ThemeDocument &m_doc;
+    const HeaderObjectsModel &m_model;
+
+    LayoutCompositor m_compositor;
+    QTransform m_transform;   // canvas -> widget
+    int m_currentRow = -1;
+
+    QSet<int> m_pending;
+    QSet<int> m_stale;        // pending pictures that changed
+    QThreadPool m_decodePool;
+    QThreadPool m_rasterPool;
+    int m_generation = 0;     // drops pictures of a closed document
+};
+
+#endif //FOCUSIPC_LAYOUTPREVIEW_H
@@ -0,0 +1,292 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "PaletteGroupsDialog.h"
+
+PaletteGroupsDialog::PaletteGroupsDialog(ThemeDocument &doc, JobScheduler &scheduler, const PictureListModel &pictures,
+                                         QWidget *parent) :
+        QDialog(parent), m_doc(doc), m_scheduler(scheduler), m_pictures(pictures) {
+
+    setWindowTitle("Palette groups");
+    resize(900, 480);
+
+    m_tree = new QTreeWidget(this);
+    m_tree->setColumnCount(COL_COUNT);
+    m_tree->setHeaderLabels({"Palette", "Pictures", "Pixels", "Replaced", "Save work, MB", "Save CPU, ms",
+                             "Mean dE", "Max dE"});
+    m_tree->setUniformRowHeights(true);
+    m_tree->setSortingEnabled(true);
+    m_tree->sortByColumn(COL_SAVE_MS, Qt::DescendingOrder);
+    m_tree->header()->setSectionResizeMode(COL_PALETTE, QHeaderView::Stretch);
+    connect(m_tree, &QTreeWidget::itemDoubleClicked, this, [this](QTreeWidgetItem *item) {
+        auto picture_idx = item->data(COL_PALETTE, PictureIndexRole);
+        if (picture_idx.isValid()) {
+            emit pictureActivated(picture_idx.toInt());
+        }
+    });
+
+    m_summary = new QLabel("Reading the groups...", this);
+    m_summary->setWordWrap(true);
+
+    auto buttons = new QDialogButtonBox(QDialogButtonBox::Close, this);
+    buttons->addButton("Measure all", QDialogButtonBox::ActionRole)->setObjectName("measure");
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+    connect(buttons, &QDialogButtonBox::clicked, this, [this](QAbstractButton *button) {
+        if (button->objectName() != "measure") return;
+
+        // untouched groups too, that's the error a replacement in them would start from
+        for (auto crc : m_items.keys()) {
+            const auto error = m_errors.value(crc);
+            const bool measured = error.key == m_keys.value(crc) && error.error.isEmpty();
+            if (!measured && !m_queue.contains(crc) && !m_measuring.contains(crc)) {
+                m_queue << crc;
+            }
+        }
+        refresh();
+    });
+
+    auto layout = new QVBoxLayout(this);
+    layout->addWidget(m_tree);
+    layout->addWidget(m_summary);
+    layout->addWidget(buttons);
+
+    m_refreshTimer.setSingleShot(true);
+    m_refreshTimer.setInterval(refreshDelayMs);
+    connect(&m_refreshTimer, &QTimer::timeout, this, &PaletteGroupsDialog::refresh);
+    connect(&m_scheduler, &JobScheduler::jobFailed, this, &PaletteGroupsDialog::jobFailed);
+    connect(&m_pictures, &QAbstractItemModel::modelReset, this, &PaletteGroupsDialog::scheduleRefresh);
+    connect(&m_pictures, &PictureListModel::pictureChanged, this, &PaletteGroupsDialog::scheduleRefresh);
+    connect(&m_pictures, &QAbstractItemModel::dataChanged, this,
+            [this](const QModelIndex &, const QModelIndex &, const QVector<int> &roles) {
+                // thumbnails don't change the groups, states after a save do
+                if (roles.isEmpty() || roles.contains(Qt::BackgroundRole)) {
+                    scheduleRefresh();
+                }
+            });
+
+    refresh();
+}
+
+PaletteGroupsDialog::~PaletteGroupsDialog() {
+    if (m_listJob) {
+        m_scheduler.cancel(m_listJob);
+    }
+    if (m_measureJob) {
+        m_scheduler.cancel(m_measureJob);
+    }
+}
+
+void PaletteGroupsDialog::setDocumentBusy(bool busy) {
+
+    if (busy == m_busy) return;
+    m_busy = busy;
+    if (!m_busy && m_refreshWanted) {
+        scheduleRefresh();
+    }
+}
+
+void PaletteGroupsDialog::scheduleRefresh() {
+    if (!m_refreshTimer.isActive()) {
+        m_refreshTimer.start();
+    }
+}
+
+void PaletteGroupsDialog::refresh() {
+
+    // the groups are read under the document lock, so not on the GUI thread and not while a job holds it
+    m_refreshTimer.stop();
+    if (m_busy || m_listJob) {
+        m_refreshWanted = true;
+        return;
+    }
+    m_refreshWanted = false;
+
+    QPointer<PaletteGroupsDialog> self(this);
+    m_listJob = m_scheduler.submit("Listing palette groups", JobScheduler::PRIORITY_INTERACTIVE,
+                                   [doc = &m_doc]() { return doc->paletteGroups(); },
+                                   [self](const std::vector<ThemeDocument::sPaletteGroup> &groups, bool cancelled) {
+                                       if (self) self->showGroups(groups, cancelled);
+                                   });
+}
+
+void PaletteGroupsDialog::showGroups(const std::vector<ThemeDocument::sPaletteGroup> &groups, bool cancelled) {
+
+    m_listJob = 0;
+    if (cancelled) {
+        // listed again on the next change or when the document is free
+        m_refreshWanted = true;
+        return;
+    }
+    if (m_refreshWanted) {
+        // the list is behind already, take the next one
+        refresh();
+        return;
+    }
+
+    int pictures = 0;
+    int remapped_groups = 0;
+    int remapped_pictures = 0;
+    qint64 save_bytes = 0;
+    qint64 save_ms = 0;
+    QSet<uint16_t> seen;
+
+    // sorting while the items change would move them under the loop
+    m_tree->setSortingEnabled(false);
+    for (const auto &group : groups) {
+        const auto crc = group.palette_crc;
+        seen.insert(crc);
+        pictures += (int) group.members.size();
+        if (group.changed) {
+            remapped_groups++;
+            remapped_pictures += (int) group.members.size();
+            save_bytes += group.save_bytes;
+            save_ms += group.save_ms;
+        }
+
+        // a replacement changes the colour error of its group, measure it again
+        if (group.changed && m_errors.value(crc).key != group.key && !m_queue.contains(crc) &&
+            !m_measuring.contains(crc)) {
+            m_queue << crc;
+        }
+
+        auto item = m_items.value(crc);
+        if (!item) {
+            item = new QTreeWidgetItem(m_tree);
+            m_items.insert(crc, item);
+        }
+        if (m_keys.value(crc) != group.key) {
+            fillGroup(item, group);
+            m_keys.insert(crc, group.key);
+        }
+        showError(item, group);
+    }
+
+    for (auto crc : m_items.keys()) {
+        if (seen.contains(crc)) continue;
+        delete m_items.take(crc);
+        m_keys.remove(crc);
+        m_errors.remove(crc);
+        m_queue.removeAll(crc);
+    }
+    m_tree->setSortingEnabled(true);
+
+    if (remapped_groups) {
+        m_summary->setText(QString("%1 groups of %2 pictures. The save remaps %3 of them with %4 pictures: "
+                                   "%5 MB of pixels and EIFs, about %6 ms of CPU.")
+                                   .arg(groups.size()).arg(pictures).arg(remapped_groups).arg(remapped_pictures)
+                                   .arg((double) save_bytes / (1024 * 1024), 0, 'f', 1).arg(save_ms));
+    } else {
+        m_summary->setText(QString("%1 groups of %2 pictures. No 16-bit picture is replaced, "
+                                   "the save doesn't remap palettes.").arg(groups.size()).arg(pictures));
+    }
+
+    startMeasure();
+}
+
+void PaletteGroupsDialog::jobFailed(int job_id, const QString &error) {
+
+    // no callback comes for a failed job, so it's taken off here
+    if (job_id == m_listJob) {
+        m_listJob = 0;
+        m_summary->setText("Listing the groups failed: " + error);
+    } else if (job_id == m_measureJob) {
+        m_measureJob = 0;
+        markMeasuring("Failed: " + error);
+        m_measuring.clear();
+        refresh();
+    }
+}
+
+void PaletteGroupsDialog::markMeasuring(const QString &error) {
+
+    // not measured again until the group changes or "Measure all" is pressed
+    for (auto crc : m_measuring) {
+        ThemeDocument::sPaletteError failed;
+        failed.palette_crc = crc;
+        failed.key = m_keys.value(crc);
+        failed.error = error;
+        m_errors.insert(crc, failed);
+    }
+}
+
+void PaletteGroupsDialog::fillGroup(QTreeWidgetItem *item, const ThemeDocument::sPaletteGroup &group) {
+
+    // numbers go in as numbers, so the columns sort by value
+    item->setText(COL_PALETTE, QString("%1").arg(group.palette_crc, 4, 16, QChar('0')));
+    item->setData(COL_MEMBERS, Qt::DisplayRole, (int) group.members.size());
+    item->setData(COL_PIXELS, Qt::DisplayRole, group.pixels);
+    item->setData(COL_REPLACED, Qt::DisplayRole, group.changed);
+    item->setData(COL_SAVE_MB, Qt::DisplayRole,
+                  std::round((double) group.save_bytes / (1024 * 1024) * 10) / 10);
+    item->setData(COL_SAVE_MS, Qt::DisplayRole, group.save_ms);
+
+    const auto &pictures = m_pictures.pictures();
+    qDeleteAll(item->takeChildren());
+    for (auto idx : group.members) {
+        auto member = new QTreeWidgetItem(item);
+        member->setData(COL_PALETTE, PictureIndexRole, idx);
+        if (idx >= (int) pictures.size()) continue;
+
+        const auto &picture = pictures[idx];
+        member->setText(COL_PALETTE, QString::fromStdString(picture.name));
+        member->setData(COL_PIXELS, Qt::DisplayRole, (qint64) picture.width * picture.height);
+        if (picture.changed) {
+            member->setText(COL_REPLACED, "yes");
+        }
+    }
+}
+
+void PaletteGroupsDialog::showError(QTreeWidgetItem *item, const ThemeDocument::sPaletteGroup &group) {
+
+    const auto crc = group.palette_crc;
+    auto error = m_errors.find(crc);
+    if (error != m_errors.end() && error->key == group.key) {
+        if (error->error.isEmpty()) {
+            item->setData(COL_MEAN_DE, Qt::DisplayRole, std::round(error->mean_delta_e * 100) / 100);
+            item->setData(COL_MAX_DE, Qt::DisplayRole, std::round(error->max_delta_e * 100) / 100);
+            item->setToolTip(COL_MEAN_DE, "");
+        } else {
+            item->setText(COL_MEAN_DE, "failed");
+            item->setText(COL_MAX_DE, "");
+            item->setToolTip(COL_MEAN_DE, error->error);
+        }
+        return;
+    }
+
+    const bool pending = m_queue.contains(crc) || m_measuring.contains(crc);
+    item->setText(COL_MEAN_DE, pending ? "..." : "");
+    item->setText(COL_MAX_DE, "");
+    item->setToolTip(COL_MEAN_DE, "");
+}
+
+void PaletteGroupsDialog::startMeasure() {
+
+    if (m_measureJob || m_queue.isEmpty()) return;
+
+    std::vector<uint16_t> crcs(m_queue.begin(), m_queue.end());
+    m_measuring = m_queue;
+    m_queue.clear();
+
+    // a closed dialog cancels its job, the result of a running one is dropped
+    QPointer<PaletteGroupsDialog> self(this);
+    m_measureJob = m_scheduler.submit("Measuring palette groups", JobScheduler::PRIORITY_BACKGROUND,
+                                      [doc = &m_doc, crcs]() { return doc->measurePaletteGroups(crcs); },
+                                      [self](const std::vector<ThemeDocument::sPaletteError> &errors, bool cancelled) {
+                                          if (self) self->measureFinished(errors, cancelled);
+                                      });
+}
+
+void PaletteGroupsDialog::measureFinished(const std::vector<ThemeDocument::sPaletteError> &errors, bool cancelled) {
+
+    m_measureJob = 0;
+    if (cancelled) {
+        markMeasuring("Cancelled");
+    } else {
+        for (const auto &error : errors) {
+            m_errors.insert(error.palette_crc, error);
+        }
+    }
+    m_measuring.clear();
+    refresh();
+}
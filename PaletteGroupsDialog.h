@@ -0,0 +1,89 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_PALETTEGROUPSDIALOG_H
+#define FOCUSIPC_PALETTEGROUPSDIALOG_H
+
+#include <QtWidgets>
+
+#include "JobScheduler.h"
+#include "PictureListModel.h"
+#include "ThemeDocument.h"
+
+/*
+ * Palette groups of the opened document with what the next save costs.
+ *
+ * Replacing one 16-bit picture makes the save remap and recompress its
+ * whole group, so every group shows its members, pixels, the work the
+ * save would do and the colour error of the remap. The list follows the
+ * picture changes, colour errors are measured in the background only
+ * for the groups whose members changed since they were last measured.
+ */
+class PaletteGroupsDialog : public QDialog {
+
+    Q_OBJECT
+
+public:
+    PaletteGroupsDialog(ThemeDocument &doc, JobScheduler &scheduler, const PictureListModel &pictures,
+                        QWidget *parent = nullptr);
+    ~PaletteGroupsDialog() override;
+
+    /* an exclusive job holds the document, the list is refreshed after it */
+    void setDocumentBusy(bool busy);
+
+signals:
+    void pictureActivated(int picture_idx);
+
+private:
+    enum enColumns {
+        COL_PALETTE,
+        COL_MEMBERS,
+        COL_PIXELS,
+        COL_REPLACED,
+        COL_SAVE_MB,
+        COL_SAVE_MS,
+        COL_MEAN_DE,
+        COL_MAX_DE,
+        COL_COUNT
+    };
+
+    enum enRoles {
+        PictureIndexRole = Qt::UserRole,
+    };
+
+    /* changes come in bursts, the list is rebuilt once they settle */
+    void scheduleRefresh();
+    void refresh();
+    void showGroups(const std::vector<ThemeDocument::sPaletteGroup> &groups, bool cancelled);
+    void fillGroup(QTreeWidgetItem *item, const ThemeDocument::sPaletteGroup &group);
+    void showError(QTreeWidgetItem *item, const ThemeDocument::sPaletteGroup &group);
+    /* measure queued groups unless a measure job is running already */
+    void startMeasure();
+    void measureFinished(const std::vector<ThemeDocument::sPaletteError> &errors, bool cancelled);
+    void jobFailed(int job_id, const QString &error);
+    /* groups of the measure job that ended without results get the error */
+    void markMeasuring(const QString &error);
+
+    ThemeDocument &m_doc;
+    JobScheduler &m_scheduler;
+    const PictureListModel &m_pictures;
+
+    QTreeWidget *m_tree;
+    QLabel *m_summary;
+    QTimer m_refreshTimer;
+
+    QHash<uint16_t, QTreeWidgetItem *> m_items;
+    QHash<uint16_t, QString> m_keys;   // of the group as its item shows it
+    QHash<uint16_t, ThemeDocument::sPaletteError> m_errors;
+    QList<uint16_t> m_queue;           // groups to measure
+    QList<uint16_t> m_measuring;       // by the running job
+    int m_measureJob = 0;
+    int m_listJob = 0;
+    bool m_refreshWanted = false;      // while listing or busy
+    bool m_busy = false;
+
+    static constexpr int refreshDelayMs = 250;
+};
+
+#endif //FOCUSIPC_PALETTEGROUPSDIALOG_H
@@ -0,0 +1,358 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "PaletteQuantiser.h"
+#include "JobScheduler.h"
+
+#include <EifConverter.h>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+namespace {
+
+    inline int channel(uint32_t rgb, int axis) {
+        return (int) (rgb >> (16 - 8 * axis)) & 0xFF;
+    }
+
+    inline uint32_t rgbOf(const uint8_t *pixel) {
+        return (uint32_t) pixel[0] << 16 | (uint32_t) pixel[1] << 8 | pixel[2];
+    }
+
+    struct sColour {
+        uint32_t rgb;
+        uint32_t count;
+    };
+
+    struct sBox {
+        size_t begin;
+        size_t end;
+        uint64_t weight;
+        int axis;  // of the longest side
+        int range;
+    };
+
+    sBox makeBox(const std::vector<sColour> &colours, size_t begin, size_t end) {
+
+        sBox box{begin, end, 0, 0, 0};
+        int lo[3] = {255, 255, 255}, hi[3] = {};
+        for (size_t i = begin; i < end; ++i) {
+            box.weight += colours[i].count;
+            for (int axis = 0; axis < 3; ++axis) {
+                lo[axis] = std::min(lo[axis], channel(colours[i].rgb, axis));
+                hi[axis] = std::max(hi[axis], channel(colours[i].rgb, axis));
+            }
+        }
+        for (int axis = 0; axis < 3; ++axis) {
+            if (hi[axis] - lo[axis] > box.range) {
+                box.range = hi[axis] - lo[axis];
+                box.axis = axis;
+            }
+        }
+        return box;
+    }
+
+    /* weighted median cut, the colours are reordered */
+    std::vector<uint32_t> medianCut(std::vector<sColour> &colours, size_t palette_size) {
+
+        std::vector<uint32_t> palette;
+        if (colours.size() <= palette_size) {
+            for (const auto &colour : colours) {
+                palette.push_back(colour.rgb);
+            }
+            return palette;
+        }
+
+        // split the box which is the largest by weight and extent until the palette is full
+        std::vector<sBox> boxes{makeBox(colours, 0, colours.size())};
+        while (boxes.size() < palette_size) {
+            auto split = std::max_element(boxes.begin(), boxes.end(), [](const sBox &a, const sBox &b) {
+                return (double) a.weight * a.range < (double) b.weight * b.range;
+            });
+            if (split->range == 0) break;
+
+            const auto box = *split;
+            std::sort(colours.begin() + (ptrdiff_t) box.begin, colours.begin() + (ptrdiff_t) box.end,
+                      [axis = box.axis](const sColour &a, const sColour &b) {
+                          return channel(a.rgb, axis) < channel(b.rgb, axis);
+                      });
+            uint64_t below = 0;
+            size_t middle = box.begin;
+            while (middle + 1 < box.end && below + colours[middle].count <= box.weight / 2) {
+                below += colours[middle++].count;
+            }
+            middle = std::clamp(middle, box.begin + 1, box.end - 1);
+
+            *split = makeBox(colours, box.begin, middle);
+            boxes.push_back(makeBox(colours, middle, box.end));
+        }
+
+        for (const auto &box : boxes) {
+            uint64_t sum[3] = {};
+            for (size_t i = box.begin; i < box.end; ++i) {
+                for (int axis = 0; axis < 3; ++axis) {
+                    sum[axis] += (uint64_t) channel(colours[i].rgb, axis) * colours[i].count;
+                }
+            }
+            uint32_t rgb = 0;
+            for (int axis = 0; axis < 3; ++axis) {
+                rgb = rgb << 8 | (uint32_t) ((sum[axis] + box.weight / 2) / box.weight);
+            }
+            palette.push_back(rgb);
+        }
+        return palette;
+    }
+
+    /* nearest palette entry by RGB distance */
+    class PaletteTree {
+
+    public:
+        explicit PaletteTree(const std::vector<uint32_t> &palette) : m_palette(palette) {
+            std::vector<int> entries(palette.size());
+            std::iota(entries.begin(), entries.end(), 0);
+            m_root = build(entries, 0, (int) entries.size());
+        }
+
+        [[nodiscard]] int nearest(uint32_t rgb) const {
+            int best = 0;
+            int best_distance = std::numeric_limits<int>::max();
+            search(m_root, rgb, best, best_distance);
+            return best;
+        }
+
+    private:
+        struct sNode {
+            int entry;
+            int axis;
+            int left = -1;
+            int right = -1;
+        };
+
+        int build(std::vector<int> &entries, int begin, int end) {
+
+            if (begin >= end) return -1;
+
+            // split on the widest axis at the median entry
+            int axis = 0, widest = -1;
+            for (int a = 0; a < 3; ++a) {
+                auto [lo, hi] = std::minmax_element(entries.begin() + begin, entries.begin() + end,
+                                                    [this, a](int x, int y) {
+                                                        return channel(m_palette[x], a) < channel(m_palette[y], a);
+                                                    });
+                const int width = channel(m_palette[*hi], a) - channel(m_palette[*lo], a);
+                if (width > widest) {
+                    widest = width;
+                    axis = a;
+                }
+            }
+            const int middle = (begin + end) / 2;
+            std::nth_element(entries.begin() + begin, entries.begin() + middle, entries.begin() + end,
+                             [this, axis](int x, int y) {
+                                 return channel(m_palette[x], axis) < channel(m_palette[y], axis);
+                             });
+
+            const int node = (int) m_nodes.size();
+            m_nodes.push_back({entries[middle], axis});
+            const int left = build(entries, begin, middle);
+            const int right = build(entries, middle + 1, end);
+            m_nodes[node].left = left;
+            m_nodes[node].right = right;
+            return node;
+        }
+
+        void search(int node, uint32_t rgb, int &best, int &best_distance) const {
+
+            if (node < 0) return;
+            const auto &n = m_nodes[node];
+            const auto entry = m_palette[n.entry];
+
+            int distance = 0;
+            for (int axis = 0; axis < 3; ++axis) {
+                const int d = channel(rgb, axis) - channel(entry, axis);
+                distance += d * d;
+            }
+            if (distance < best_distance || (distance == best_distance && n.entry < best)) {
+                best_distance = distance;
+                best = n.entry;
+            }
+
+            const int d = channel(rgb, n.axis) - channel(entry, n.axis);
+            search(d < 0 ? n.left : n.right, rgb, best, best_distance);
+            if (d * d <= best_distance) {
+                search(d < 0 ? n.right : n.left, rgb, best, best_distance);
+            }
+        }
+
+        const std::vector<uint32_t> &m_palette;
+        std::vector<sNode> m_nodes;
+        int m_root = -1;
+    };
+
+    struct sLayout {
+        size_t stride;
+        bool alpha_first;
+        bool bgr;
+    };
+}
+
+PaletteQuantiser::sPalette
+PaletteQuantiser::quantise(const std::vector<const std::vector<uint8_t> *> &bitmaps, QThreadPool &pool) {
+
+    // histograms of the bitmaps, each one split into shards by the colour hash.
+    // Transparent pixels only get their colour listed, they are mapped but don't weigh
+    using Histogram = std::unordered_map<uint32_t, uint32_t>;
+    std::vector<std::array<Histogram, shards>> histograms(bitmaps.size());
+    JobScheduler::parallelFor(pool, (int) bitmaps.size(), [&bitmaps, &histograms](int i) {
+        const auto &bitmap = *bitmaps[i];
+        auto &histogram = histograms[i];
+        for (size_t p = 0; p + 3 < bitmap.size(); p += 4) {
+            const auto rgb = rgbOf(&bitmap[p]);
+            histogram[shardOf(rgb)][rgb] += bitmap[p + 3] ? 1 : 0;
+        }
+    });
+
+    // shards hold disjoint colours, so they are merged concurrently
+    std::array<Histogram, shards> merged;
+    JobScheduler::parallelFor(pool, shards, [&histograms, &merged](int shard) {
+        auto &into = merged[shard];
+        for (auto &histogram : histograms) {
+            for (const auto &[rgb, count] : histogram[shard]) {
+                into[rgb] += count;
+            }
+            histogram[shard] = {};
+        }
+    });
+
+    std::vector<sColour> colours;
+    for (const auto &shard : merged) {
+        for (const auto &[rgb, count] : shard) {
+            if (count) {
+                colours.push_back({rgb, count});
+            }
+        }
+    }
+    // the same bitmaps give the same palette whatever the hash order was
+    std::sort(colours.begin(), colours.end(), [](const sColour &a, const sColour &b) { return a.rgb < b.rgb; });
+
+    sPalette result;
+    result.colours = medianCut(colours, paletteSize);
+    if (result.colours.empty()) {
+        result.colours.push_back(0);
+    }
+
+    // every distinct colour is looked up once, the shard tables then hold palette indexes
+    const PaletteTree tree(result.colours);
+    JobScheduler::parallelFor(pool, shards, [&tree, &merged](int shard) {
+        for (auto &[rgb, index] : merged[shard]) {
+            index = (uint32_t) tree.nearest(rgb);
+        }
+    });
+
+    result.indexes.resize(bitmaps.size());
+    JobScheduler::parallelFor(pool, (int) bitmaps.size(), [&bitmaps, &merged, &result](int i) {
+        const auto &bitmap = *bitmaps[i];
+        auto &indexes = result.indexes[i];
+        indexes.resize(bitmap.size() / 4);
+        for (size_t p = 0; p < indexes.size(); ++p) {
+            const auto rgb = rgbOf(&bitmap[p * 4]);
+            indexes[p] = (uint8_t) merged[shardOf(rgb)].at(rgb);
+        }
+    });
+
+    return result;
+}
+
+std::optional<PaletteQuantiser::sApplied>
+PaletteQuantiser::applyToEif(const std::vector<uint8_t> &eif, const std::vector<uint8_t> &rgba,
+                             const sPalette &palette, size_t bitmap) {
+
+    if (eif.size() < pixelsOffset || eif[7] != EIF_TYPE_MULTICOLOR) {
+        return std::nullopt;
+    }
+    const auto header = reinterpret_cast<const EIF::EifBaseHeader *>(eif.data());
+    const size_t width = header->width;
+    const size_t height = header->height;
+    const auto &indexes = palette.indexes.at(bitmap);
+    if (!width || !height || rgba.size() != width * height * 4 || indexes.size() != width * height) {
+        return std::nullopt;
+    }
+
+    // pixels are an index and an alpha byte, rows may be padded to 4 bytes. Take the layout
+    // that decodes every pixel to what FTools decoded, there's no other description of it here
+    auto matches = [&eif, &rgba, width, height](const sLayout &layout) {
+        if (pixelsOffset + layout.stride * (height - 1) + width * 2 > eif.size()) {
+            return false;
+        }
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                const auto pixel = &eif[pixelsOffset + y * layout.stride + x * 2];
+                const auto expected = &rgba[(y * width + x) * 4];
+                const auto index = pixel[layout.alpha_first ? 1 : 0];
+                const auto alpha = pixel[layout.alpha_first ? 0 : 1];
+                if (alpha != expected[3]) {
+                    return false;
+                }
+                if (!alpha) continue;
+                const auto entry = &eif[paletteOffset + index * 3];
+                for (int c = 0; c < 3; ++c) {
+                    if (entry[layout.bgr ? 2 - c : c] != expected[c]) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    };
+
+    std::optional<sLayout> found;
+    for (auto stride : {width * 2, (width * 2 + 3) & ~(size_t) 3}) {
+        for (bool alpha_first : {false, true}) {
+            for (bool bgr : {false, true}) {
+                if (!found && matches({stride, alpha_first, bgr})) {
+                    found = sLayout{stride, alpha_first, bgr};
+                }
+            }
+        }
+    }
+    if (!found) {
+        return std::nullopt;
+    }
+
+    sApplied applied;
+    applied.eif = eif;
+    std::fill(applied.eif.begin() + paletteOffset, applied.eif.begin() + pixelsOffset, 0);
+    for (size_t i = 0; i < palette.colours.size(); ++i) {
+        const auto rgb = palette.colours[i];
+        for (int c = 0; c < 3; ++c) {
+            applied.eif[paletteOffset + i * 3 + (found->bgr ? 2 - c : c)] = (uint8_t) channel(rgb, c);
+        }
+    }
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            applied.eif[pixelsOffset + y * found->stride + x * 2 + (found->alpha_first ? 1 : 0)] =
+                    indexes[y * width + x];
+        }
+    }
+
+    // read back the way the firmware tools read it, the alpha stays and the colours are the palette's
+    EIF::EifImage16bit check;
+    check.openEif(applied.eif);
+    applied.rgba = check.getBitmapRBGA();
+    if (applied.rgba.size() != rgba.size()) {
+        return std::nullopt;
+    }
+    for (size_t p = 0; p < indexes.size(); ++p) {
+        const auto pixel = &applied.rgba[p * 4];
+        if (pixel[3] != rgba[p * 4 + 3]) {
+            return std::nullopt;
+        }
+        if (pixel[3] && rgbOf(pixel) != palette.colours[indexes[p]]) {
+            return std::nullopt;
+        }
+    }
+    return applied;
+}
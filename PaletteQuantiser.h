@@ -0,0 +1,57 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_PALETTEQUANTISER_H
+#define FOCUSIPC_PALETTEQUANTISER_H
+
+#include <QtCore>
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/*
+ * One palette for a group of 16-bit EIFs sharing it.
+ *
+ * Colour histograms of the bitmaps are counted in parallel into hash
+ * sharded tables, the palette is cut from them by weighted median cut
+ * and every distinct colour is mapped once to its nearest palette entry
+ * through a k-d tree. Bitmaps are only read, so the pictures aren't
+ * copied. Fully transparent pixels don't weigh in the palette.
+ */
+class PaletteQuantiser {
+
+public:
+    static constexpr int paletteSize = 256;
+
+    struct sPalette {
+        std::vector<uint32_t> colours;             // 0xRRGGBB, at most paletteSize
+        std::vector<std::vector<uint8_t>> indexes; // per bitmap, one per pixel
+    };
+
+    struct sApplied {
+        std::vector<uint8_t> eif;  // with the palette and the indexes put in
+        std::vector<uint8_t> rgba; // as FTools decodes it back
+    };
+
+    /* RGBA8888 bitmaps */
+    static sPalette quantise(const std::vector<const std::vector<uint8_t> *> &bitmaps, QThreadPool &pool);
+
+    /*
+     * Put the palette and the indexes of one bitmap into its 16-bit EIF, rgba is what the EIF decodes to now.
+     * The pixel layout is found by matching the EIF against rgba and the result is decoded back to check it,
+     * nullopt if either doesn't agree, the EIF has to be remapped some other way then.
+     */
+    static std::optional<sApplied> applyToEif(const std::vector<uint8_t> &eif, const std::vector<uint8_t> &rgba,
+                                              const sPalette &palette, size_t bitmap);
+
+private:
+    static constexpr int shards = 16;
+    static constexpr size_t paletteOffset = 0x10;
+    static constexpr size_t pixelsOffset = paletteOffset + paletteSize * 3;
+
+    static int shardOf(uint32_t rgb) { return (int) ((rgb * 2654435761u) >> 28); }
+};
+
+#endif //FOCUSIPC_PALETTEQUANTISER_H
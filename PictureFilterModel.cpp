@@ -0,0 +1,210 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "PictureFilterModel.h"
+
+#include <EifConverter.h>
+
+#include <algorithm>
+#include <cctype>
+#include <optional>
+
+static inline uint32_t trigram(const char *p) {
+    return (uint8_t) p[0] << 16 | (uint8_t) p[1] << 8 | (uint8_t) p[2];
+}
+
+static std::string toLower(std::string str) {
+    std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return (char) std::tolower(c); });
+    return str;
+}
+
+PictureFilterModel::PictureFilterModel(PictureListModel &pictures, QObject *parent) :
+        QSortFilterProxyModel(parent), m_pictures(pictures) {
+
+    setSourceModel(&m_pictures);
+
+    connect(&m_pictures, &QAbstractItemModel::modelReset, this, [this]() {
+        rebuildIndex();
+        applyQuery();
+    });
+    connect(&m_pictures, &QAbstractItemModel::dataChanged, this,
+            [this](const QModelIndex &, const QModelIndex &, const QVector<int> &roles) {
+        // thumbnails arrive all the time, only a state change may move a row in or out
+        if (!m_query.isEmpty() && !roles.contains(Qt::DecorationRole)) {
+            applyQuery();
+        }
+    });
+
+    rebuildIndex();
+}
+
+QString PictureFilterModel::queryHelp() {
+    return "Words to find in names, and filters:\n"
+           "type:8|16|32, size:<width>x<height> (* for any), palette:<crc>, changed, dup, dup:<picture>";
+}
+
+void PictureFilterModel::rebuildIndex() {
+
+    m_names.clear();
+    m_trigrams.clear();
+
+    const auto &pictures = m_pictures.pictures();
+    m_names.reserve(pictures.size());
+    for (int row = 0; row < (int) pictures.size(); ++row) {
+        auto &name = m_names.emplace_back(toLower(pictures[row].name));
+        for (size_t i = 0; i + 3 <= name.size(); ++i) {
+            auto &postings = m_trigrams[trigram(name.data() + i)];
+            // rows come in order, so postings stay sorted and unique
+            if (postings.empty() || postings.back() != row) {
+                postings.push_back(row);
+            }
+        }
+    }
+}
+
+std::vector<int> PictureFilterModel::matchName(const std::string &word) const {
+
+    std::vector<int> rows;
+
+    if (word.size() < 3) {
+        for (int row = 0; row < (int) m_names.size(); ++row) {
+            if (m_names[row].find(word) != std::string::npos) {
+                rows.push_back(row);
+            }
+        }
+        return rows;
+    }
+
+    // start with the rarest trigram, then narrow it down by the others
+    std::vector<const std::vector<int> *> lists;
+    for (size_t i = 0; i + 3 <= word.size(); ++i) {
+        auto it = m_trigrams.find(trigram(word.data() + i));
+        if (it == m_trigrams.end()) {
+            return {};
+        }
+        lists.push_back(&it->second);
+    }
+    std::sort(lists.begin(), lists.end(), [](auto a, auto b) { return a->size() < b->size(); });
+
+    rows = *lists.front();
+    std::vector<int> narrowed;
+    for (size_t i = 1; i < lists.size() && !rows.empty(); ++i) {
+        narrowed.clear();
+        std::set_intersection(rows.begin(), rows.end(), lists[i]->begin(), lists[i]->end(),
+                              std::back_inserter(narrowed));
+        rows.swap(narrowed);
+    }
+
+    // trigrams may be spread over the name, check the whole word
+    rows.erase(std::remove_if(rows.begin(), rows.end(),
+                              [this, &word](int row) { return m_names[row].find(word) == std::string::npos; }),
+               rows.end());
+    return rows;
+}
+
+void PictureFilterModel::setQuery(const QString &query) {
+
+    m_query = query.trimmed();
+    applyQuery();
+}
+
+void PictureFilterModel::applyQuery() {
+
+    const auto &pictures = m_pictures.pictures();
+    m_accepted.assign(pictures.size(), 1);
+
+    std::optional<std::vector<int>> name_rows;
+    std::optional<int> type;
+    int width = -1, height = -1;
+    std::optional<uint16_t> palette;
+    bool changed = false;
+    bool duplicated = false;
+    std::optional<int> duplicates_of;
+    bool nothing = false;
+
+    auto dimension = [&nothing](const QString &value) {
+        if (value == "*") return -1;
+        bool ok;
+        int res = value.toInt(&ok);
+        nothing |= !ok;
+        return res;
+    };
+
+    for (const auto &word : m_query.split(' ')) {
+        if (word.isEmpty()) continue;
+        auto lower = word.toLower();
+        if (lower.startsWith("type:")) {
+            auto value = lower.mid(5);
+            if (value == "8" || value == "mono") type = EIF_TYPE_MONOCHROME;
+            else if (value == "16" || value == "multi") type = EIF_TYPE_MULTICOLOR;
+            else if (value == "32" || value == "super") type = EIF_TYPE_SUPERCOLOR;
+            else nothing = true;
+        } else if (lower.startsWith("size:")) {
+            auto value = lower.mid(5).split('x');
+            width = dimension(value.value(0, "*"));
+            height = dimension(value.value(1, "*"));
+        } else if (lower.startsWith("palette:")) {
+            bool ok;
+            palette = (uint16_t) lower.mid(8).toUInt(&ok, 16);
+            nothing |= !ok;
+        } else if (lower == "changed") {
+            changed = true;
+        } else if (lower == "dup") {
+            duplicated = true;
+        } else if (lower.startsWith("dup:")) {
+            bool ok;
+            int idx = lower.mid(4).toInt(&ok);
+            nothing |= !ok || idx < 0 || idx >= (int) pictures.size();
+            if (!nothing) {
+                duplicates_of = pictures[idx].duplicate_of >= 0 ? pictures[idx].duplicate_of : idx;
+            }
+        } else {
+            auto rows = matchName(lower.toStdString());
+            if (name_rows) {
+                std::vector<int> both;
+                std::set_intersection(name_rows->begin(), name_rows->end(), rows.begin(), rows.end(),
+                                      std::back_inserter(both));
+                rows.swap(both);
+            }
+            name_rows = std::move(rows);
+        }
+    }
+
+    if (nothing) {
+        std::fill(m_accepted.begin(), m_accepted.end(), 0);
+    } else if (name_rows) {
+        std::fill(m_accepted.begin(), m_accepted.end(), 0);
+        for (auto row : *name_rows) {
+            m_accepted[row] = 1;
+        }
+    }
+
+    // first copies don't point anywhere, find them by the others
+    std::vector<char> has_copies(pictures.size());
+    for (const auto &picture : pictures) {
+        if (picture.duplicate_of >= 0) {
+            has_copies[picture.index] = has_copies[picture.duplicate_of] = 1;
+        }
+    }
+
+    for (int row = 0; row < (int) pictures.size(); ++row) {
+        const auto &picture = pictures[row];
+        const int first = picture.duplicate_of >= 0 ? picture.duplicate_of : picture.index;
+        if ((duplicated && !has_copies[row]) ||
+            (duplicates_of && first != *duplicates_of) ||
+            (type && picture.type != *type) ||
+            (width >= 0 && picture.width != width) ||
+            (height >= 0 && picture.height != height) ||
+            (palette && picture.palette_crc != *palette) ||
+            (changed && !picture.changed)) {
+            m_accepted[row] = 0;
+        }
+    }
+
+    invalidateFilter();
+}
+
+bool PictureFilterModel::filterAcceptsRow(int source_row, const QModelIndex &source_parent) const {
+    return source_row < (int) m_accepted.size() && m_accepted[source_row];
+}
@@ -0,0 +1,61 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_PICTUREFILTERMODEL_H
+#define FOCUSIPC_PICTUREFILTERMODEL_H
+
+#include <QSortFilterProxyModel>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "PictureListModel.h"
+
+/*
+ * Live filter of the picture list.
+ *
+ * Query is a list of words, every one has to match:
+ *   needle          name contains "needle", case insensitive
+ *   type:16         EIF type, 8/16/32 or mono/multi/super
+ *   size:64x*       width x height, * matches any
+ *   palette:1a2b    shared palette group (palette CRC)
+ *   changed         replaced, but not saved yet
+ *   dup             has copies with the same pixels, after the duplicates search
+ *   dup:12          picture 12 and its copies
+ *
+ * Names are looked up in a trigram index built once per document,
+ * so a keystroke costs a few posting list intersections, not a scan.
+ */
+class PictureFilterModel : public QSortFilterProxyModel {
+
+    Q_OBJECT
+
+public:
+    explicit PictureFilterModel(PictureListModel &pictures, QObject *parent = nullptr);
+
+    void setQuery(const QString &query);
+    [[nodiscard]] QString query() const { return m_query; }
+
+    static QString queryHelp();
+
+protected:
+    bool filterAcceptsRow(int source_row, const QModelIndex &source_parent) const override;
+
+private:
+    void rebuildIndex();
+    void applyQuery();
+
+    /* sorted rows which names contain the lower case word */
+    [[nodiscard]] std::vector<int> matchName(const std::string &word) const;
+
+    PictureListModel &m_pictures;
+    QString m_query;
+
+    std::vector<std::string> m_names; // lower case names in the row order
+    std::unordered_map<uint32_t, std::vector<int>> m_trigrams;
+    std::vector<char> m_accepted;
+};
+
+#endif //FOCUSIPC_PICTUREFILTERMODEL_H
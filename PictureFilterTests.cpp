@@ -0,0 +1,82 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include <QtTest>
+
+#include <EifConverter.h>
+
+#include "PictureFilterModel.h"
+#include "PictureListModel.h"
+
+/*
+ * Queries of the picture filter: names, type, size, palette, changed and copies.
+ */
+class PictureFilterTests : public QObject {
+
+    Q_OBJECT
+
+private slots:
+    void query_data();
+    void query();
+
+private:
+    static QList<int> filtered(PictureFilterModel &filter);
+};
+
+QList<int> PictureFilterTests::filtered(PictureFilterModel &filter) {
+
+    QList<int> pictures;
+    for (int row = 0; row < filter.rowCount(); ++row) {
+        pictures << filter.index(row, 0).data(PictureListModel::PictureIndexRole).toInt();
+    }
+    return pictures;
+}
+
+void PictureFilterTests::query_data() {
+
+    QTest::addColumn<QString>("query");
+    QTest::addColumn<QList<int>>("pictures");
+
+    QTest::newRow("empty") << "" << QList<int>{0, 1, 2, 3, 4};
+    QTest::newRow("name") << "NEEDLE" << QList<int>{0, 2};
+    QTest::newRow("short name") << "ar" << QList<int>{3};
+    QTest::newRow("two names") << "needle gauge" << QList<int>{2};
+    QTest::newRow("missing name") << "nothing" << QList<int>{};
+    QTest::newRow("type") << "type:16" << QList<int>{1, 2};
+    QTest::newRow("type name") << "type:mono" << QList<int>{0, 4};
+    QTest::newRow("bad type") << "type:12" << QList<int>{};
+    QTest::newRow("size") << "size:64x*" << QList<int>{0, 1, 2, 4};
+    QTest::newRow("size both") << "size:64x32" << QList<int>{1, 2};
+    QTest::newRow("bad size") << "size:ax1" << QList<int>{};
+    QTest::newRow("palette") << "palette:1A2B" << QList<int>{1, 2};
+    QTest::newRow("changed") << "changed" << QList<int>{3};
+    QTest::newRow("dup") << "dup" << QList<int>{0, 4};
+    QTest::newRow("dup of copy") << "dup:4" << QList<int>{0, 4};
+    QTest::newRow("dup out of range") << "dup:9" << QList<int>{};
+    QTest::newRow("all at once") << "needle type:16 size:64x32 palette:1a2b" << QList<int>{2};
+}
+
+void PictureFilterTests::query() {
+
+    QFETCH(QString, query);
+    QFETCH(QList<int>, pictures);
+
+    ThemeDocument doc;
+    PictureListModel list(doc);
+    list.reset({
+        {0, "needle_big", 0, EIF_TYPE_MONOCHROME, 64, 64, false, -1},
+        {1, "gauge_face", 0x1a2b, EIF_TYPE_MULTICOLOR, 64, 32, false, -1},
+        {2, "gauge_needle", 0x1a2b, EIF_TYPE_MULTICOLOR, 64, 32, false, -1},
+        {3, "star", 0, EIF_TYPE_SUPERCOLOR, 16, 16, true, -1},
+        {4, "copy", 0, EIF_TYPE_MONOCHROME, 64, 64, false, 0},
+    });
+    PictureFilterModel filter(list);
+
+    filter.setQuery(query);
+    QCOMPARE(filtered(filter), pictures);
+}
+
+QTEST_GUILESS_MAIN(PictureFilterTests)
+
+#include "PictureFilterTests.moc"
@@ -0,0 +1,141 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "PictureListModel.h"
+
+PictureListModel::PictureListModel(ThemeDocument &doc, QObject *parent) :
+        QAbstractListModel(parent), m_doc(doc) {
+    // leave most of the cores for the document
+    m_pool.setMaxThreadCount(2);
+}
+
+PictureListModel::~PictureListModel() {
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+int PictureListModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : (int) m_pictures.size();
+}
+
+QVariant PictureListModel::data(const QModelIndex &index, int role) const {
+
+    if (!index.isValid() || index.row() >= (int) m_pictures.size())
+        return QVariant();
+
+    const auto &picture = m_pictures[index.row()];
+    switch (role) {
+        case Qt::DisplayRole:
+            return QString::fromStdString(picture.name);
+        case Qt::ToolTipRole:
+            return QString("%1x%2%3").arg(picture.width).arg(picture.height)
+                    .arg(picture.palette_crc ? ", palette " + QString::number(picture.palette_crc, 16) : "");
+        case Qt::BackgroundRole:
+            return picture.changed ? QBrush(Qt::gray) : QVariant();
+        case Qt::DecorationRole:
+            if (auto thumbnail = m_thumbnails.object(thumbnailKey(index.row()))) {
+                return *thumbnail;
+            }
+            if (!m_failed.contains(thumbnailKey(index.row()))) {
+                requestThumbnail(index.row());
+            }
+            return QVariant();
+        case PictureIndexRole:
+            return picture.index;
+        default:
+            return QVariant();
+    }
+}
+
+int PictureListModel::thumbnailKey(int row) const {
+    const auto &picture = m_pictures[row];
+    return picture.duplicate_of >= 0 ? picture.duplicate_of : picture.index;
+}
+
+void PictureListModel::requestThumbnail(int row) const {
+
+    const int picture_idx = thumbnailKey(row);
+    if (m_pending.contains(picture_idx)) return;
+    m_pending.insert(picture_idx);
+
+    auto self = const_cast<PictureListModel *>(this);
+    const int generation = m_generation;
+    QtConcurrent::run(&m_pool, [self, picture_idx, generation]() {
+        QImage thumbnail;
+        try {
+            thumbnail = self->m_doc.decodePicture(picture_idx)
+                    .scaled(thumbnailSize, thumbnailSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        } catch (const std::exception &) {
+            // the view shows just the name then
+        }
+
+        // pixmaps are made in the GUI thread, a call queued to a deleted model is dropped
+        QMetaObject::invokeMethod(self, [self, picture_idx, generation, thumbnail]() {
+            if (generation != self->m_generation) return;
+            self->m_pending.remove(picture_idx);
+            auto index = self->index(picture_idx);
+            if (self->m_stale.remove(picture_idx)) {
+                // picture changed while it was decoded, let the view ask again
+                emit self->dataChanged(index, index, {Qt::DecorationRole});
+                return;
+            }
+            if (thumbnail.isNull()) {
+                self->m_failed.insert(picture_idx);
+                return;
+            }
+
+            self->m_thumbnails.insert(picture_idx, new QPixmap(QPixmap::fromImage(thumbnail)));
+            for (int row = 0; row < (int) self->m_pictures.size(); ++row) {
+                if (self->thumbnailKey(row) == picture_idx) {
+                    auto copy = self->index(row);
+                    emit self->dataChanged(copy, copy, {Qt::DecorationRole});
+                }
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+void PictureListModel::reset(std::vector<ThemeDocument::sPictureInfo> pictures) {
+
+    beginResetModel();
+    m_pool.clear();
+    m_generation++;
+    m_pending.clear();
+    m_stale.clear();
+    m_failed.clear();
+    m_thumbnails.clear();
+    m_pictures = std::move(pictures);
+    endResetModel();
+}
+
+void PictureListModel::refreshInfo() {
+
+    auto pictures = m_doc.pictureList();
+    if (pictures.size() != m_pictures.size()) {
+        reset(std::move(pictures));
+        return;
+    }
+    m_pictures = std::move(pictures);
+    if (!m_pictures.empty()) {
+        emit dataChanged(index(0), index((int) m_pictures.size() - 1),
+                         {Qt::DisplayRole, Qt::ToolTipRole, Qt::BackgroundRole});
+    }
+}
+
+void PictureListModel::updatePicture(int picture_idx) {
+
+    if (picture_idx < 0 || picture_idx >= (int) m_pictures.size()) return;
+
+    if (auto info = m_doc.pictureInfo(picture_idx)) {
+        m_pictures[picture_idx] = *info;
+    }
+    m_thumbnails.remove(picture_idx);
+    m_failed.remove(picture_idx);
+    if (m_pending.contains(picture_idx)) {
+        m_stale.insert(picture_idx);
+    }
+    auto index = this->index(picture_idx);
+    emit dataChanged(index, index);
+    emit pictureChanged(picture_idx);
+}
@@ -0,0 +1,66 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_PICTURELISTMODEL_H
+#define FOCUSIPC_PICTURELISTMODEL_H
+
+#include <QtCore>
+#include <QtGui>
+
+#include "ThemeDocument.h"
+
+/*
+ * Pictures of the opened document for the list view.
+ *
+ * Thumbnails are decoded on a background pool only when the view asks
+ * for a row, so a long list costs nothing until it's scrolled through.
+ * A picture that doesn't decode is shown by its name only and isn't
+ * decoded again until it changes.
+ */
+class PictureListModel : public QAbstractListModel {
+
+    Q_OBJECT
+
+public:
+    enum enRoles {
+        PictureIndexRole = Qt::UserRole,
+    };
+
+    static constexpr int thumbnailSize = 48;
+
+    explicit PictureListModel(ThemeDocument &doc, QObject *parent = nullptr);
+    ~PictureListModel() override;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    void reset(std::vector<ThemeDocument::sPictureInfo> pictures);
+    [[nodiscard]] const std::vector<ThemeDocument::sPictureInfo> &pictures() const { return m_pictures; }
+
+    /* picture content or its state changed, drop the thumbnail and reread the info */
+    void updatePicture(int picture_idx);
+    /* reread infos of all pictures, thumbnails are kept */
+    void refreshInfo();
+
+signals:
+    /* emitted by updatePicture() */
+    void pictureChanged(int picture_idx);
+
+private:
+    void requestThumbnail(int row) const;
+    /* copies share one thumbnail, it's kept under the first one */
+    [[nodiscard]] int thumbnailKey(int row) const;
+
+    ThemeDocument &m_doc;
+    std::vector<ThemeDocument::sPictureInfo> m_pictures;
+
+    mutable QCache<int, QPixmap> m_thumbnails{2048}; // by thumbnailKey()
+    mutable QSet<int> m_pending;
+    QSet<int> m_stale;   // pending thumbnails of changed pictures
+    mutable QSet<int> m_failed; // pictures that didn't decode, by thumbnailKey()
+    mutable QThreadPool m_pool;
+    int m_generation = 0; // drops thumbnails of a closed document
+};
+
+#endif //FOCUSIPC_PICTURELISTMODEL_H
@@ -0,0 +1,130 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "PixelConvert.h"
+
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PIXEL_CONVERT_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(PIXEL_CONVERT_SSE2) && defined(__GNUC__)
+#define PIXEL_CONVERT_AVX2
+#include <immintrin.h>
+#endif
+
+namespace {
+
+    // exact round(c * a / 255)
+    inline uint32_t mul255(uint32_t c, uint32_t a) {
+        uint32_t t = c * a + 128;
+        return (t + (t >> 8)) >> 8;
+    }
+
+    void convertScalar(const uint8_t *src, uint32_t *dst, size_t pixels) {
+        for (size_t i = 0; i < pixels; ++i, src += 4) {
+            uint32_t a = src[3];
+            dst[i] = a << 24 | mul255(src[0], a) << 16 | mul255(src[1], a) << 8 | mul255(src[2], a);
+        }
+    }
+
+#ifdef PIXEL_CONVERT_SSE2
+    // 8 channels of two pixels in 16 bit lanes, alpha lane is multiplied by 255
+    inline __m128i premultiply(__m128i px, __m128i alpha_lane, __m128i round) {
+        __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        a = _mm_or_si128(_mm_andnot_si128(alpha_lane, a), _mm_and_si128(alpha_lane, _mm_set1_epi16(255)));
+        __m128i t = _mm_add_epi16(_mm_mullo_epi16(px, a), round);
+        return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+
+    // RGBA words to ARGB, swap R and B
+    inline __m128i swapRB(__m128i px) {
+        const __m128i ag_mask = _mm_set1_epi32((int) 0xFF00FF00);
+        __m128i rb = _mm_andnot_si128(ag_mask, px);
+        rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+        return _mm_or_si128(_mm_and_si128(px, ag_mask), _mm_andnot_si128(ag_mask, rb));
+    }
+
+    size_t convertSse2(const uint8_t *src, uint32_t *dst, size_t pixels) {
+
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi16(128);
+        const __m128i alpha_lane = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4) {
+            __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+            __m128i lo = premultiply(_mm_unpacklo_epi8(px, zero), alpha_lane, round);
+            __m128i hi = premultiply(_mm_unpackhi_epi8(px, zero), alpha_lane, round);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), swapRB(_mm_packus_epi16(lo, hi)));
+        }
+        return i;
+    }
+#endif
+
+#ifdef PIXEL_CONVERT_AVX2
+    __attribute__((target("avx2")))
+    inline __m256i premultiply256(__m256i px, __m256i alpha_lane, __m256i round) {
+        __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        a = _mm256_or_si256(_mm256_andnot_si256(alpha_lane, a), _mm256_and_si256(alpha_lane, _mm256_set1_epi16(255)));
+        __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(px, a), round);
+        return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+    }
+
+    __attribute__((target("avx2")))
+    size_t convertAvx2(const uint8_t *src, uint32_t *dst, size_t pixels) {
+
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i round = _mm256_set1_epi16(128);
+        const __m256i alpha_lane = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+        const __m256i swap_rb = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                                 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+        size_t i = 0;
+        for (; i + 8 <= pixels; i += 8) {
+            __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4));
+            // unpack and pack work inside 128 bit lanes, so pixel order is kept
+            __m256i lo = premultiply256(_mm256_unpacklo_epi8(px, zero), alpha_lane, round);
+            __m256i hi = premultiply256(_mm256_unpackhi_epi8(px, zero), alpha_lane, round);
+            __m256i res = _mm256_shuffle_epi8(_mm256_packus_epi16(lo, hi), swap_rb);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), res);
+        }
+        return i;
+    }
+
+    bool hasAvx2() {
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        return avx2;
+    }
+#endif
+}
+
+void PixelConvert::rgbaToArgb32Premultiplied(const uint8_t *src, uint32_t *dst, size_t pixels) {
+
+    size_t done = 0;
+#ifdef PIXEL_CONVERT_AVX2
+    if (hasAvx2()) {
+        done = convertAvx2(src, dst, pixels);
+    }
+#endif
+#ifdef PIXEL_CONVERT_SSE2
+    done += convertSse2(src + done * 4, dst + done, pixels - done);
+#endif
+    convertScalar(src + done * 4, dst + done, pixels - done);
+}
+
+QImage PixelConvert::imageFromRgba(const std::vector<uint8_t> &rgba, int width, int height) {
+
+    if (rgba.size() < (size_t) width * height * 4) {
+        throw std::runtime_error("Bitmap size mismatch");
+    }
+
+    // 32 bit scanlines are never padded, so the whole image is converted at once
+    QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+    rgbaToArgb32Premultiplied(rgba.data(), reinterpret_cast<uint32_t *>(image.bits()), (size_t) width * height);
+
+    return image;
+}
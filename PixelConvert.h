@@ -0,0 +1,22 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_PIXELCONVERT_H
+#define FOCUSIPC_PIXELCONVERT_H
+
+#include <QImage>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace PixelConvert {
+
+    /* RGBA8888 bytes to premultiplied ARGB32 words, src and dst may not overlap */
+    void rgbaToArgb32Premultiplied(const uint8_t *src, uint32_t *dst, size_t pixels);
+
+    /* make an image ready for QPixmap from the EIF RGBA bitmap in one pass */
+    QImage imageFromRgba(const std::vector<uint8_t> &rgba, int width, int height);
+}
+
+#endif //FOCUSIPC_PIXELCONVERT_H
@@ -0,0 +1,166 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstring>
+
+static std::atomic<Profiler::AllocationCounter> allocationCounter{nullptr};
+
+static int threadNumber() {
+    static QAtomicInt threads = 0;
+    static thread_local int number = threads.fetchAndAddRelaxed(1) + 1;
+    return number;
+}
+
+void Profiler::setAllocationCounter(AllocationCounter counter) {
+    allocationCounter = counter;
+}
+
+quint64 Profiler::threadAllocations() {
+    auto counter = allocationCounter.load(std::memory_order_relaxed);
+    return counter ? counter() : 0;
+}
+
+Profiler::Scope::Scope(Profiler &profiler, const char *stage, std::string detail) :
+        m_profiler(profiler), m_stage(stage), m_detail(std::move(detail)),
+        m_start_us(profiler.clock.nsecsElapsed() / 1000), m_allocations(threadAllocations()) {
+}
+
+Profiler::Scope::~Scope() {
+    auto allocations = (qint64) (threadAllocations() - m_allocations);
+    m_profiler.record({m_stage, std::move(m_detail), m_start_us,
+                       m_profiler.clock.nsecsElapsed() / 1000 - m_start_us, threadNumber(), m_bytes, allocations});
+}
+
+static int nextProfilerId() {
+    static QAtomicInt ids = 0;
+    return ids.fetchAndAddRelaxed(1) + 1;
+}
+
+Profiler::Profiler() : id(nextProfilerId()) {
+    clock.start();
+}
+
+Profiler::sThreadLog &Profiler::threadLog() {
+
+    // ids aren't reused, so a log of a destroyed profiler is never looked up again
+    static thread_local std::vector<std::pair<int, sThreadLog *>> cache;
+    for (const auto &[profiler_id, log] : cache) {
+        if (profiler_id == id) return *log;
+    }
+
+    QMutexLocker locker(&mutex);
+    auto log = logs.emplace_back(std::make_unique<sThreadLog>()).get();
+    cache.emplace_back(id, log);
+    return *log;
+}
+
+static void addToTotals(std::vector<Profiler::sStage> &totals, const Profiler::sStage &stage) {
+
+    auto it = std::find_if(totals.begin(), totals.end(),
+                           [&stage](const Profiler::sStage &total) { return 0 == strcmp(total.name, stage.name); });
+    if (it == totals.end()) {
+        totals.push_back(stage);
+        return;
+    }
+    it->calls += stage.calls;
+    it->total_us += stage.total_us;
+    it->bytes += stage.bytes;
+    it->allocations += stage.allocations;
+    it->first_us = std::min(it->first_us, stage.first_us);
+    if (stage.max_us >= it->max_us) {
+        it->max_us = stage.max_us;
+        it->slowest = stage.slowest;
+    }
+}
+
+void Profiler::record(sEvent &&event) {
+
+    auto &log = threadLog();
+    QMutexLocker locker(&log.mutex);
+
+    sStage stage{event.stage, 1, event.duration_us, event.duration_us, event.bytes, event.allocations,
+                 event.detail, event.start_us};
+    addToTotals(log.totals, stage);
+
+    if (eventsKept.fetch_add(1, std::memory_order_relaxed) < maxEvents) {
+        log.events.push_back(std::move(event));
+    } else {
+        eventsKept.fetch_sub(1, std::memory_order_relaxed);
+        log.dropped++;
+    }
+}
+
+void Profiler::clear() {
+
+    QMutexLocker locker(&mutex);
+    for (auto &log : logs) {
+        QMutexLocker log_locker(&log->mutex);
+        log->events.clear();
+        log->totals.clear();
+        log->dropped = 0;
+    }
+    eventsKept = 0;
+}
+
+std::vector<Profiler::sStage> Profiler::stages() const {
+
+    std::vector<sStage> totals;
+    QMutexLocker locker(&mutex);
+    for (const auto &log : logs) {
+        QMutexLocker log_locker(&log->mutex);
+        for (const auto &stage : log->totals) {
+            addToTotals(totals, stage);
+        }
+    }
+    std::stable_sort(totals.begin(), totals.end(),
+                     [](const sStage &a, const sStage &b) { return a.first_us < b.first_us; });
+    return totals;
+}
+
+size_t Profiler::eventsCount() const {
+
+    size_t count = 0;
+    QMutexLocker locker(&mutex);
+    for (const auto &log : logs) {
+        QMutexLocker log_locker(&log->mutex);
+        count += log->events.size() + log->dropped;
+    }
+    return count;
+}
+
+QByteArray Profiler::chromeTrace() const {
+
+    QJsonArray trace_events;
+    size_t dropped = 0;
+    QMutexLocker locker(&mutex);
+    for (const auto &log : logs) {
+        QMutexLocker log_locker(&log->mutex);
+        dropped += log->dropped;
+        for (const auto &event : log->events) {
+            QJsonObject args{{"bytes", event.bytes}, {"allocations", event.allocations}};
+            if (!event.detail.empty()) {
+                args["detail"] = QString::fromStdString(event.detail);
+            }
+            trace_events.append(QJsonObject{
+                    {"name", event.stage},
+                    {"cat",  "themedoc"},
+                    {"ph",   "X"},
+                    {"ts",   event.start_us},
+                    {"dur",  event.duration_us},
+                    {"pid",  (qint64) QCoreApplication::applicationPid()},
+                    {"tid",  event.thread},
+                    {"args", args},
+            });
+        }
+    }
+
+    return QJsonDocument(QJsonObject{
+            {"traceEvents",     trace_events},
+            {"displayTimeUnit", "ms"},
+            {"otherData",       QJsonObject{{"dropped_events", (qint64) dropped}}},
+    }).toJson(QJsonDocument::Compact);
+}
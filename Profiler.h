@@ -0,0 +1,112 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_PROFILER_H
+#define FOCUSIPC_PROFILER_H
+
+#include <QtCore>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Scoped stage timers of the document pipeline.
+ *
+ * A Scope records wall time, processed bytes and, when the binary installs
+ * an allocation counter, heap allocations made by its thread while it was
+ * alive. Events keep the picture or palette group they belong to, so a slow
+ * save can be traced down to the item. Stage totals are kept even when the
+ * event buffer is full.
+ *
+ * Every thread records into its own log, the logs are merged only when
+ * they are read, so parallel stages don't contend on one mutex.
+ */
+class Profiler {
+
+public:
+    struct sStage {
+        const char *name;
+        qint64 calls = 0;
+        qint64 total_us = 0;
+        qint64 max_us = 0;
+        qint64 bytes = 0;
+        qint64 allocations = 0;
+        std::string slowest; // detail of the longest call
+        qint64 first_us = 0; // start of the first call
+    };
+
+    /* heap allocations made by the calling thread so far */
+    using AllocationCounter = quint64 (*)();
+
+    class Scope {
+    public:
+        Scope(Profiler &profiler, const char *stage, std::string detail = {});
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+        ~Scope();
+
+        void addBytes(qint64 bytes) { m_bytes += bytes; }
+        void setDetail(std::string detail) { m_detail = std::move(detail); }
+
+    private:
+        Profiler &m_profiler;
+        const char *m_stage;
+        std::string m_detail;
+        qint64 m_start_us;
+        qint64 m_bytes = 0;
+        quint64 m_allocations;
+    };
+
+    Profiler();
+    Profiler(const Profiler &) = delete;
+    Profiler &operator=(const Profiler &) = delete;
+
+    void clear();
+
+    /* totals in the order stages were first seen */
+    [[nodiscard]] std::vector<sStage> stages() const;
+    [[nodiscard]] size_t eventsCount() const;
+
+    /* events in the Chrome trace event format, open it in chrome://tracing or Perfetto */
+    [[nodiscard]] QByteArray chromeTrace() const;
+
+    /* allocations are counted only by binaries that replace operator new and
+     * install the counter, the library leaves the allocator alone (see main.cpp and ThemeBench) */
+    static void setAllocationCounter(AllocationCounter counter);
+    static quint64 threadAllocations();
+
+private:
+    struct sEvent {
+        const char *stage;
+        std::string detail;
+        qint64 start_us;
+        qint64 duration_us;
+        int thread;
+        qint64 bytes;
+        qint64 allocations;
+    };
+
+    /* events and totals of one thread, its mutex is contended only by readers */
+    struct sThreadLog {
+        QMutex mutex;
+        std::vector<sEvent> events;
+        std::vector<sStage> totals;
+        size_t dropped = 0;
+    };
+
+    void record(sEvent &&event);
+    sThreadLog &threadLog();
+
+    static constexpr size_t maxEvents = 200000;
+
+    const int id;                  // tells the logs of this profiler in the threads' caches
+    mutable QMutex mutex;          // guards the list of logs
+    QElapsedTimer clock;
+    std::vector<std::unique_ptr<sThreadLog>> logs;
+    std::atomic<size_t> eventsKept{0};
+};
+
+#endif //FOCUSIPC_PROFILER_H
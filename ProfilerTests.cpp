@@ -0,0 +1,186 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include <QtTest>
+
+#include <cstring>
+#include <thread>
+
+#include "Profiler.h"
+
+/*
+ * Stage totals, the merge of the per-thread logs and the Chrome trace.
+ */
+class ProfilerTests : public QObject {
+
+    Q_OBJECT
+
+private slots:
+    void scopeTotals();
+    void allocations();
+    void threadsMerge();
+    void chromeTrace();
+
+private:
+    static const Profiler::sStage *stage(const std::vector<Profiler::sStage> &stages, const char *name);
+    static void recordFromThreads(Profiler &profiler, int threads, int scopes);
+};
+
+const Profiler::sStage *ProfilerTests::stage(const std::vector<Profiler::sStage> &stages, const char *name) {
+
+    for (const auto &total : stages) {
+        if (0 == strcmp(total.name, name)) return &total;
+    }
+    return nullptr;
+}
+
+void ProfilerTests::recordFromThreads(Profiler &profiler, int threads, int scopes) {
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back([&profiler, scopes, i]() {
+            for (int j = 0; j < scopes; ++j) {
+                Profiler::Scope scope(profiler, "compress", "thread " + std::to_string(i));
+                scope.addBytes(2);
+            }
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void ProfilerTests::scopeTotals() {
+
+    Profiler profiler;
+    {
+        Profiler::Scope outer(profiler, "save");
+        outer.addBytes(100);
+        {
+            Profiler::Scope fast(profiler, "replace", "fast");
+            fast.addBytes(10);
+        }
+        {
+            Profiler::Scope slow(profiler, "replace", "slow");
+            slow.addBytes(20);
+            QThread::msleep(20);
+        }
+    }
+
+    // stages go in the order they were entered, the slowest call keeps its detail
+    auto stages = profiler.stages();
+    QCOMPARE(stages.size(), (size_t) 2);
+    QCOMPARE(QString(stages[0].name), QString("save"));
+    QCOMPARE(QString(stages[1].name), QString("replace"));
+
+    QCOMPARE(stages[0].calls, (qint64) 1);
+    QCOMPARE(stages[0].bytes, (qint64) 100);
+    QVERIFY(stages[0].total_us >= stages[1].total_us);
+
+    QCOMPARE(stages[1].calls, (qint64) 2);
+    QCOMPARE(stages[1].bytes, (qint64) 30);
+    QCOMPARE(stages[1].slowest, std::string("slow"));
+    QVERIFY(stages[1].max_us >= 20000);
+    QVERIFY(stages[1].total_us >= stages[1].max_us);
+    QCOMPARE(profiler.eventsCount(), (size_t) 3);
+
+    profiler.clear();
+    QVERIFY(profiler.stages().empty());
+    QCOMPARE(profiler.eventsCount(), (size_t) 0);
+}
+
+static quint64 fakeAllocations = 0;
+
+static quint64 countFakeAllocations() {
+    return fakeAllocations;
+}
+
+void ProfilerTests::allocations() {
+
+    Profiler profiler;
+    {
+        Profiler::Scope scope(profiler, "uncounted");
+        fakeAllocations += 3;
+    }
+
+    Profiler::setAllocationCounter(&countFakeAllocations);
+    {
+        Profiler::Scope scope(profiler, "counted");
+        fakeAllocations += 5;
+    }
+    Profiler::setAllocationCounter(nullptr);
+
+    auto stages = profiler.stages();
+    QCOMPARE(stage(stages, "uncounted")->allocations, (qint64) 0);
+    QCOMPARE(stage(stages, "counted")->allocations, (qint64) 5);
+}
+
+void ProfilerTests::threadsMerge() {
+
+    Profiler profiler;
+    recordFromThreads(profiler, 4, 250);
+    {
+        Profiler::Scope scope(profiler, "compress", "main");
+        scope.addBytes(2);
+    }
+
+    // every thread logs on its own, the totals add up once read
+    auto stages = profiler.stages();
+    QCOMPARE(stages.size(), (size_t) 1);
+    QCOMPARE(stages[0].calls, (qint64) 1001);
+    QCOMPARE(stages[0].bytes, (qint64) 2002);
+    QCOMPARE(profiler.eventsCount(), (size_t) 1001);
+
+    // clear() empties the logs kept so far, later threads add their own
+    profiler.clear();
+    recordFromThreads(profiler, 2, 10);
+    QCOMPARE(profiler.stages()[0].calls, (qint64) 20);
+}
+
+void ProfilerTests::chromeTrace() {
+
+    Profiler profiler;
+    recordFromThreads(profiler, 2, 3);
+    {
+        Profiler::Scope scope(profiler, "save");
+    }
+
+    QJsonParseError error{};
+    auto trace = QJsonDocument::fromJson(profiler.chromeTrace(), &error);
+    QCOMPARE(error.error, QJsonParseError::NoError);
+    QCOMPARE(trace["displayTimeUnit"].toString(), QString("ms"));
+    QCOMPARE(trace["otherData"]["dropped_events"].toInt(-1), 0);
+
+    auto events = trace["traceEvents"].toArray();
+    QCOMPARE(events.size(), 7);
+
+    QSet<int> compress_threads;
+    int saves = 0;
+    for (const auto &value : events) {
+        auto event = value.toObject();
+        QCOMPARE(event["ph"].toString(), QString("X"));
+        QCOMPARE(event["cat"].toString(), QString("themedoc"));
+        QCOMPARE((qint64) event["pid"].toDouble(), QCoreApplication::applicationPid());
+        QVERIFY(event["ts"].toDouble(-1) >= 0);
+        QVERIFY(event["dur"].toDouble(-1) >= 0);
+
+        auto args = event["args"].toObject();
+        if (event["name"].toString() == "save") {
+            ++saves;
+            QVERIFY(!args.contains("detail"));
+            QCOMPARE(args["bytes"].toInt(-1), 0);
+        } else {
+            QCOMPARE(event["name"].toString(), QString("compress"));
+            QVERIFY(args["detail"].toString().startsWith("thread "));
+            QCOMPARE(args["bytes"].toInt(-1), 2);
+            compress_threads << event["tid"].toInt();
+        }
+    }
+    QCOMPARE(saves, 1);
+    QCOMPARE(compress_threads.size(), 2);
+}
+
+QTEST_GUILESS_MAIN(ProfilerTests)
+
+#include "ProfilerTests.moc"
@@ -0,0 +1,70 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "Progress.h"
+
+double sProgress::fraction() const {
+
+    if (total_bytes > 0) {
+        return std::min(1.0, (double) bytes / (double) total_bytes);
+    }
+    if (total > 0) {
+        return std::min(1.0, (double) done / total);
+    }
+    return -1;
+}
+
+double sProgress::bytesPerSecond() const {
+    return elapsed_ms > 0 ? (double) bytes * 1000 / (double) elapsed_ms : 0;
+}
+
+qint64 sProgress::etaMs() const {
+
+    // the first moments say nothing about the rate
+    auto part = fraction();
+    if (part <= 0 || elapsed_ms < 2 * ProgressMeter::intervalMs) {
+        return -1;
+    }
+    return (qint64) ((double) elapsed_ms * (1 - part) / part);
+}
+
+ProgressMeter::ProgressMeter(const char *stage, int total, qint64 total_bytes, Sink sink)
+        : m_stage(stage), m_total(total), m_totalBytes(total_bytes), m_sink(std::move(sink)) {
+
+    m_timer.start();
+    if (m_sink) {
+        m_sink(snapshot());
+    }
+}
+
+void ProgressMeter::advance(int items, qint64 bytes) {
+
+    const int done = m_done.fetch_add(items) + items;
+    m_bytes.fetch_add(bytes);
+    if (!m_sink) return;
+
+    if (items && done == m_total) {
+        m_sink(snapshot());
+        return;
+    }
+
+    // only the thread moving the deadline reports
+    auto now = m_timer.elapsed();
+    auto next = m_nextReportMs.load();
+    if (now >= next && m_nextReportMs.compare_exchange_strong(next, now + intervalMs)) {
+        m_sink(snapshot());
+    }
+}
+
+sProgress ProgressMeter::snapshot() const {
+
+    sProgress progress;
+    progress.stage = m_stage;
+    progress.done = m_done;
+    progress.total = m_total;
+    progress.bytes = m_bytes;
+    progress.total_bytes = m_totalBytes;
+    progress.elapsed_ms = m_timer.elapsed();
+    return progress;
+}
@@ -0,0 +1,62 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_PROGRESS_H
+#define FOCUSIPC_PROGRESS_H
+
+#include <QtCore>
+
+#include <atomic>
+#include <functional>
+
+/* snapshot of one stage of a long operation */
+struct sProgress {
+    const char *stage = "";  // unpack, export, quantise, compress, write...
+    int done = 0;
+    int total = 0;
+    qint64 bytes = 0;        // processed by the stage so far
+    qint64 total_bytes = 0;  // 0 if unknown, the estimates go by items then
+    qint64 elapsed_ms = 0;   // since the stage started
+
+    /* 0..1 or -1 if there's nothing to measure */
+    [[nodiscard]] double fraction() const;
+    [[nodiscard]] double bytesPerSecond() const;
+    /* remaining time at the current rate, -1 until it can be estimated */
+    [[nodiscard]] qint64 etaMs() const;
+};
+
+Q_DECLARE_METATYPE(sProgress)
+
+/*
+ * Counts items and bytes of one stage, advanced from any thread.
+ * Snapshots go to the sink when the stage starts, at most every
+ * intervalMs while it runs and when the last item is done, so busy
+ * loops don't flood the GUI with signals.
+ */
+class ProgressMeter {
+
+public:
+    using Sink = std::function<void(const sProgress &progress)>;
+
+    static constexpr qint64 intervalMs = 100;
+
+    ProgressMeter(const char *stage, int total, qint64 total_bytes, Sink sink);
+    ProgressMeter(const ProgressMeter &) = delete;
+    ProgressMeter &operator=(const ProgressMeter &) = delete;
+
+    void advance(int items, qint64 bytes = 0);
+    [[nodiscard]] sProgress snapshot() const;
+
+private:
+    const char *m_stage;
+    const int m_total;
+    const qint64 m_totalBytes;
+    Sink m_sink;
+    QElapsedTimer m_timer;
+    std::atomic<int> m_done{0};
+    std::atomic<qint64> m_bytes{0};
+    std::atomic<qint64> m_nextReportMs{intervalMs};
+};
+
+#endif //FOCUSIPC_PROGRESS_H
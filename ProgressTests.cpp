@@ -0,0 +1,79 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include <QtTest>
+
+#include "Progress.h"
+
+/*
+ * Progress reports of ProgressMeter and the estimates made from them.
+ */
+class ProgressTests : public QObject {
+
+    Q_OBJECT
+
+private slots:
+    void meterReports();
+    void estimates();
+};
+
+void ProgressTests::meterReports() {
+
+    QList<sProgress> reports;
+    ProgressMeter meter("export", 3, 0, [&reports](const sProgress &progress) { reports << progress; });
+    QCOMPARE(reports.size(), 1);
+    QCOMPARE(reports[0].stage, "export");
+    QCOMPARE(reports[0].done, 0);
+
+    // no report until the interval passes, the last item is reported at once
+    meter.advance(1, 100);
+    QCOMPARE(reports.size(), 1);
+    QTest::qWait((int) ProgressMeter::intervalMs + 20);
+    meter.advance(1, 100);
+    QCOMPARE(reports.size(), 2);
+    QCOMPARE(reports[1].done, 2);
+    meter.advance(1, 100);
+    QCOMPARE(reports.size(), 3);
+    QCOMPARE(reports[2].done, 3);
+    QCOMPARE(reports[2].bytes, (qint64) 300);
+    QCOMPARE(meter.snapshot().fraction(), 1.0);
+
+    // bytes are counted from every thread
+    ProgressMeter shared("compress", 4000, 0, {});
+    QThreadPool pool;
+    for (int i = 0; i < 4; ++i) {
+        pool.start([&shared]() {
+            for (int j = 0; j < 1000; ++j) shared.advance(1, 2);
+        });
+    }
+    pool.waitForDone();
+    QCOMPARE(shared.snapshot().done, 4000);
+    QCOMPARE(shared.snapshot().bytes, (qint64) 8000);
+}
+
+void ProgressTests::estimates() {
+
+    sProgress progress;
+    QCOMPARE(progress.fraction(), -1.0);
+    QCOMPARE(progress.etaMs(), (qint64) -1);
+
+    // bytes go before items once the total is known
+    progress.done = 1;
+    progress.total = 4;
+    QCOMPARE(progress.fraction(), 0.25);
+    progress.bytes = 512;
+    progress.total_bytes = 1024;
+    QCOMPARE(progress.fraction(), 0.5);
+
+    // the first moments say nothing about the rate
+    progress.elapsed_ms = ProgressMeter::intervalMs;
+    QCOMPARE(progress.etaMs(), (qint64) -1);
+    progress.elapsed_ms = 1000;
+    QCOMPARE(progress.etaMs(), (qint64) 1000);
+    QCOMPARE(progress.bytesPerSecond(), 512.0);
+}
+
+QTEST_GUILESS_MAIN(ProgressTests)
+
+#include "ProgressTests.moc"
@@ -0,0 +1,522 @@
+//
+// Created by user on 17.10.2026.
+//
+
+/*
+ * Pipeline benchmark on synthetic VBFs.
+ *
+ *   themebench generate <seed.vbf> <out.vbf> [--images N] [--mix 1:2:1] [--group-size K] [--seed S]
+ *   themebench run <vbf>... [--repeat R] [--compression fast|default|max] [--json <file>]
+ *
+ * generate rewrites pictures of a real theme with synthetic bitmaps of the chosen
+ * type mix, multicolor ones are bonded into shared palette groups of the given size.
+ * run times every stage of unpack/decode/remap/pack on one thread and prints
+ * the results as JSON, so two builds can be compared stage by stage. Palette
+ * groups are remapped by both mappers, FTools' and the median cut, and their
+ * mean colour errors are reported side by side.
+ */
+
+#include <QtCore>
+#include <QColor>
+
+#include <VbfFile.h>
+#include <ImageSection.h>
+#include <EifConverter.h>
+#include <CRC.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "ColorMetrics.h"
+#include "EifZip.h"
+#include "PaletteQuantiser.h"
+#include "Profiler.h"
+
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+// Allocations are counted by the binaries, as in main.cpp: replacing the global operator new
+// in the library would swap the allocator of every binary that links it.
+// A plain counter, operator new can't afford anything that allocates itself
+static thread_local quint64 t_allocations = 0;
+
+void *operator new(std::size_t size) {
+    ++t_allocations;
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+static quint64 threadAllocations() {
+    return t_allocations;
+}
+
+namespace {
+
+    struct sStage {
+        qint64 calls = 0;
+        qint64 allocations = 0;
+        vector<double> runs_ms; // total time of the stage in every repeat
+    };
+
+    /* stage timings in the order the stages first ran */
+    class StageTimer {
+
+    public:
+        template<class Function>
+        auto measure(const QString &stage, Function fn) {
+            QElapsedTimer timer;
+            timer.start();
+            struct sAccount {
+                StageTimer &owner;
+                const QString &stage;
+                QElapsedTimer &timer;
+                quint64 allocations;
+                ~sAccount() {
+                    owner.account(stage, (double) timer.nsecsElapsed() / 1e6, threadAllocations() - allocations);
+                }
+            } account{*this, stage, timer, threadAllocations()};
+            return fn();
+        }
+
+        void nextRun() { ++run; }
+
+        [[nodiscard]] QJsonObject toJson() const {
+            QJsonObject stages;
+            for (const auto &name : order) {
+                auto runs = this->stages[name].runs_ms;
+                runs.resize(run + 1);
+                sort(runs.begin(), runs.end());
+                stages[name] = QJsonObject{
+                        {"calls",     (double) this->stages[name].calls / (double) runs.size()},
+                        {"min_ms",    runs.front()},
+                        {"median_ms", runs[runs.size() / 2]},
+                        {"max_ms",    runs.back()},
+                        {"allocations", (double) this->stages[name].allocations / (double) runs.size()},
+                };
+            }
+            return stages;
+        }
+
+    private:
+        void account(const QString &stage, double ms, quint64 allocations) {
+            auto &entry = stages[stage];
+            if (0 == entry.calls) {
+                order << stage;
+            }
+            entry.calls++;
+            entry.allocations += (qint64) allocations;
+            entry.runs_ms.resize(run + 1);
+            entry.runs_ms[run] += ms;
+        }
+
+        int run = 0;
+        QStringList order;
+        QMap<QString, sStage> stages;
+    };
+
+    uint16_t paletteCrc(const vector<uint8_t> &eif) {
+        return CRC::Calculate((char *) eif.data() + 0x10, 768, CRC::CRC_16_CCITTFALSE());
+    }
+
+    unsigned compressionLevel(const QString &profile) {
+        if (profile == "fast") return MZ_BEST_SPEED;
+        if (profile == "max") return MZ_UBER_COMPRESSION;
+        if (profile == "default") return MZ_DEFAULT_LEVEL;
+        throw runtime_error("Unknown compression profile " + profile.toStdString());
+    }
+
+    /* 32 bit BGRA bottom-up BMP, the format openBmp takes for every EIF type */
+    void saveBmp32(const QString &path, const vector<uint8_t> &rgba, int width, int height) {
+
+        const uint32_t image_size = width * height * 4;
+        QByteArray bmp;
+        QDataStream out(&bmp, QIODevice::WriteOnly);
+        out.setByteOrder(QDataStream::LittleEndian);
+        out << (quint8) 'B' << (quint8) 'M' << (quint32) (14 + 40 + image_size) << (quint32) 0 << (quint32) (14 + 40);
+        out << (quint32) 40 << (qint32) width << (qint32) height << (quint16) 1 << (quint16) 32
+            << (quint32) 0 << image_size << (qint32) 2835 << (qint32) 2835 << (quint32) 0 << (quint32) 0;
+        for (int y = height - 1; y >= 0; --y) {
+            auto p = rgba.data() + (size_t) y * width * 4;
+            for (int x = 0; x < width; ++x, p += 4) {
+                out << p[2] << p[1] << p[0] << p[3];
+            }
+        }
+
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly) || file.write(bmp) != bmp.size()) {
+            throw runtime_error("Can't write " + path.toStdString());
+        }
+    }
+
+    /*
+     * Gradient with a few soft blobs and an anti-aliased border, close enough
+     * to real gauges and icons for the quantiser and deflate to do real work.
+     * Colours come from the palette, so members of one group share their colours.
+     */
+    vector<uint8_t> syntheticBitmap(int width, int height, const vector<QColor> &palette, bool grey, mt19937 &rng) {
+
+        uniform_int_distribution<int> pick(0, (int) palette.size() - 1);
+        uniform_real_distribution<double> unit(0, 1);
+
+        struct sBlob {
+            double x, y, r;
+            QColor color;
+        };
+        vector<sBlob> blobs(4);
+        for (auto &blob : blobs) {
+            blob = {unit(rng) * width, unit(rng) * height, (0.1 + 0.3 * unit(rng)) * max(width, height),
+                    palette[pick(rng)]};
+        }
+        auto top = palette[pick(rng)];
+        auto bottom = palette[pick(rng)];
+
+        vector<uint8_t> rgba((size_t) width * height * 4);
+        auto p = rgba.data();
+        for (int y = 0; y < height; ++y) {
+            double t = height > 1 ? (double) y / (height - 1) : 0;
+            for (int x = 0; x < width; ++x, p += 4) {
+                double c[3] = {top.red() * (1 - t) + bottom.red() * t,
+                               top.green() * (1 - t) + bottom.green() * t,
+                               top.blue() * (1 - t) + bottom.blue() * t};
+                for (const auto &blob : blobs) {
+                    double d = hypot(x - blob.x, y - blob.y) / blob.r;
+                    double w = d < 1 ? (1 - d) * (1 - d) : 0;
+                    c[0] += (blob.color.red() - c[0]) * w;
+                    c[1] += (blob.color.green() - c[1]) * w;
+                    c[2] += (blob.color.blue() - c[2]) * w;
+                }
+                double edge = min({x + 0.5, y + 0.5, width - x - 0.5, height - y - 0.5});
+                if (grey) {
+                    c[0] = c[1] = c[2] = 0.299 * c[0] + 0.587 * c[1] + 0.114 * c[2];
+                }
+                p[0] = (uint8_t) lround(c[0]);
+                p[1] = (uint8_t) lround(c[1]);
+                p[2] = (uint8_t) lround(c[2]);
+                p[3] = (uint8_t) lround(255 * clamp(edge / 3, 0.0, 1.0));
+            }
+        }
+        return rgba;
+    }
+
+    vector<QColor> syntheticPalette(mt19937 &rng) {
+        uniform_int_distribution<int> hue(0, 359);
+        uniform_int_distribution<int> level(64, 255);
+        vector<QColor> palette(8);
+        for (auto &color : palette) {
+            color = QColor::fromHsv(hue(rng), level(rng), level(rng));
+        }
+        return palette;
+    }
+
+    int generate(const QString &seed_path, const QString &out_path, int images, const vector<double> &mix,
+                 int group_size, unsigned seed) {
+
+        VbfFile vbf;
+        vbf.OpenFile(seed_path.toStdWString());
+
+        std::vector<uint8_t> img_sec_bin;
+        if (vbf.GetSectionRaw(1, img_sec_bin)) {
+            throw runtime_error("Can't get image section");
+        }
+        ImageSection section;
+        section.Parse(img_sec_bin);
+
+        QTemporaryDir tmp_dir;
+        if (!tmp_dir.isValid()) {
+            throw runtime_error("Can't create a temporary directory");
+        }
+
+        // ImageSection can't add items, so the seed sets the upper bound
+        const int items_count = section.GetItemsCount(ImageSection::RT_ZIP);
+        const int count = images < 0 ? items_count : min(images, items_count);
+
+        mt19937 rng(seed);
+        discrete_distribution<int> type_pick(mix.begin(), mix.end());
+        const uint8_t types[] = {EIF_TYPE_MONOCHROME, EIF_TYPE_MULTICOLOR, EIF_TYPE_SUPERCOLOR};
+
+        struct sItem {
+            int index;
+            string name;
+            uint8_t type;
+            vector<uint8_t> eif;
+        };
+        vector<sItem> items;
+        vector<EIF::EifImage16bit> group;
+        vector<int> group_items;
+        auto group_palette = syntheticPalette(rng);
+
+        auto flush_group = [&]() {
+            if (group.empty()) return;
+            EIF::EifConverter::mapMultiPalette(group);
+            for (size_t i = 0; i < group.size(); ++i) {
+                items[group_items[i]].eif = group[i].saveEifToVector();
+            }
+            group.clear();
+            group_items.clear();
+            group_palette = syntheticPalette(rng);
+        };
+
+        for (int i = 0; i < count; ++i) {
+            vector<uint8_t> zip;
+            section.GetItemData(ImageSection::RT_ZIP, i, zip);
+            std::string name;
+            auto head = EifZip::peek(zip, &name);
+            auto header = reinterpret_cast<const EIF::EifBaseHeader *>(head.data());
+
+            auto &item = items.emplace_back(sItem{i, name, types[type_pick(rng)]});
+            auto bmp_path = QDir(tmp_dir.path()).absoluteFilePath(QString("%1.bmp").arg(i));
+            bool multicolor = item.type == EIF_TYPE_MULTICOLOR;
+            auto palette = multicolor ? group_palette : syntheticPalette(rng);
+            saveBmp32(bmp_path, syntheticBitmap(header->width, header->height, palette,
+                                                item.type == EIF_TYPE_MONOCHROME, rng),
+                      header->width, header->height);
+
+            if (multicolor) {
+                group.emplace_back().openBmp(bmp_path.toStdWString());
+                group_items.push_back((int) items.size() - 1);
+                if ((int) group.size() == group_size) {
+                    flush_group();
+                }
+            } else {
+                auto eif = EIF::EifConverter::makeEif(static_cast<EIF::EIF_TYPE>(item.type));
+                eif->openBmp(bmp_path.toStdWString());
+                item.eif = eif->saveEifToVector();
+            }
+            QFile::remove(bmp_path);
+        }
+        flush_group();
+
+        int stats[3] = {};
+        for (auto &item : items) {
+            auto zip = EifZip::compress(item.eif, item.name);
+            auto header = reinterpret_cast<const EIF::EifBaseHeader *>(item.eif.data());
+            section.ReplaceItem(ImageSection::RT_ZIP, item.index, zip, header->width, header->height, header->type);
+            stats[find(begin(types), end(types), item.type) - begin(types)]++;
+        }
+
+        img_sec_bin.clear();
+        section.SaveToVector(img_sec_bin);
+        vbf.ReplaceSectionRaw(1, img_sec_bin);
+        vbf.SaveToFile(out_path.toStdWString());
+
+        qInfo().noquote() << QString("%1: %2 of %3 images synthesised, %4 monochrome, %5 multicolor, %6 supercolor")
+                .arg(out_path).arg(items.size()).arg(items_count).arg(stats[0]).arg(stats[1]).arg(stats[2]);
+        return 0;
+    }
+
+    QJsonObject benchmark(const QString &path, int repeat, unsigned level) {
+
+        QTemporaryDir tmp_dir;
+        if (!tmp_dir.isValid()) {
+            throw runtime_error("Can't create a temporary directory");
+        }
+        auto out_path = QDir(tmp_dir.path()).absoluteFilePath(QFileInfo(path).fileName());
+
+        StageTimer timer;
+        int images = 0;
+        int types[3] = {};
+        int groups = 0;
+        ColorMetrics::sDeltaE ftools_delta_e, median_cut_delta_e;
+        int median_cut_fallbacks = 0;
+        QThreadPool single_thread;
+        single_thread.setMaxThreadCount(1);
+
+        for (int run = 0; run < repeat; ++run) {
+
+            VbfFile vbf;
+            timer.measure("OpenFile", [&] { vbf.OpenFile(path.toStdWString()); });
+
+            std::vector<uint8_t> img_sec_bin;
+            if (timer.measure("GetSectionRaw", [&] { return vbf.GetSectionRaw(1, img_sec_bin); })) {
+                throw runtime_error("Can't get image section");
+            }
+
+            ImageSection section;
+            timer.measure("ImageSection::Parse", [&] { section.Parse(img_sec_bin); });
+
+            images = section.GetItemsCount(ImageSection::RT_ZIP);
+            fill(begin(types), end(types), 0);
+            std::map<uint16_t, vector<EIF::EifImage16bit>> palette_groups;
+            std::map<uint16_t, vector<int>> palette_items;
+            vector<vector<uint8_t>> eifs(images);
+            vector<string> names(images);
+
+            for (int i = 0; i < images; ++i) {
+                vector<uint8_t> zip;
+                timer.measure("GetItemData", [&] { section.GetItemData(ImageSection::RT_ZIP, i, zip); });
+                auto &eif_data = eifs[i];
+                eif_data = timer.measure("unzipEIF", [&] { return EifZip::unzip(zip, &names[i]); });
+
+                auto type = eif_data[7];
+                if (type == EIF_TYPE_MULTICOLOR) {
+                    auto crc = paletteCrc(eif_data);
+                    auto &eif = palette_groups[crc].emplace_back();
+                    palette_items[crc].push_back(i);
+                    timer.measure("openEif", [&] { eif.openEif(eif_data); });
+                    timer.measure("getBitmapRBGA", [&] { return eif.getBitmapRBGA(); });
+                    types[1]++;
+                } else {
+                    auto eif = EIF::EifConverter::makeEif(static_cast<EIF::EIF_TYPE>(type));
+                    timer.measure("openEif", [&] { eif->openEif(eif_data); });
+                    timer.measure("getBitmapRBGA", [&] { return eif->getBitmapRBGA(); });
+                    types[type == EIF_TYPE_MONOCHROME ? 0 : 2]++;
+                }
+            }
+
+            // remap every group as if one of its pictures was replaced, the median cut
+            // goes first as it only reads the EIFs FTools then remaps in place
+            groups = (int) palette_groups.size();
+            ftools_delta_e = median_cut_delta_e = {};
+            median_cut_fallbacks = 0;
+            for (auto &[crc, set] : palette_groups) {
+                vector<vector<uint8_t>> bitmaps;
+                vector<const vector<uint8_t> *> bitmap_ptrs;
+                for (auto &eif : set) {
+                    bitmaps.push_back(eif.getBitmapRBGA());
+                }
+                for (const auto &bitmap : bitmaps) {
+                    bitmap_ptrs.push_back(&bitmap);
+                }
+
+                auto palette = timer.measure("PaletteQuantiser::quantise", [&] {
+                    return PaletteQuantiser::quantise(bitmap_ptrs, single_thread);
+                });
+                for (size_t i = 0; i < set.size(); ++i) {
+                    auto applied = timer.measure("PaletteQuantiser::applyToEif", [&] {
+                        return PaletteQuantiser::applyToEif(eifs[palette_items[crc][i]], bitmaps[i], palette, i);
+                    });
+                    if (!applied) {
+                        median_cut_fallbacks++;
+                        break;
+                    }
+                    median_cut_delta_e += ColorMetrics::deltaE(bitmaps[i], applied->rgba);
+                }
+
+                timer.measure("mapMultiPalette", [&] { EIF::EifConverter::mapMultiPalette(set); });
+                for (size_t i = 0; i < set.size(); ++i) {
+                    ftools_delta_e += ColorMetrics::deltaE(bitmaps[i], set[i].getBitmapRBGA());
+                    eifs[palette_items[crc][i]] = set[i].saveEifToVector();
+                }
+            }
+
+            for (int i = 0; i < images; ++i) {
+                auto zip = timer.measure("compressVector", [&] { return EifZip::compress(eifs[i], names[i], level); });
+                auto header = reinterpret_cast<const EIF::EifBaseHeader *>(eifs[i].data());
+                timer.measure("ReplaceItem", [&] {
+                    section.ReplaceItem(ImageSection::RT_ZIP, i, zip, header->width, header->height, header->type);
+                });
+            }
+
+            img_sec_bin.clear();
+            timer.measure("SaveToVector", [&] { section.SaveToVector(img_sec_bin); });
+            timer.measure("ReplaceSectionRaw", [&] { vbf.ReplaceSectionRaw(1, img_sec_bin); });
+            timer.measure("SaveToFile", [&] { vbf.SaveToFile(out_path.toStdWString()); });
+
+            if (run + 1 < repeat) {
+                timer.nextRun();
+            }
+        }
+
+        return QJsonObject{
+                {"file",           QFileInfo(path).fileName()},
+                {"bytes",          QFileInfo(path).size()},
+                {"images",         images},
+                {"monochrome",     types[0]},
+                {"multicolor",     types[1]},
+                {"supercolor",     types[2]},
+                {"palette_groups", groups},
+                {"palette_delta_e", QJsonObject{
+                        {"ftools",               ftools_delta_e.mean()},
+                        {"median_cut",           median_cut_delta_e.mean()},
+                        {"median_cut_fallbacks", median_cut_fallbacks},
+                }},
+                {"repeat",         repeat},
+                {"stages",         timer.toJson()},
+        };
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("themebench");
+    Profiler::setAllocationCounter(&threadAllocations);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Ford focus mk 3.* IPC theme editor, pipeline benchmark");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"images", "Synthesise first <count> images of the seed, all by default.", "count"},
+        {"mix", "Weights of monochrome:multicolor:supercolor images.", "weights", "1:2:1"},
+        {"group-size", "Multicolor images sharing one palette.", "count", "4"},
+        {"seed", "Random seed.", "seed", "1"},
+        {{"r", "repeat"}, "Times every VBF is processed.", "count", "5"},
+        {{"c", "compression"}, "Compression profile: fast, default or max.", "profile", "default"},
+        {"json", "Write the results to <file> instead of stdout.", "file"},
+    });
+    parser.addPositionalArgument("command", "generate <seed.vbf> <out.vbf> | run <vbf>...");
+    parser.process(app);
+
+    QTextStream err(stderr);
+    auto args = parser.positionalArguments();
+    auto command = args.isEmpty() ? QString() : args.takeFirst();
+
+    try {
+        if (command == "generate" && args.size() == 2) {
+            vector<double> mix;
+            for (const auto &weight : parser.value("mix").split(':')) {
+                mix.push_back(weight.toDouble());
+            }
+            if (mix.size() != 3) {
+                err << "Mix needs three weights" << '\n';
+                return 1;
+            }
+            return generate(args[0], args[1], parser.isSet("images") ? parser.value("images").toInt() : -1, mix,
+                            max(1, parser.value("group-size").toInt()), parser.value("seed").toUInt());
+        }
+
+        if (command == "run" && !args.isEmpty()) {
+            const auto repeat = max(1, parser.value("repeat").toInt());
+            const auto level = compressionLevel(parser.value("compression"));
+
+            QJsonArray results;
+            for (const auto &path : args) {
+                results.append(benchmark(path, repeat, level));
+            }
+            QJsonObject report{
+                    {"compression", parser.value("compression")},
+                    {"threads",     1},
+                    {"results",     results},
+            };
+
+            auto json = QJsonDocument(report).toJson();
+            if (parser.isSet("json")) {
+                QFile file(parser.value("json"));
+                if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+                    throw runtime_error("Can't write " + parser.value("json").toStdString());
+                }
+            } else {
+                QTextStream(stdout) << json;
+            }
+            return 0;
+        }
+    } catch (const std::runtime_error &ex) {
+        err << ex.what() << '\n';
+        return 2;
+    }
+
+    parser.showHelp(1);
+}
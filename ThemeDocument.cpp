@@ -0,0 +1,1805 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "ThemeDocument.h"
+#include "ColorMetrics.h"
+#include "EifZip.h"
+#include "PaletteQuantiser.h"
+#include "PixelConvert.h"
+#include "ThemePatch.h"
+#include "VbfWriter.h"
+
+#include <CRC.h>
+
+#include <cctype>
+#include <optional>
+#include <cstring>
+#include <set>
+#include <tuple>
+
+namespace fs = std::filesystem;
+
+static std::string toLower(std::string str) {
+    std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return (char) std::tolower(c); });
+    return str;
+}
+
+/*
+ * openBmp() doesn't tell a broken file from a BMP, so only the header it reads is checked
+ * here for a clear error. Any depth it converts is taken.
+ */
+static void checkBmp(const QString &path) {
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw runtime_error("can't read the BMP: " + file.errorString().toStdString());
+    }
+    const auto head = file.read(54);
+    if (head.size() < 54 || head[0] != 'B' || head[1] != 'M') {
+        throw runtime_error("not a BMP file");
+    }
+    uint32_t pixels_pos = 0;
+    for (int i = 3; i >= 0; --i) {
+        pixels_pos = pixels_pos << 8 | (uint8_t) head[10 + i];
+    }
+    if (pixels_pos < 54 || pixels_pos >= (uint64_t) file.size()) {
+        throw runtime_error("broken BMP");
+    }
+}
+
+ThemeDocument::ThemeDocument(QObject *parent) : QObject(parent) {
+    qRegisterMetaType<sProgress>();
+}
+
+void ThemeDocument::setMaxThreads(int threads) {
+    pool.setMaxThreadCount(std::max(1, threads));
+}
+
+void ThemeDocument::setProgressCallback(ProgressCallback callback) {
+    QWriteLocker locker(&lock);
+    progressCallback = std::move(callback);
+}
+
+void ThemeDocument::reportProgress(const sProgress &progress) {
+
+    progressChanged(progress);
+    if (auto job = JobContext::current()) {
+        job->setProgress(progress);
+    }
+    if (progressCallback) {
+        progressCallback(progress);
+    }
+}
+
+ProgressMeter ThemeDocument::progressMeter(const char *stage, int total, qint64 total_bytes) {
+    return {stage, total, total_bytes, [this](const sProgress &progress) { reportProgress(progress); }};
+}
+
+void ThemeDocument::parallelFor(int count, const std::function<void(int)> &fn) {
+    JobScheduler::parallelFor(pool, count, fn);
+}
+
+ThemeDocument::sPictureInfo ThemeDocument::toInfo(const sPictureIPC &picture) {
+    return {picture.index, picture.name, picture.palette_crc, picture.type,
+            picture.width, picture.height, picture.changed, picture.duplicate_of};
+}
+
+bool ThemeDocument::isOpen() const {
+    QReadLocker locker(&lock);
+    return vbfMap.isOpen();
+}
+
+QString ThemeDocument::path() const {
+    QReadLocker locker(&lock);
+    return docPath;
+}
+
+std::vector<ThemeDocument::sPictureInfo> ThemeDocument::pictureList() const {
+
+    QReadLocker locker(&lock);
+    std::vector<sPictureInfo> list;
+    list.reserve(images.size());
+    for (const auto &it : images) {
+        list.push_back(toInfo(it.second));
+    }
+    return list;
+}
+
+std::optional<ThemeDocument::sPictureInfo> ThemeDocument::pictureInfo(int picture_idx) const {
+
+    QReadLocker locker(&lock);
+    auto it = images.find(picture_idx);
+    if (it == images.end()) {
+        return std::nullopt;
+    }
+    return toInfo(it->second);
+}
+
+std::map<int, QString> ThemeDocument::pictureHashes() {
+
+    QReadLocker locker(&lock);
+
+    std::vector<const sPictureIPC *> pictures;
+    qint64 total_bytes = 0;
+    for (const auto &it : images) {
+        pictures.push_back(&it.second);
+        total_bytes += (qint64) it.second.zip.size();
+    }
+
+    std::vector<QString> hashes(pictures.size());
+    auto progress = progressMeter("hash", (int) pictures.size(), total_bytes);
+    parallelFor((int) pictures.size(), [&](int i) {
+        hashes[i] = DecodeCache::key(pictures[i]->zip);
+        progress.advance(1, (qint64) pictures[i]->zip.size());
+    });
+
+    std::map<int, QString> by_index;
+    for (size_t i = 0; i < pictures.size(); ++i) {
+        by_index.emplace(pictures[i]->index, std::move(hashes[i]));
+    }
+    return by_index;
+}
+
+std::vector<uint8_t> ThemeDocument::zippedPicture(int picture_idx) const {
+
+    QReadLocker locker(&lock);
+    const auto &picture = images.at(picture_idx);
+    if (picture.eif) {
+        throw runtime_error(picture.name + " is replaced, save it first");
+    }
+    return {picture.zip.begin(), picture.zip.end()};
+}
+
+QImage ThemeDocument::decodePicture(int picture_idx) const {
+
+    QReadLocker locker(&lock);
+    return decodeImage(images.at(picture_idx));
+}
+
+QImage ThemeDocument::decodeImage(const sPictureIPC &picture) const {
+
+    // replaced pictures aren't zipped yet, so only the section ones are cached
+    QString cache_key;
+    if (!picture.eif) {
+        cache_key = DecodeCache::key(picture.zip);
+        auto cached = decodeCache.load(cache_key);
+        if (!cached.isNull()) {
+            return cached;
+        }
+    }
+
+    unique_ptr<EIF::EifImageBase> decoded;
+    auto &eif = pictureEif(picture, decoded);
+    auto bitmap = eif.getBitmapRBGA();
+
+    auto image = PixelConvert::imageFromRgba(bitmap, eif.getWidth(), eif.getHeight());
+    if (!cache_key.isEmpty()) {
+        decodeCache.store(cache_key, image);
+    }
+    return image;
+}
+
+void ThemeDocument::setDecodeCacheEnabled(bool enabled) {
+    decodeCache.setEnabled(enabled);
+}
+
+ThemeDocument::sDuplicatesStats ThemeDocument::findDuplicates() {
+
+    try {
+        return groupDuplicates();
+    } catch (const std::runtime_error& ex) {
+        sDuplicatesStats stats;
+        stats.error = ex.what();
+        return stats;
+    }
+}
+
+ThemeDocument::sDuplicatesStats ThemeDocument::groupDuplicates() {
+
+    // same pixels in another EIF type aren't a copy, a replacement has to be made for each type
+    struct sKey {
+        uint64_t hash;
+        uint8_t type;
+        int width;
+        int height;
+        bool operator<(const sKey &other) const {
+            return std::tie(hash, type, width, height) < std::tie(other.hash, other.type, other.width, other.height);
+        }
+    };
+
+    std::vector<sKey> keys;
+    quint64 generation;
+    {
+        QReadLocker locker(&lock);
+        Profiler::Scope scope(stageProfiler, "dedup");
+        generation = picturesGeneration;
+
+        std::vector<const sPictureIPC *> pictures;
+        for (const auto &it : images) {
+            pictures.push_back(&it.second);
+        }
+        const int pics_count = (int) pictures.size();
+        keys.resize(pics_count);
+        std::vector<std::string> errors(pics_count);
+
+        // premultiplied pixels, so differently coloured transparent areas still match
+        static const CRC::Table<crcpp_uint64, 64> table(CRC::CRC_64());
+        qint64 total_bytes = 0;
+        for (auto picture : pictures) {
+            total_bytes += (qint64) picture->zip.size();
+        }
+        auto progress = progressMeter("dedup", pics_count, total_bytes);
+        parallelFor(pics_count, [&](int i) {
+            try {
+                auto image = decodeImage(*pictures[i]);
+                keys[i] = {CRC::Calculate(image.constBits(), (size_t) image.sizeInBytes(), table),
+                           pictures[i]->type, image.width(), image.height()};
+            } catch (const std::runtime_error &ex) {
+                errors[i] = pictures[i]->name + ": " + ex.what();
+            }
+            progress.advance(1, (qint64) pictures[i]->zip.size());
+        });
+
+        for (auto &error : errors) {
+            if (!error.empty()) {
+                throw runtime_error(error);
+            }
+        }
+    }
+
+    // the keys are of the pictures as they were read, an edit or another document in between makes them wrong
+    QWriteLocker locker(&lock);
+    if (generation != picturesGeneration) {
+        throw runtime_error("Document changed during the analysis");
+    }
+    sDuplicatesStats stats;
+    std::map<sKey, int> first_of;
+    std::set<int> groups;
+    size_t pos = 0;
+    for (auto &[idx, picture] : images) {
+        auto [it, inserted] = first_of.emplace(keys[pos++], idx);
+        picture.duplicate_of = inserted ? -1 : it->second;
+        if (!inserted) {
+            groups.insert(it->second);
+            stats.duplicates++;
+            stats.bytes += (qint64) picture.width * picture.height * 4;
+        }
+    }
+    stats.groups = (int) groups.size();
+
+    return stats;
+}
+
+std::vector<int> ThemeDocument::duplicatesOf(int picture_idx) const {
+
+    QReadLocker locker(&lock);
+    auto it = images.find(picture_idx);
+    if (it == images.end()) {
+        return {};
+    }
+
+    const int first = it->second.duplicate_of >= 0 ? it->second.duplicate_of : picture_idx;
+    std::vector<int> group;
+    for (const auto &[idx, picture] : images) {
+        if (idx == first || picture.duplicate_of == first) {
+            group.push_back(idx);
+        }
+    }
+    return group;
+}
+
+void ThemeDocument::detachDuplicate(int picture_idx) {
+
+    auto &picture = images.at(picture_idx);
+    if (picture.duplicate_of >= 0) {
+        picture.duplicate_of = -1;
+        return;
+    }
+
+    // the first copy leaves, the next one leads the rest
+    int next = -1;
+    for (auto &[idx, other] : images) {
+        if (other.duplicate_of != picture_idx) continue;
+        if (next < 0) {
+            next = idx;
+            other.duplicate_of = -1;
+        } else {
+            other.duplicate_of = next;
+        }
+    }
+}
+
+void ThemeDocument::exportPicture(int picture_idx, const QString &path) const {
+
+    QReadLocker locker(&lock);
+    unique_ptr<EIF::EifImageBase> decoded;
+    pictureEif(images.at(picture_idx), decoded).saveBmp(path.toStdWString());
+}
+
+vector<ImageSection::HeaderRecord> ThemeDocument::getHeaderLines() const {
+    QReadLocker locker(&lock);
+    return headerLines;
+}
+
+QString ThemeDocument::setHeaderLines(const vector<ImageSection::HeaderRecord> &lines, const QString &title) {
+
+    QWriteLocker locker(&lock);
+    if (lines.size() != headerLines.size()) {
+        return QString("%1 header rows given, the theme has %2").arg(lines.size()).arg(headerLines.size());
+    }
+
+    // the history keeps only the rows that changed
+    std::vector<ThemeProject::sRowChange> rows;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        if (!ThemePatch::sameRecord(headerLines[i], lines[i])) {
+            rows.push_back({(int) i, headerLines[i], lines[i]});
+        }
+    }
+    if (!rows.empty()) {
+        recordEdit(title, {}, false, std::move(rows));
+    }
+    return "";
+}
+
+void ThemeDocument::setCompressionProfile(enCompressionProfile profile) {
+    QWriteLocker locker(&lock);
+    compressionProfile = profile;
+}
+
+void ThemeDocument::setVerifyCompression(bool verify) {
+    QWriteLocker locker(&lock);
+    verifyCompression = verify;
+}
+
+void ThemeDocument::setPaletteMapper(enPaletteMapper mapper) {
+    QWriteLocker locker(&lock);
+    paletteMapper = mapper;
+}
+
+std::vector<int> ThemeDocument::repacked() const {
+    QReadLocker locker(&lock);
+    return repackedIndexes;
+}
+
+ThemeDocument::sPackStats ThemeDocument::lastPackStats() const {
+    QReadLocker locker(&lock);
+    return packStats;
+}
+
+unique_ptr<EIF::EifImageBase> ThemeDocument::decodeEif(const sPictureIPC &picture) {
+
+    auto eif_data = EifZip::unzip(picture.zip);
+    auto eif = EIF::EifConverter::makeEif(static_cast<EIF::EIF_TYPE>(eif_data[7]));
+    eif->openEif(eif_data);
+
+    return eif;
+}
+
+EIF::EifImageBase &ThemeDocument::pictureEif(const sPictureIPC &picture, unique_ptr<EIF::EifImageBase> &decoded) {
+
+    // replaced picture keeps its own eif, others are decoded from the section
+    if (picture.eif) {
+        return *picture.eif;
+    }
+
+    decoded = decodeEif(picture);
+    return *decoded;
+}
+
+EIF::EifImageBase &ThemeDocument::decodedEif(const sPictureIPC &picture, unique_ptr<EIF::EifImageBase> &decoded) {
+
+    Profiler::Scope scope(stageProfiler, "decode", picture.name);
+    scope.addBytes((qint64) picture.zip.size());
+    return pictureEif(picture, decoded);
+}
+
+void ThemeDocument::detachPictures() {
+
+    // move zipped pictures out of the mapping, so the file can be overwritten
+    for (auto &it : images) {
+        auto &picture = it.second;
+        if (picture.zip_owned.empty()) {
+            picture.zip_owned.assign(picture.section_zip.begin(), picture.section_zip.end());
+            picture.section_zip = picture.zip_owned;
+            if (!picture.zip_patched) {
+                picture.zip = picture.section_zip;
+            }
+        }
+    }
+    vbfMap.close();
+}
+
+void ThemeDocument::attachPictures(const QString &path, ImageSection &section) {
+
+    detachPictures();
+    vbfMap.open(path);
+
+    // point pictures back into the mapping and free own copies
+    auto zip_items = locateItems(section, vbfMap.section(1));
+    if (zip_items.size() != images.size()) return;
+
+    for (auto &it : images) {
+        auto &picture = it.second;
+        picture.section_zip = zip_items[it.first];
+        if (!picture.zip_patched) {
+            picture.zip = picture.section_zip;
+        }
+        picture.zip_owned.clear();
+        picture.zip_owned.shrink_to_fit();
+    }
+}
+
+unique_ptr<ImageSection> ThemeDocument::parseSection() {
+
+    auto img_sec_map = vbfMap.section(1);
+    auto section = std::make_unique<ImageSection>();
+    Profiler::Scope scope(stageProfiler, "parse");
+    scope.addBytes((qint64) img_sec_map.size());
+    {
+        // Parse() takes only a vector, the copy lives as long as this call
+        std::vector<uint8_t> img_sec_bin(img_sec_map.begin(), img_sec_map.end());
+        section->Parse(img_sec_bin);
+    }
+    return section;
+}
+
+std::vector<std::span<const uint8_t>> ThemeDocument::locateItems(ImageSection &section,
+                                                                  std::span<const uint8_t> mapped) {
+
+    // zips are found by their signatures, every one has to be the item of the table at its position
+    auto zip_items = VbfMap::findZipItems(mapped);
+    const int count = section.GetItemsCount(ImageSection::RT_ZIP);
+    if ((int) zip_items.size() != count) {
+        return {};
+    }
+    std::vector<uint8_t> item;
+    for (int i = 0; i < count; ++i) {
+        section.GetItemData(ImageSection::RT_ZIP, i, item);
+        if (item.size() != zip_items[i].size() || !std::equal(item.begin(), item.end(), zip_items[i].begin())) {
+            return {};
+        }
+    }
+    return zip_items;
+}
+
+std::optional<ThemeProject::sIndex> ThemeDocument::baseIndex() const {
+
+    if (!vbfMap.isOpen()) {
+        return std::nullopt;
+    }
+
+    const auto section = vbfMap.section(1);
+    const auto section_begin = (uintptr_t) section.data();
+    ThemeProject::sIndex index;
+    index.rows = baseLines;
+    for (const auto &[idx, picture] : images) {
+        // copied items of the fallback unpack can't be found by offset
+        const auto zip_begin = (uintptr_t) picture.section_zip.data();
+        if (zip_begin < section_begin || zip_begin + picture.section_zip.size() > section_begin + section.size()) {
+            return std::nullopt;
+        }
+        index.items.push_back({picture.name, picture.type, picture.width, picture.height,
+                               picture.section_palette_crc, (qint64) (zip_begin - section_begin),
+                               (qint64) picture.section_zip.size()});
+    }
+    return index;
+}
+
+bool ThemeDocument::unpackIndexed(const ThemeProject::sIndex &index) {
+
+    Profiler::Scope scope(stageProfiler, "index");
+    const auto section = vbfMap.section(1);
+    std::map<int, sPictureIPC> pictures;
+    for (size_t i = 0; i < index.items.size(); ++i) {
+        const auto &item = index.items[i];
+        if (item.offset < 0 || item.size < 4 || item.offset + item.size > (qint64) section.size()) {
+            return false;
+        }
+        auto zip = section.subspan(item.offset, item.size);
+        if (zip[0] != 'P' || zip[1] != 'K' || zip[2] != 3 || zip[3] != 4) {
+            return false;
+        }
+
+        auto &picture = pictures[(int) i];
+        picture.index = (int) i;
+        picture.name = item.name;
+        picture.type = item.type;
+        picture.width = item.width;
+        picture.height = item.height;
+        picture.palette_crc = picture.section_palette_crc = item.palette_crc;
+        picture.zip = picture.section_zip = zip;
+    }
+
+    // the section is parsed only if it's saved
+    images = std::move(pictures);
+    headerLines = baseLines = index.rows;
+    return true;
+}
+
+void ThemeDocument::clearDocument() {
+
+    images.clear();
+    picturesGeneration++;
+    headerLines.clear();
+    baseLines.clear();
+    repackedIndexes.clear();
+    project.close();
+    vbfMap.close();
+    vbfRewritable = false;
+    docPath.clear();
+}
+
+void ThemeDocument::checkRewritable() {
+
+    // once per opened file, a save through VbfWriter keeps its checksums reproducible
+    Profiler::Scope scope(stageProfiler, "checksum");
+    scope.addBytes((qint64) vbfMap.binary().size());
+    vbfRewritable = VbfWriter::canRewrite(vbfMap);
+}
+
+QString ThemeDocument::unpackVBF(const QString &path) {
+
+    QWriteLocker locker(&lock);
+    images.clear();
+    picturesGeneration++;
+    Profiler::Scope unpack_scope(stageProfiler, "unpack", QFileInfo(path).fileName().toStdString());
+
+    try {
+        unpackBase(path);
+        project.start(ThemeProject::sBase::of(vbfMap));
+    } catch (const std::runtime_error& ex) {
+        // the previous document is gone already, don't leave a half opened one
+        clearDocument();
+        return ex.what();
+    }
+
+    return "";
+}
+
+void ThemeDocument::unpackBase(const QString &path) {
+
+    std::span<const uint8_t> img_sec_map;
+    {
+        Profiler::Scope scope(stageProfiler, "map");
+        vbfMap.open(path);
+        img_sec_map = vbfMap.section(1);
+        scope.addBytes((qint64) img_sec_map.size());
+    }
+    checkRewritable();
+
+    /* parse images section, it's only kept while the pictures are found in it */
+    auto parsed = parseSection();
+    auto &section = *parsed;
+
+    /* extract header lines */
+    headerLines = baseLines = section.getHeaderData();
+
+    /* extract images */
+    int zipped_items = section.GetItemsCount(ImageSection::RT_ZIP);
+
+    std::vector<sPictureIPC> pictures(zipped_items);
+    std::vector<std::string> errors(zipped_items);
+
+    // point zipped EIFs right into the mapped section.
+    // ImageSection hands out items only as copies, so if the zips can't be
+    // matched to its items in the section order fall back to copying them
+    auto zip_items = locateItems(section, img_sec_map);
+    qint64 total_bytes = 0;
+    for(int i = 0; i < zipped_items; i++) {
+        if (!zip_items.empty()) {
+            pictures[i].section_zip = zip_items[i];
+        } else {
+            section.GetItemData(ImageSection::RT_ZIP, i, pictures[i].zip_owned);
+            pictures[i].section_zip = pictures[i].zip_owned;
+        }
+        pictures[i].zip = pictures[i].section_zip;
+        pictures[i].index = i;
+        total_bytes += (qint64) pictures[i].zip.size();
+    }
+
+    // read names from the zip directory and inflate only EIF headers,
+    // pictures are decoded later when they are needed
+    auto progress = progressMeter("unpack", zipped_items, total_bytes);
+    parallelForEach(pictures, [this, &progress, &errors](sPictureIPC &picture) {
+
+        Profiler::Scope scope(stageProfiler, "peek");
+        scope.addBytes((qint64) picture.zip.size());
+        try {
+            std::string eif_name;
+            auto eif_head = EifZip::peek(picture.zip, &eif_name);
+            scope.setDetail(eif_name);
+            auto eif_header_p = reinterpret_cast<const EIF::EifBaseHeader*>(eif_head.data());
+
+            picture.name = eif_name;
+            picture.type = eif_head[7];
+            picture.width = eif_header_p->width;
+            picture.height = eif_header_p->height;
+
+            if (picture.type == EIF_TYPE_MULTICOLOR) {
+                if (eif_head.size() < EifZip::peekSize) {
+                    throw runtime_error("Broken image palette");
+                }
+                auto crc16 = CRC::Calculate((char *) eif_head.data() + 0x10, 768, CRC::CRC_16_CCITTFALSE());
+                picture.palette_crc = picture.section_palette_crc = crc16;
+            }
+        } catch (const std::runtime_error& ex) {
+            errors[picture.index] = "Item " + std::to_string(picture.index) + ": " + ex.what();
+        }
+
+        progress.advance(1, (qint64) picture.zip.size());
+    });
+
+    // fill the images map in the section order
+    for (auto &picture : pictures) {
+        if (!errors[picture.index].empty()) {
+            images.clear();
+            throw runtime_error(errors[picture.index]);
+        }
+        images[picture.index] = std::move(picture);
+    }
+    docPath = path;
+}
+
+QString ThemeDocument::openProject(const QString &dir) {
+
+    QWriteLocker locker(&lock);
+    images.clear();
+    picturesGeneration++;
+    Profiler::Scope open_scope(stageProfiler, "open project", QFileInfo(dir).fileName().toStdString());
+
+    try {
+        project.open(dir);
+        const auto base = project.base();
+        {
+            Profiler::Scope scope(stageProfiler, "map");
+            vbfMap.open(base.path);
+        }
+        if (ThemeProject::sBase::of(vbfMap) != base) {
+            throw runtime_error(base.path.toStdString() + " has changed since the project was saved");
+        }
+
+        // the index saves the unpack, the base is the same file
+        auto index = project.index();
+        if (!index || !unpackIndexed(*index)) {
+            unpackBase(base.path);
+            project.saveIndex(baseIndex());
+        } else {
+            checkRewritable();
+        }
+        docPath = base.path;
+
+        // every picture and row as the last applied edit left it
+        std::map<int, ThemeProject::sPictureState> states;
+        std::map<int, ImageSection::HeaderRecord> rows;
+        const auto &entries = project.entries();
+        for (int i = 0; i < (int) entries.size(); ++i) {
+            for (const auto &change : entries[i].pictures) {
+                if (!images.count(change.index)) {
+                    throw runtime_error("The project history doesn't fit " + base.path.toStdString());
+                }
+                if (i < project.cursor()) {
+                    states[change.index] = change.after;
+                }
+            }
+            for (const auto &change : entries[i].rows) {
+                if (change.index < 0 || change.index >= (int) headerLines.size()) {
+                    throw runtime_error("The project history doesn't fit " + base.path.toStdString());
+                }
+                if (i < project.cursor()) {
+                    rows[change.index] = change.after;
+                }
+            }
+        }
+
+        // only the final states are read from the store, the rest waits for undo
+        std::vector<std::pair<int, ThemeProject::sPictureState>> changed(states.begin(), states.end());
+        std::vector<std::string> errors(changed.size());
+        auto progress = progressMeter("history", (int) changed.size());
+        parallelFor((int) changed.size(), [this, &changed, &errors, &progress](int i) {
+            const auto &state = changed[i].second;
+            try {
+                if (state.state == ThemeProject::STATE_EIF) {
+                    (void) project.eif(state.hash);
+                } else if (state.state == ThemeProject::STATE_ZIP) {
+                    (void) project.zip(state.hash);
+                }
+            } catch (const std::runtime_error &ex) {
+                errors[i] = images.at(changed[i].first).name + ": " + ex.what();
+            }
+            progress.advance(1);
+        });
+        for (auto &error : errors) {
+            if (!error.empty()) {
+                throw runtime_error(error);
+            }
+        }
+
+        for (const auto &[idx, state] : changed) {
+            setPictureState(images.at(idx), state);
+        }
+        for (const auto &[idx, record] : rows) {
+            headerLines[idx] = record;
+        }
+    } catch (const std::runtime_error& ex) {
+        clearDocument();
+        return ex.what();
+    }
+
+    return "";
+}
+
+QString ThemeDocument::createProject(const QString &dir) {
+
+    QWriteLocker locker(&lock);
+    try {
+        if (!vbfMap.isOpen()) {
+            throw runtime_error("No VBF is open");
+        }
+        project.attach(dir, baseIndex());
+    } catch (const std::runtime_error& ex) {
+        return ex.what();
+    }
+
+    return "";
+}
+
+QString ThemeDocument::projectDir() const {
+    QReadLocker locker(&lock);
+    return project.dir();
+}
+
+void ThemeDocument::setPictureState(sPictureIPC &picture, const ThemeProject::sPictureState &state) {
+
+    // the store is asked first, so a broken object leaves the picture as it was
+    switch (state.state) {
+        case ThemeProject::STATE_EIF:
+            picture.eif = project.eif(state.hash);
+            picture.zip_patched.reset();
+            picture.zip = picture.section_zip;
+            picture.palette_crc = state.palette_crc;
+            break;
+        case ThemeProject::STATE_ZIP:
+            picture.zip_patched = project.zip(state.hash);
+            picture.zip = *picture.zip_patched;
+            picture.eif.reset();
+            picture.palette_crc = state.palette_crc;
+            break;
+        default:
+            picture.eif.reset();
+            picture.zip_patched.reset();
+            picture.zip = picture.section_zip;
+            picture.palette_crc = picture.section_palette_crc;
+    }
+    picture.state = state;
+    picture.changed = state.state != ThemeProject::STATE_ORIGINAL;
+    picturesGeneration++;
+}
+
+void ThemeDocument::recordEdit(const QString &title,
+                               const std::vector<std::pair<int, ThemeProject::sPictureState>> &states,
+                               bool detach_duplicates, std::vector<ThemeProject::sRowChange> rows) {
+
+    ThemeProject::sEntry entry{title, {}, std::move(rows)};
+    std::map<int, int> duplicates_before;
+    if (detach_duplicates) {
+        for (const auto &[idx, picture] : images) {
+            duplicates_before[idx] = picture.duplicate_of;
+        }
+    }
+    for (const auto &[idx, state] : states) {
+        auto &picture = images.at(idx);
+        entry.pictures.push_back({idx, picture.state, state});
+        setPictureState(picture, state);
+        if (detach_duplicates) {
+            detachDuplicate(idx);
+        }
+    }
+    // the copies left behind get new leaders, undo puts the groups back
+    for (const auto &[idx, before] : duplicates_before) {
+        const int after = images.at(idx).duplicate_of;
+        if (after != before) {
+            entry.duplicates.push_back({idx, before, after});
+        }
+    }
+    for (const auto &row : entry.rows) {
+        headerLines.at(row.index) = row.after;
+    }
+    project.record(std::move(entry));
+}
+
+ThemeDocument::sHistoryStep ThemeDocument::applyEdit(const ThemeProject::sEntry &entry, bool undo) {
+
+    // a reopened project reads the stored pictures here, nothing changes if one is broken
+    for (const auto &change : entry.pictures) {
+        const auto &state = undo ? change.before : change.after;
+        if (state.state == ThemeProject::STATE_EIF) {
+            (void) project.eif(state.hash);
+        } else if (state.state == ThemeProject::STATE_ZIP) {
+            (void) project.zip(state.hash);
+        }
+    }
+
+    sHistoryStep step;
+    step.title = entry.title;
+    for (const auto &change : entry.pictures) {
+        setPictureState(images.at(change.index), undo ? change.before : change.after);
+        step.pictures.push_back(change.index);
+    }
+    for (const auto &change : entry.rows) {
+        headerLines.at(change.index) = undo ? change.before : change.after;
+    }
+    for (const auto &change : entry.duplicates) {
+        images.at(change.index).duplicate_of = undo ? change.before : change.after;
+        step.pictures.push_back(change.index);
+    }
+    step.rows = !entry.rows.empty();
+    return step;
+}
+
+ThemeDocument::sHistoryStep ThemeDocument::undo() {
+
+    QWriteLocker locker(&lock);
+    if (project.cursor() == 0) {
+        return {};
+    }
+
+    try {
+        auto step = applyEdit(project.entries()[project.cursor() - 1], true);
+        project.undo();
+        return step;
+    } catch (const std::runtime_error& ex) {
+        sHistoryStep step;
+        step.error = ex.what();
+        return step;
+    }
+}
+
+ThemeDocument::sHistoryStep ThemeDocument::redo() {
+
+    QWriteLocker locker(&lock);
+    if (project.cursor() == (int) project.entries().size()) {
+        return {};
+    }
+
+    try {
+        auto step = applyEdit(project.entries()[project.cursor()], false);
+        project.redo();
+        return step;
+    } catch (const std::runtime_error& ex) {
+        sHistoryStep step;
+        step.error = ex.what();
+        return step;
+    }
+}
+
+QString ThemeDocument::undoTitle() const {
+    QReadLocker locker(&lock);
+    return project.undoTitle();
+}
+
+QString ThemeDocument::redoTitle() const {
+    QReadLocker locker(&lock);
+    return project.redoTitle();
+}
+
+unsigned ThemeDocument::compressionLevel(enCompressionProfile profile) {
+    switch (profile) {
+        case COMPRESSION_FAST: return MZ_BEST_SPEED;
+        case COMPRESSION_MAX: return MZ_UBER_COMPRESSION;
+        default: return MZ_DEFAULT_LEVEL;
+    }
+}
+
+vector<uint8_t> ThemeDocument::CompressEIF(const vector<uint8_t>& res_bin, const std::string& res_name,
+                                        unsigned level, bool verify) {
+
+    auto zip_bin = EifZip::compress(res_bin, res_name, level);
+
+    // round trip check before the zip goes to the section
+    if (verify && EifZip::unzip(zip_bin) != res_bin) {
+        throw runtime_error("Compressed resource " + res_name + " doesn't match the original");
+    }
+
+    return zip_bin;
+}
+
+void ThemeDocument::ReplaceEIF(ImageSection& img_sec, int idx, const vector<uint8_t>& res_bin,
+                            const vector<uint8_t>& zip_bin) {
+
+    //get header data
+    auto eif_header_p = reinterpret_cast<const EIF::EifBaseHeader*>(res_bin.data());
+
+    //replace
+    img_sec.ReplaceItem(ImageSection::RT_ZIP, idx, zip_bin,
+                        eif_header_p->width, eif_header_p->height, eif_header_p->type);
+}
+
+void ThemeDocument::savePng(EIF::EifImageBase &eif, const fs::path &path, QSemaphore &io_slots) {
+
+    // encode outside of the write slot
+    size_t png_size = 0;
+    unique_ptr<void, decltype(&mz_free)> png(nullptr, &mz_free);
+    {
+        Profiler::Scope scope(stageProfiler, "encode", path.filename().string());
+        auto bitmap = eif.getBitmapRBGA();
+        png.reset(tdefl_write_image_to_png_file_in_memory_ex(bitmap.data(), eif.getWidth(), eif.getHeight(), 4,
+                                                             &png_size, MZ_DEFAULT_LEVEL, MZ_FALSE));
+        if (!png) {
+            throw runtime_error("Can't encode PNG");
+        }
+        scope.addBytes((qint64) png_size);
+    }
+
+    io_slots.acquire();
+    QSemaphoreReleaser slot(io_slots);
+    Profiler::Scope scope(stageProfiler, "write", path.filename().string());
+    scope.addBytes((qint64) png_size);
+
+    QFile file(QString::fromStdWString(path.wstring()));
+    if (!file.open(QIODevice::WriteOnly) || file.write((const char *) png.get(), (qint64) png_size) != (qint64) png_size) {
+        throw runtime_error(file.errorString().toStdString());
+    }
+}
+
+QStringList ThemeDocument::exportAll(const QString &dest_dir, enExportFormat format) {
+
+    QReadLocker locker(&lock);
+    Profiler::Scope export_scope(stageProfiler, "export", QFileInfo(docPath).fileName().toStdString());
+
+    std::vector<const sPictureIPC *> pictures;
+    for (const auto &it : images) {
+        pictures.push_back(&it.second);
+    }
+    const int pics_count = (int) pictures.size();
+
+    // decode and encode on the pool, but keep only a few files in flight,
+    // slow network shares don't like hundreds of parallel writes
+    QSemaphore io_slots(exportWriteSlots);
+    std::vector<QString> errors(pics_count);
+    qint64 total_bytes = 0;
+    for (auto picture : pictures) {
+        total_bytes += (qint64) picture->zip.size();
+    }
+    auto progress = progressMeter("export", pics_count, total_bytes);
+
+    try {
+        parallelFor(pics_count, [&](int i) {
+            auto &picture = *pictures[i];
+            fs::path store_path(dest_dir.toStdWString() /
+                                fs::path(picture.name).replace_extension(format == EXPORT_PNG ? ".png" : ".bmp"));
+            try {
+                unique_ptr<EIF::EifImageBase> decoded;
+                auto &eif = decodedEif(picture, decoded);
+
+                if (format == EXPORT_PNG) {
+                    savePng(eif, store_path, io_slots);
+                } else {
+                    io_slots.acquire();
+                    QSemaphoreReleaser slot(io_slots);
+                    Profiler::Scope scope(stageProfiler, "write", picture.name);
+                    eif.saveBmp(store_path);
+                }
+            }
+            catch (const runtime_error& ex) {
+                qWarning() << picture.name.c_str() << ex.what();
+                errors[i] = QString("%1: %2").arg(picture.name.c_str(), ex.what());
+            }
+            progress.advance(1, (qint64) picture.zip.size());
+        });
+    } catch (const JobCancelled &ex) {
+        return {ex.what()};
+    }
+
+    QStringList failed;
+    for (auto &error : errors) {
+        if (!error.isEmpty()) {
+            failed << error;
+        }
+    }
+
+    return failed;
+}
+
+QPair<int, QString> ThemeDocument::ReplacePicture(int picture_idx, const QString &new_picture_path) {
+
+    try {
+        auto info = pictureInfo(picture_idx);
+        if (!info) {
+            throw runtime_error("Wrong picture index");
+        }
+
+        // decode BMP without holding the document
+        checkBmp(new_picture_path);
+        auto new_eif = EIF::EifConverter::makeEif(static_cast<EIF::EIF_TYPE>(info->type));
+
+        new_eif->openBmp(new_picture_path.toStdWString());
+
+        if (new_eif->getWidth() != info->width || new_eif->getHeight() != info->height) {
+            throw runtime_error("Replaced picture size mismatch");
+        }
+        auto state = project.storeEif(std::move(new_eif), info->palette_crc);
+
+        QWriteLocker locker(&lock);
+        recordEdit(QString("Replace %1").arg(info->name.c_str()), {{picture_idx, state}}, true);
+    } catch (const std::runtime_error& ex) {
+        return {picture_idx, ex.what()};
+    }
+
+    return {picture_idx, ""};
+}
+
+ThemeDocument::sBatchReplace ThemeDocument::ReplacePictures(const QMap<QString, QString> &bmp_by_name) {
+
+    struct sJob {
+        sPictureInfo info;
+        QString path;
+        ThemeProject::sPictureState state;
+        QString error;
+    };
+
+    sBatchReplace result;
+    std::vector<sJob> jobs;
+    {
+        std::map<std::string, sPictureInfo> by_name;
+        for (auto &info : pictureList()) {
+            by_name.emplace(info.name, info);
+        }
+        for (auto it = bmp_by_name.begin(); it != bmp_by_name.end(); ++it) {
+            auto picture = by_name.find(it.key().toStdString());
+            if (picture == by_name.end()) {
+                result.errors << "No image " + it.key();
+                continue;
+            }
+            jobs.push_back({picture->second, it.value()});
+        }
+    }
+
+    // decode and check all BMPs first, so one bad file doesn't leave half of the theme replaced
+    auto progress = progressMeter("validate", (int) jobs.size());
+    try {
+        parallelForEach(jobs, [this, &progress](sJob &job) {
+            try {
+                // the EIF is made for the picture's type, so check what the BMP brings for it
+                checkBmp(job.path);
+                auto eif = EIF::EifConverter::makeEif(static_cast<EIF::EIF_TYPE>(job.info.type));
+                eif->openBmp(job.path.toStdWString());
+                if (eif->getWidth() != job.info.width || eif->getHeight() != job.info.height) {
+                    throw runtime_error(QString("size %1x%2 doesn't match %3x%4")
+                                                .arg(eif->getWidth()).arg(eif->getHeight())
+                                                .arg(job.info.width).arg(job.info.height).toStdString());
+                }
+                job.state = project.storeEif(std::move(eif), job.info.palette_crc);
+            } catch (const std::runtime_error &ex) {
+                job.error = QString("%1 (%2): %3").arg(job.info.name.c_str(), QFileInfo(job.path).fileName(), ex.what());
+            }
+            progress.advance(1);
+        });
+    } catch (const JobCancelled &ex) {
+        result.errors << ex.what();
+        return result;
+    }
+
+    for (auto &job : jobs) {
+        if (!job.error.isEmpty()) {
+            result.errors << job.error;
+        }
+    }
+    if (!result.errors.isEmpty()) {
+        return result;
+    }
+
+    std::vector<std::pair<int, ThemeProject::sPictureState>> states;
+    for (auto &job : jobs) {
+        states.emplace_back(job.info.index, job.state);
+    }
+
+    QWriteLocker locker(&lock);
+    recordEdit(QString("Replace %1 pictures").arg(states.size()), states, true);
+    result.replaced = (int) states.size();
+
+    return result;
+}
+
+ThemeDocument::sPatchResult ThemeDocument::applyPatch(const ThemePatch &patch) {
+
+    sPatchResult result;
+
+    // check everything against the current pictures first, the patch goes in all at once
+    const auto pictures = pictureList();
+    std::map<std::string, sPictureInfo> by_name;
+    for (auto &info : pictures) {
+        by_name.emplace(info.name, info);
+    }
+    std::map<int, QString> hashes;
+    try {
+        hashes = pictureHashes();
+    } catch (const JobCancelled &ex) {
+        result.errors << ex.what();
+        return result;
+    }
+
+    std::vector<std::pair<int, const ThemePatch::sItem *>> items;
+    std::set<int> patched;              // including the items applied already
+    std::set<uint16_t> repaletted;      // groups whose palette the patch replaces
+    for (const auto &item : patch.items) {
+        auto it = by_name.find(item.name);
+        if (it == by_name.end()) {
+            result.errors << QString("No image %1").arg(item.name.c_str());
+            continue;
+        }
+        const auto &info = it->second;
+        if (info.width != item.width || info.height != item.height || info.type != item.type) {
+            result.errors << QString("%1: %2x%3 type %4 doesn't match %5x%6 type %7")
+                    .arg(item.name.c_str()).arg(item.width).arg(item.height).arg(item.type)
+                    .arg(info.width).arg(info.height).arg(info.type);
+            continue;
+        }
+        auto hash_it = hashes.find(info.index);
+        if (hash_it == hashes.end()) {
+            result.errors << QString("%1 changed while the patch was checked").arg(item.name.c_str());
+            continue;
+        }
+        const auto &hash = hash_it->second;
+        patched.insert(info.index);
+        if (hash == item.hash && !info.changed) {
+            continue; // applied already
+        }
+        if (info.palette_crc && item.palette_crc != info.palette_crc) {
+            repaletted.insert(info.palette_crc);
+        }
+        if (hash != item.base_hash || info.changed) {
+            result.warnings << QString("%1 differs from the patch base").arg(item.name.c_str());
+        }
+        items.emplace_back(info.index, &item);
+    }
+
+    // a 16-bit item brings its own palette, the pictures that share the old one
+    // would be left pointing at colours that aren't there anymore
+    for (const auto &info : pictures) {
+        if (info.palette_crc && repaletted.count(info.palette_crc) && !patched.count(info.index)) {
+            result.errors << QString("%1 shares palette %2 with patched pictures, but the patch doesn't change it")
+                    .arg(info.name.c_str()).arg(info.palette_crc, 4, 16, QChar('0'));
+        }
+    }
+
+    auto lines = getHeaderLines();
+    if (!patch.rows.empty() && (int) lines.size() != patch.base_rows) {
+        result.errors << QString("Header has %1 rows, the patch expects %2").arg(lines.size()).arg(patch.base_rows);
+    }
+    if (!result.errors.isEmpty()) {
+        return result;
+    }
+
+    // zips go to the store as they are, the history refers to them by hash
+    std::vector<std::pair<int, ThemeProject::sPictureState>> states;
+    for (auto [idx, item] : items) {
+        states.emplace_back(idx, project.storeZip(item->zip, item->palette_crc));
+    }
+
+    QWriteLocker locker(&lock);
+    std::vector<ThemeProject::sRowChange> rows;
+    for (const auto &row : patch.rows) {
+        if (!ThemePatch::sameRecord(headerLines.at(row.index), row.record)) {
+            rows.push_back({row.index, headerLines[row.index], row.record});
+        }
+    }
+    result.items = (int) states.size();
+    result.rows = (int) rows.size();
+    if (!states.empty() || !rows.empty()) {
+        recordEdit("Apply patch", states, true, std::move(rows));
+    }
+
+    return result;
+}
+
+ThemeDocument::sBatchReplace ThemeDocument::ReplaceFromDirectory(const QString &dir) {
+
+    // exportAll() names BMPs after the pictures, match them the same way
+    QMap<QString, QString> bmp_by_name;
+    std::map<std::string, std::string> name_by_bmp;
+    std::set<std::string> ambiguous;
+    for (auto &info : pictureList()) {
+        auto bmp = toLower(fs::path(info.name).replace_extension(".bmp").string());
+        if (!name_by_bmp.emplace(bmp, info.name).second) {
+            ambiguous.insert(bmp);
+        }
+    }
+
+    // names are matched ignoring the case, so a match has to be the only one either way
+    sBatchReplace result;
+    for (auto &entry : QDir(dir).entryInfoList({"*.bmp"}, QDir::Files)) {
+        const auto bmp = toLower(entry.fileName().toStdString());
+        auto name = name_by_bmp.find(bmp);
+        if (name == name_by_bmp.end()) {
+            result.errors << "No image for " + entry.fileName();
+            continue;
+        }
+        if (ambiguous.count(bmp)) {
+            result.errors << entry.fileName() + " matches several images that differ only in case";
+            continue;
+        }
+        const auto picture_name = QString::fromStdString(name->second);
+        if (bmp_by_name.contains(picture_name)) {
+            result.errors << QString("%1 and %2 both replace %3")
+                    .arg(QFileInfo(bmp_by_name[picture_name]).fileName(), entry.fileName(), picture_name);
+            continue;
+        }
+        bmp_by_name[picture_name] = entry.absoluteFilePath();
+    }
+
+    if (bmp_by_name.isEmpty() && result.errors.isEmpty()) {
+        result.errors << "No BMP files in " + dir;
+    }
+    if (!result.errors.isEmpty()) {
+        return result;
+    }
+
+    return ReplacePictures(bmp_by_name);
+}
+
+QPair<int, QString> ThemeDocument::ReplaceDuplicates(int picture_idx, const QString &new_picture_path) {
+
+    try {
+        // BMP is decoded once per EIF type, the copies share the stored EIF
+        std::map<uint8_t, ThemeProject::sPictureState> stored;
+        std::vector<std::pair<int, ThemeProject::sPictureState>> states;
+        std::string name;
+
+        for (auto idx : duplicatesOf(picture_idx)) {
+            auto info = pictureInfo(idx);
+            if (!info) {
+                throw runtime_error("Wrong picture index");
+            }
+            if (idx == picture_idx) {
+                name = info->name;
+            }
+
+            auto state = stored.find(info->type);
+            if (state == stored.end()) {
+                checkBmp(new_picture_path);
+                auto new_eif = EIF::EifConverter::makeEif(static_cast<EIF::EIF_TYPE>(info->type));
+                new_eif->openBmp(new_picture_path.toStdWString());
+                if (new_eif->getWidth() != info->width || new_eif->getHeight() != info->height) {
+                    throw runtime_error("Replaced picture size mismatch");
+                }
+                state = stored.emplace(info->type, project.storeEif(std::move(new_eif), info->palette_crc)).first;
+            }
+
+            auto picture_state = state->second;
+            picture_state.palette_crc = info->palette_crc;
+            states.emplace_back(idx, picture_state);
+        }
+
+        QWriteLocker locker(&lock);
+        recordEdit(QString("Replace %1 and its copies").arg(name.c_str()), states, false);
+    } catch (const std::runtime_error& ex) {
+        return {picture_idx, ex.what()};
+    }
+
+    return {picture_idx, ""};
+}
+
+ThemeDocument::sRemappedGroup
+ThemeDocument::remapGroup(uint16_t palette_crc, const std::vector<const sPictureIPC *> &pictures,
+                          enPaletteMapper mapper, ProgressMeter &progress) {
+
+    struct sMember {
+        const sPictureIPC *picture;
+        unique_ptr<EIF::EifImageBase> decoded;
+        vector<uint8_t> bitmap; // appearance before the remap
+        ColorMetrics::sDeltaE delta_e;
+    };
+
+    std::vector<sMember> members;
+    for (auto picture : pictures) {
+        members.push_back({picture});
+    }
+
+    // decode the set members concurrently, a replaced picture's eif is shared with the history,
+    // so it's only read here
+    parallelForEach(members, [this](sMember &member) {
+        member.bitmap = decodedEif(*member.picture, member.decoded).getBitmapRBGA();
+    });
+    auto memberEif = [](sMember &member) -> EIF::EifImageBase & {
+        return member.picture->eif ? *member.picture->eif : *member.decoded;
+    };
+
+    const auto detail = "palette " + QString::number(palette_crc, 16).toStdString() +
+                        ", " + std::to_string(members.size()) + " images";
+    sRemappedGroup remapped;
+    remapped.eifs.resize(members.size());
+
+    if (mapper == PALETTE_MAPPER_MEDIAN_CUT) {
+        PaletteQuantiser::sPalette palette;
+        {
+            Profiler::Scope scope(stageProfiler, "quantise", detail);
+            std::vector<const vector<uint8_t> *> bitmaps;
+            for (const auto &member : members) {
+                bitmaps.push_back(&member.bitmap);
+                scope.addBytes((qint64) member.bitmap.size());
+            }
+            palette = PaletteQuantiser::quantise(bitmaps, pool);
+        }
+
+        // the layout of every member is checked, one that doesn't fit sends the group to FTools
+        QAtomicInt misfits = 0;
+        parallelFor((int) members.size(), [&members, &remapped, &palette, &misfits, &memberEif](int i) {
+            auto &member = members[i];
+            auto applied = PaletteQuantiser::applyToEif(memberEif(member).saveEifToVector(), member.bitmap,
+                                                        palette, i);
+            if (!applied) {
+                misfits.fetchAndAddRelaxed(1);
+                return;
+            }
+            member.delta_e = ColorMetrics::deltaE(member.bitmap, applied->rgba);
+            remapped.eifs[i] = std::move(applied->eif);
+        });
+        remapped.ftools_fallback = misfits.loadRelaxed() > 0;
+    }
+
+    if (mapper == PALETTE_MAPPER_FTOOLS || remapped.ftools_fallback) {
+        // mapMultiPalette() remaps the set in place, so it gets its own copies
+        std::vector<EIF::EifImage16bit> set(members.size());
+        parallelFor((int) members.size(), [&members, &set, &memberEif](int i) {
+            if (members[i].decoded) {
+                set[i] = std::move(*reinterpret_cast<EIF::EifImage16bit *>(members[i].decoded.get())); // 🤢
+                members[i].decoded.reset();
+            } else {
+                set[i] = *reinterpret_cast<const EIF::EifImage16bit *>(&memberEif(members[i]));
+            }
+        });
+        {
+            Profiler::Scope scope(stageProfiler, "quantise", detail + ", FTools");
+            for (const auto &member : members) {
+                scope.addBytes((qint64) member.bitmap.size());
+            }
+            EIF::EifConverter::mapMultiPalette(set);
+        }
+        parallelFor((int) members.size(), [&members, &remapped, &set](int i) {
+            members[i].delta_e = ColorMetrics::deltaE(members[i].bitmap, set[i].getBitmapRBGA());
+            remapped.eifs[i] = set[i].saveEifToVector();
+        });
+    }
+
+    for (auto &member : members) {
+        progress.advance(1, pixelBytes(*member.picture));
+        remapped.delta_e += member.delta_e;
+    }
+    return remapped;
+}
+
+std::vector<ThemeDocument::sRepackedItem>
+ThemeDocument::remapPaletteGroups(const std::map<uint16_t, std::vector<int>> &groups) {
+
+    struct sGroup {
+        uint16_t palette_crc;
+        const std::vector<int> *indexes;
+        std::vector<sRepackedItem> items;
+        ColorMetrics::sDeltaE delta_e;
+        bool ftools_fallback = false;
+        std::string error;
+    };
+
+    std::vector<sGroup> jobs;
+    int members_count = 0;
+    qint64 total_bytes = 0;
+    for (const auto &[crc, indexes] : groups) {
+        auto &group = jobs.emplace_back();
+        group.palette_crc = crc;
+        group.indexes = &indexes;
+        for (auto idx : indexes) {
+            total_bytes += pixelBytes(images.at(idx));
+        }
+        members_count += (int) indexes.size();
+    }
+
+    // groups don't depend on each other, so remap them concurrently.
+    // Progress goes by pictures, a single large group still moves the bar
+    auto progress = progressMeter("quantise", members_count, total_bytes);
+    parallelForEach(jobs, [this, &progress](sGroup &group) {
+        try {
+            std::vector<const sPictureIPC *> pictures;
+            for (auto idx : *group.indexes) {
+                pictures.push_back(&images.at(idx));
+            }
+            auto remapped = remapGroup(group.palette_crc, pictures, paletteMapper, progress);
+
+            group.items.resize(remapped.eifs.size());
+            parallelForEach(group.items, [&group, &remapped](sRepackedItem &item) {
+                auto i = &item - group.items.data();
+                item.index = group.indexes->at(i);
+                item.eif = std::move(remapped.eifs[i]);
+                item.palette_crc = CRC::Calculate((char *) item.eif.data() + 0x10, 768, CRC::CRC_16_CCITTFALSE());
+            });
+
+            group.delta_e = remapped.delta_e;
+            group.ftools_fallback = remapped.ftools_fallback;
+        } catch (const std::runtime_error& ex) {
+            group.error = ex.what();
+        }
+    });
+
+    std::vector<sRepackedItem> items;
+    for (auto &group : jobs) {
+        if (!group.error.empty()) {
+            throw runtime_error(group.error);
+        }
+        packStats.palette_delta_e = std::max(packStats.palette_delta_e, group.delta_e.mean());
+        packStats.palette_fallbacks += group.ftools_fallback;
+        for (auto &item : group.items) {
+            items.push_back(std::move(item));
+        }
+    }
+
+    return items;
+}
+
+std::map<uint16_t, ThemeDocument::sPaletteGroup> ThemeDocument::collectPaletteGroups() const {
+
+    // as packVBF() finds them: patched pictures are members, but only a replaced member gets the group remapped
+    std::map<uint16_t, sPaletteGroup> groups;
+    for (const auto &[idx, picture] : images) {
+        if (!picture.palette_crc) continue;
+
+        auto &group = groups[picture.palette_crc];
+        if (group.members.empty()) {
+            group.palette_crc = picture.palette_crc;
+            group.key = QString::number(picture.palette_crc, 16);
+        }
+        group.members.push_back(idx);
+        group.pixels += (qint64) picture.width * picture.height;
+        group.changed += picture.changed && !picture.zip_patched;
+        group.key += QString(";%1:%2").arg(idx).arg(picture.state.hash);
+    }
+    return groups;
+}
+
+std::vector<ThemeDocument::sPaletteGroup> ThemeDocument::paletteGroups() const {
+
+    QReadLocker locker(&lock);
+
+    // stage totals of earlier saves tell the rates on this machine
+    double quantise_rate = defaultQuantiseRate;
+    double compress_rate = defaultCompressRate;
+    for (const auto &stage : stageProfiler.stages()) {
+        if (!stage.bytes || !stage.total_us) continue;
+        if (0 == strcmp(stage.name, "quantise")) {
+            quantise_rate = (double) stage.bytes / (double) stage.total_us;
+        } else if (0 == strcmp(stage.name, "compress")) {
+            compress_rate = (double) stage.bytes / (double) stage.total_us;
+        }
+    }
+
+    std::vector<sPaletteGroup> groups;
+    for (auto &[crc, group] : collectPaletteGroups()) {
+        if (group.changed) {
+            // 16-bit EIF is an index and an alpha byte per pixel after the palette
+            const qint64 quantise_bytes = group.pixels * 4;
+            const qint64 eif_bytes = (qint64) (group.members.size() * EifZip::peekSize) + group.pixels * 2;
+            group.save_bytes = quantise_bytes + eif_bytes;
+            group.save_ms = (qint64) ((quantise_bytes / quantise_rate + eif_bytes / compress_rate) / 1000);
+        }
+        groups.push_back(std::move(group));
+    }
+    return groups;
+}
+
+ThemeDocument::sPictureIPC ThemeDocument::detachedCopy(const sPictureIPC &picture) {
+
+    // a replaced picture's eif is never changed, others get their own zip
+    auto copy = picture;
+    if (!copy.eif) {
+        copy.zip_owned.assign(picture.zip.begin(), picture.zip.end());
+        copy.zip = copy.section_zip = copy.zip_owned;
+    }
+    return copy;
+}
+
+std::vector<ThemeDocument::sPaletteError> ThemeDocument::measurePaletteGroups(const std::vector<uint16_t> &palette_crcs) {
+
+    Profiler::Scope scope(stageProfiler, "palette error", std::to_string(palette_crcs.size()) + " groups");
+
+    struct sMeasured {
+        std::vector<sPictureIPC> copies;
+        std::vector<const sPictureIPC *> pictures;
+    };
+
+    // the members are copied under the lock and remapped without it, so a save or
+    // an edit waiting for the lock doesn't hold up the readers queued behind it
+    std::vector<sPaletteError> errors;
+    std::vector<sMeasured> measured;
+    int members_count = 0;
+    qint64 total_bytes = 0;
+    enPaletteMapper mapper;
+    {
+        QReadLocker locker(&lock);
+        mapper = paletteMapper;
+        auto groups = collectPaletteGroups();
+        for (auto crc : palette_crcs) {
+            auto &error = errors.emplace_back();
+            auto &group = measured.emplace_back();
+            error.palette_crc = crc;
+            auto found = groups.find(crc);
+            if (found == groups.end()) {
+                error.error = "No pictures with this palette";
+                continue;
+            }
+            error.key = found->second.key;
+            for (auto idx : found->second.members) {
+                group.copies.push_back(detachedCopy(images.at(idx)));
+            }
+            members_count += (int) found->second.members.size();
+            total_bytes += found->second.pixels * 4;
+        }
+    }
+    for (auto &group : measured) {
+        for (const auto &copy : group.copies) {
+            group.pictures.push_back(&copy);
+        }
+    }
+
+    auto progress = progressMeter("palette error", members_count, total_bytes);
+    try {
+        parallelFor((int) errors.size(), [this, &errors, &measured, mapper, &progress](int i) {
+            if (measured[i].pictures.empty()) return;
+            try {
+                auto remapped = remapGroup(errors[i].palette_crc, measured[i].pictures, mapper, progress);
+                errors[i].mean_delta_e = remapped.delta_e.mean();
+                errors[i].max_delta_e = remapped.delta_e.max;
+            } catch (const std::runtime_error &ex) {
+                errors[i].error = ex.what();
+            }
+        });
+    } catch (const std::runtime_error &ex) {
+        for (auto &error : errors) {
+            error.error = ex.what();
+        }
+    }
+    return errors;
+}
+
+QString ThemeDocument::packVBF(const QString &path) {
+
+    QWriteLocker locker(&lock);
+    repackedIndexes.clear();
+    packStats = {};
+    Profiler::Scope pack_scope(stageProfiler, "pack", QFileInfo(path).fileName().toStdString());
+    QElapsedTimer timer;
+    timer.start();
+
+    try {
+        // the document doesn't keep the parsed section, so its zips are only in the mapping.
+        // It's parsed again from the opened file and changed here. Untouched items keep their
+        // original compressed data
+        auto new_section = parseSection();
+        auto &section = *new_section;
+
+        // setup head objects
+        section.setHeaderData(headerLines);
+
+        // the writer lives on this thread, only the sections before the image one are written
+        // while pictures are compressed. The ones after it have to follow the new image
+        // section in the file and the block CRCs, so they are copied after it's serialised
+        std::unique_ptr<VbfWriter> writer;
+        if (vbfRewritable) {
+            try {
+                writer = std::make_unique<VbfWriter>(vbfMap, path);
+            } catch (const std::runtime_error &ex) {
+                qWarning() << "Streaming save failed, saving through VbfFile:" << ex.what();
+            }
+        }
+        std::string prefix_error;
+        QFuture<void> prefix;
+        if (writer) {
+            prefix = QtConcurrent::run([this, &writer, &prefix_error]() {
+                try {
+                    Profiler::Scope scope(stageProfiler, "write", "sections before images");
+                    writer->copySections(0, 1);
+                } catch (const std::runtime_error &ex) {
+                    prefix_error = ex.what();
+                }
+            });
+        }
+        auto wait_prefix = qScopeGuard([&prefix]() { prefix.waitForFinished(); });
+
+        std::vector<sRepackedItem> repacked;
+        std::map<uint16_t, std::vector<int>> palette_groups;
+
+        // find a changed pictures
+        for (auto &it : images) {
+
+            auto &orig_picture = it.second;
+            if (!orig_picture.changed || orig_picture.zip_patched) continue;
+
+            if (0 == orig_picture.palette_crc) {
+                // replaced pic is 8 or 32 bit eif
+                // no additional actions required
+                // just make eif from bmp and replace the
+                // original pic
+                repacked.push_back({orig_picture.index, orig_picture.eif->saveEifToVector()});
+            } else {
+                // replaced pic is definitely 16 bit eif.
+                // 16bits eif may be bonded into a set and share one palette
+                // so we need to recalculate a new palette for each eif included in that set
+                palette_groups[orig_picture.palette_crc];
+            }
+        }
+
+        // patched pictures are zipped already and their palette comes with them, the item only goes
+        // to the section. Unless a member of their group was replaced since, then they are remapped with it
+        for (auto &it : images) {
+            auto &orig_picture = it.second;
+            if (orig_picture.changed && orig_picture.zip_patched &&
+                !palette_groups.contains(orig_picture.palette_crc)) {
+                repacked.push_back({orig_picture.index, EifZip::peek(orig_picture.zip), *orig_picture.zip_patched,
+                                    orig_picture.palette_crc});
+            }
+        }
+
+        // find all pictures with the same palette, the patched ones are decoded from their zips
+        for (auto &it : images) {
+            auto group = palette_groups.find(it.second.palette_crc);
+            if (it.second.palette_crc && group != palette_groups.end()) {
+                group->second.push_back(it.first);
+            }
+        }
+
+        for (auto &item : remapPaletteGroups(palette_groups)) {
+            repacked.push_back(std::move(item));
+        }
+
+        // compress all items concurrently
+        qint64 eif_bytes = 0;
+        for (auto &item : repacked) {
+            eif_bytes += (qint64) item.eif.size();
+        }
+        auto compress_progress = progressMeter("compress", (int) repacked.size(), eif_bytes);
+        const auto level = compressionLevel(compressionProfile);
+        const auto verify = verifyCompression;
+        parallelForEach(repacked, [this, &compress_progress, level, verify](sRepackedItem &item) {
+            if (!item.zip.empty()) {
+                compress_progress.advance(1, (qint64) item.eif.size());
+                return;
+            }
+            Profiler::Scope scope(stageProfiler, "compress", images.at(item.index).name);
+            scope.addBytes((qint64) item.eif.size());
+            try {
+                item.zip = CompressEIF(item.eif, images.at(item.index).name, level, verify);
+            } catch (const std::runtime_error& ex) {
+                item.error = ex.what();
+            }
+            compress_progress.advance(1, (qint64) item.eif.size());
+        });
+
+        // and replace them in the section order, so the output doesn't depend on scheduling
+        std::sort(repacked.begin(), repacked.end(),
+                  [](const sRepackedItem &a, const sRepackedItem &b) { return a.index < b.index; });
+        for (auto &item : repacked) {
+            if (!item.error.empty()) {
+                throw runtime_error(item.error);
+            }
+            Profiler::Scope scope(stageProfiler, "replace", images[item.index].name);
+            scope.addBytes((qint64) item.zip.size());
+            ReplaceEIF(section, item.index, item.eif, item.zip);
+            packStats.items++;
+            packStats.bytes_in += item.eif.size();
+            packStats.bytes_out += item.zip.size();
+        }
+
+        //replace vbf image content
+        std::vector<uint8_t> img_sec_bin;
+        {
+            Profiler::Scope scope(stageProfiler, "serialise");
+            section.SaveToVector(img_sec_bin);
+            scope.addBytes((qint64) img_sec_bin.size());
+        }
+
+        prefix.waitForFinished();
+        if (!prefix_error.empty()) {
+            qWarning() << "Streaming save failed, saving through VbfFile:" << prefix_error.c_str();
+            writer.reset();
+        }
+        // the last point to cancel, nothing is written to the destination yet
+        JobContext::throwIfCancelled();
+        const bool overwrite = QFileInfo(path) == QFileInfo(vbfMap.path());
+        try {
+            Profiler::Scope scope(stageProfiler, "write", QFileInfo(path).fileName().toStdString());
+            qint64 write_bytes = (qint64) img_sec_bin.size();
+            for (int i = 2; i < vbfMap.sectionsCount(); ++i) {
+                write_bytes += (qint64) vbfMap.section(i).size();
+            }
+            auto write_progress = progressMeter("write", 1, write_bytes);
+            if (writer) {
+                // the rest of the file goes straight from the section and the mapping
+                writer->setProgress([&write_progress](qint64 bytes) { write_progress.advance(0, bytes); });
+                writer->writeSection(1, img_sec_bin);
+                img_sec_bin = {};
+                writer->copySections(2, vbfMap.sectionsCount());
+                if (overwrite) {
+                    detachPictures();
+                }
+                writer->commit();
+                writer->setProgress({});
+            } else {
+                // VbfFile writes in place, so write aside and rename
+                VbfFile vbf;
+                vbf.OpenFile(docPath.toStdWString());
+                vbf.ReplaceSectionRaw(1, img_sec_bin);
+                auto part_path = fs::path(path.toStdWString()).concat(".part");
+                try {
+                    vbf.SaveToFile(part_path.wstring());
+                } catch (...) {
+                    std::error_code ec;
+                    fs::remove(part_path, ec);
+                    throw;
+                }
+                if (overwrite) {
+                    detachPictures();
+                }
+                std::error_code ec;
+                fs::rename(part_path, fs::path(path.toStdWString()), ec);
+                if (ec) {
+                    fs::remove(part_path, ec);
+                    throw runtime_error("Can't replace " + path.toStdString());
+                }
+                write_progress.advance(0, write_bytes);
+            }
+            write_progress.advance(1);
+            scope.addBytes((qint64) QFileInfo(path).size());
+        } catch (const std::runtime_error&) {
+            if (!vbfMap.isOpen()) {
+                vbfMap.open(docPath);
+            }
+            throw;
+        }
+
+        // update the model in place instead of unpacking the saved file again
+        for (auto &item : repacked) {
+            auto &picture = images[item.index];
+            picture.zip_owned = std::move(item.zip);
+            picture.zip = picture.section_zip = picture.zip_owned;
+            picture.palette_crc = picture.section_palette_crc = item.palette_crc;
+            picture.eif.reset();
+            picture.zip_patched.reset();
+            picture.state = {};
+            picture.changed = false;
+            picturesGeneration++;
+            repackedIndexes.push_back(item.index);
+            // remapped palette may have moved the pixels away from the copies
+            if (picture.palette_crc) {
+                detachDuplicate(item.index);
+            }
+        }
+        attachPictures(path, section);
+        docPath = path;
+
+        // the saved file is the base of the edits from now on
+        baseLines = headerLines;
+        project.rebase(ThemeProject::sBase::of(vbfMap), baseIndex());
+
+        packStats.elapsed_ms = timer.elapsed();
+
+    } catch (const std::runtime_error& ex) {
+        return ex.what();
+    }
+
+    return "";
+}
+
+void ThemeDocument::close() {
+
+    QWriteLocker locker(&lock);
+    clearDocument();
+}
+
+int ThemeDocument::findPicture(const std::string &name) const {
+
+    QReadLocker locker(&lock);
+    for (const auto &it : images) {
+        if (it.second.name == name) {
+            return it.first;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,365 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_THEMEDOCUMENT_H
+#define FOCUSIPC_THEMEDOCUMENT_H
+
+#include <QtCore>
+#include <QtConcurrent/QtConcurrent>
+#include <QImage>
+
+#include <filesystem>
+#include <functional>
+#include <optional>
+
+#include <VbfFile.h>
+#include <ImageSection.h>
+#include <EifConverter.h>
+#include <miniz.h>
+
+#include "ColorMetrics.h"
+#include "DecodeCache.h"
+#include "JobScheduler.h"
+#include "Profiler.h"
+#include "Progress.h"
+#include "ThemeProject.h"
+#include "VbfMap.h"
+
+class ThemePatch;
+
+/*
+ * Opened VBF theme: image section, pictures and header objects.
+ * Holds the unpack/replace/export/pack pipeline without any widgets,
+ * so it's shared by the editor window and the batch mode.
+ *
+ * All public methods may be called from any thread. Long operations
+ * spread their work over the document's own thread pool and report
+ * every stage through progressChanged() and the progress callback,
+ * throttled by ProgressMeter.
+ * Run as a JobScheduler job they report to its JobContext as well and
+ * stop with a "Cancelled" error once it's cancelled, a save leaves the
+ * destination untouched then.
+ *
+ * Every replace, patch and header change is an edit of the history,
+ * which can be undone until the next save and kept in a project
+ * directory, see ThemeProject.
+ */
+class ThemeDocument : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    struct sPictureInfo {
+        int index;
+        std::string name;
+        uint16_t palette_crc;
+        uint8_t  type;
+        uint16_t width;
+        uint16_t height;
+        bool changed;
+        int duplicate_of; // first picture with the same pixels or -1, see findDuplicates()
+    };
+
+    enum enCompressionProfile {
+        COMPRESSION_FAST,
+        COMPRESSION_DEFAULT,
+        COMPRESSION_MAX
+    };
+
+    /* what builds the shared palette of a 16-bit group, both are measured by the same dE */
+    enum enPaletteMapper {
+        PALETTE_MAPPER_FTOOLS,     // EifConverter::mapMultiPalette()
+        PALETTE_MAPPER_MEDIAN_CUT  // PaletteQuantiser, FTools takes over a group whose EIFs it can't lay out
+    };
+
+    struct sPackStats {
+        qint64 elapsed_ms = 0;
+        size_t items = 0;
+        size_t bytes_in = 0;
+        size_t bytes_out = 0;
+        double palette_delta_e = 0;  // worst mean colour error among remapped palette groups
+        int palette_fallbacks = 0;   // groups the median cut left to FTools
+    };
+
+    struct sDuplicatesStats {
+        int groups = 0;
+        int duplicates = 0; // pictures beside the first one of every group
+        qint64 bytes = 0;   // decoded pixels they would take
+        QString error;
+    };
+
+    struct sBatchReplace {
+        int replaced = 0;
+        QStringList errors; // every mismatch, nothing is replaced if there are any
+    };
+
+    /* undone or redone edit */
+    struct sHistoryStep {
+        QString title;             // empty if there was nothing to undo or redo
+        std::vector<int> pictures; // pictures it changed
+        bool rows = false;         // header rows changed as well
+        QString error;
+    };
+
+    struct sPatchResult {
+        int items = 0;        // pictures taken from the patch
+        int rows = 0;         // header rows taken from the patch
+        QStringList errors;   // nothing is applied if there are any
+        QStringList warnings; // pictures that weren't as in the patch base
+    };
+
+    /* 16-bit pictures sharing one palette, a save remaps all of them once any is replaced */
+    struct sPaletteGroup {
+        uint16_t palette_crc = 0;
+        std::vector<int> members; // section order
+        qint64 pixels = 0;
+        int changed = 0;          // replaced members
+        qint64 save_bytes = 0;    // pixels remapped and EIF bytes compressed by the next save, 0 if untouched
+        qint64 save_ms = 0;       // CPU time of that at the rates of earlier saves
+        QString key;              // changes with the content of any member
+    };
+
+    /* colour change the remap would make */
+    struct sPaletteError {
+        uint16_t palette_crc = 0;
+        QString key;              // of the group as it was measured
+        double mean_delta_e = 0;  // CIE76
+        double max_delta_e = 0;
+        QString error;
+    };
+
+    enum enExportFormat {
+        EXPORT_BMP,
+        EXPORT_PNG
+    };
+
+    /* called from the pool threads */
+    using ProgressCallback = std::function<void(const sProgress &progress)>;
+
+    explicit ThemeDocument(QObject *parent = nullptr);
+
+    QString unpackVBF(const QString &path);
+    QString packVBF(const QString &path);
+    /* export every picture, returns one message per failed file */
+    QStringList exportAll(const QString &dest_dir, enExportFormat format = EXPORT_BMP);
+    QPair<int, QString> ReplacePicture(int picture_idx, const QString &new_picture_path);
+    /* replace the picture and every picture with the same pixels */
+    QPair<int, QString> ReplaceDuplicates(int picture_idx, const QString &new_picture_path);
+    /* replace pictures by name with BMPs, all of them or none: any mismatch leaves the document untouched */
+    sBatchReplace ReplacePictures(const QMap<QString, QString> &bmp_by_name);
+    /* BMPs in the directory replace pictures of the same name ignoring the case, see exportAll() */
+    sBatchReplace ReplaceFromDirectory(const QString &dir);
+    /* take zipped pictures and header rows of the patch, the next save writes them as they are */
+    sPatchResult applyPatch(const ThemePatch &patch);
+    void close();
+
+    /* keep the history of the opened VBF in the directory from now on */
+    QString createProject(const QString &dir);
+    /* open the project's base VBF and bring its edits back, the base isn't unpacked again if it's unchanged */
+    QString openProject(const QString &dir);
+    [[nodiscard]] QString projectDir() const;
+
+    sHistoryStep undo();
+    sHistoryStep redo();
+    /* empty if there's nothing to undo or redo */
+    [[nodiscard]] QString undoTitle() const;
+    [[nodiscard]] QString redoTitle() const;
+
+    [[nodiscard]] bool isOpen() const;
+    [[nodiscard]] QString path() const;
+
+    /* snapshot of pictures in the section order */
+    [[nodiscard]] std::vector<sPictureInfo> pictureList() const;
+    [[nodiscard]] std::optional<sPictureInfo> pictureInfo(int picture_idx) const;
+    [[nodiscard]] int findPicture(const std::string &name) const;
+
+    /* content hash of every zipped picture by its index, see DecodeCache::key() */
+    [[nodiscard]] std::map<int, QString> pictureHashes();
+    /* zipped EIF as stored in the section, throws runtime_error for a replaced and not saved picture */
+    [[nodiscard]] std::vector<uint8_t> zippedPicture(int picture_idx) const;
+
+    /* decode a picture to a premultiplied ARGB32 image, throws runtime_error */
+    [[nodiscard]] QImage decodePicture(int picture_idx) const;
+    /* keep decoded pictures on disk between sessions, see DecodeCache */
+    void setDecodeCacheEnabled(bool enabled);
+
+    /* palette groups in the palette order, cheap enough to call on every change */
+    [[nodiscard]] std::vector<sPaletteGroup> paletteGroups() const;
+    /*
+     * Remap copies of the groups as a save would and measure the colour change, the document isn't touched.
+     * The lock is held only while the members are copied.
+     */
+    std::vector<sPaletteError> measurePaletteGroups(const std::vector<uint16_t> &palette_crcs);
+
+    /* group pictures of one EIF type with the same decoded pixels */
+    sDuplicatesStats findDuplicates();
+    /* the picture with its copies in the section order, or just the picture */
+    [[nodiscard]] std::vector<int> duplicatesOf(int picture_idx) const;
+    void exportPicture(int picture_idx, const QString &path) const;
+
+    [[nodiscard]] vector<ImageSection::HeaderRecord> getHeaderLines() const;
+    /* changed rows go to the history as one edit, the rows count can't change */
+    QString setHeaderLines(const vector<ImageSection::HeaderRecord> &lines, const QString &title = "Edit header rows");
+
+    void setCompressionProfile(enCompressionProfile profile);
+    void setVerifyCompression(bool verify);
+    void setPaletteMapper(enPaletteMapper mapper);
+    void setMaxThreads(int threads);
+    void setProgressCallback(ProgressCallback callback);
+
+    /* pictures rewritten by the last save and its summary */
+    [[nodiscard]] std::vector<int> repacked() const;
+    [[nodiscard]] sPackStats lastPackStats() const;
+
+    /* stage timings of unpack, pack and export, thread safe on its own */
+    Profiler &profiler() { return stageProfiler; }
+
+signals:
+    void progressChanged(const sProgress &progress);
+
+private:
+
+    struct sPictureIPC {
+        int index;
+        std::string name;
+        uint16_t palette_crc = 0;
+        uint8_t  type;
+        uint16_t width;
+        uint16_t height;
+        std::span<const uint8_t> zip;          // zipped EIF as it's shown, the section's or the patch's
+        std::span<const uint8_t> section_zip;  // zipped EIF of the image section, decoded on demand
+        uint16_t section_palette_crc = 0;
+        std::vector<uint8_t> zip_owned;        // section zip storage when it's not in the mapped file
+        // set only for a patched picture, it's saved without recompression
+        std::shared_ptr<const std::vector<uint8_t>> zip_patched;
+        // set only for a replaced picture, shared with the history
+        std::shared_ptr<EIF::EifImageBase> eif;
+        ThemeProject::sPictureState state;
+        bool changed = false;
+        int duplicate_of = -1;
+    };
+
+    struct sRepackedItem {
+        int index;
+        vector<uint8_t> eif;
+        vector<uint8_t> zip;
+        uint16_t palette_crc;
+        std::string error;
+    };
+
+    static sPictureInfo toInfo(const sPictureIPC &picture);
+    /* decoded RGBA size, the unit of pixel work in progress reports */
+    static qint64 pixelBytes(const sPictureIPC &picture) { return (qint64) picture.width * picture.height * 4; }
+
+    [[nodiscard]] QImage decodeImage(const sPictureIPC &picture) const;
+    sDuplicatesStats groupDuplicates();
+    void detachDuplicate(int picture_idx);
+
+    static unique_ptr<EIF::EifImageBase> decodeEif(const sPictureIPC &picture);
+    void savePng(EIF::EifImageBase &eif, const std::filesystem::path &path, QSemaphore &io_slots);
+    static EIF::EifImageBase &pictureEif(const sPictureIPC &picture, unique_ptr<EIF::EifImageBase> &decoded);
+    /* pictureEif() accounted as the decode stage */
+    EIF::EifImageBase &decodedEif(const sPictureIPC &picture, unique_ptr<EIF::EifImageBase> &decoded);
+
+    struct sRemappedGroup {
+        vector<vector<uint8_t>> eifs; // in the order of the members
+        ColorMetrics::sDeltaE delta_e;
+        bool ftools_fallback = false; // the median cut was asked for
+    };
+
+    /*
+     * Decode the members and remap them to one palette. The pictures are the document's
+     * with the lock held or detachedCopy()s, they are only read.
+     * The median cut works on the decoded bitmaps, mapMultiPalette() owns the set it
+     * remaps, so that one gets copies of the EIFs.
+     */
+    sRemappedGroup remapGroup(uint16_t palette_crc, const std::vector<const sPictureIPC *> &pictures,
+                              enPaletteMapper mapper, ProgressMeter &progress);
+    std::vector<sRepackedItem> remapPaletteGroups(const std::map<uint16_t, std::vector<int>> &groups);
+    /* the picture with its own zip, usable after the lock is released */
+    static sPictureIPC detachedCopy(const sPictureIPC &picture);
+    /* members, pixels and keys of the groups, the caller holds the lock */
+    [[nodiscard]] std::map<uint16_t, sPaletteGroup> collectPaletteGroups() const;
+
+    // throughput assumed before a save measured it, bytes per microsecond of one thread
+    static constexpr double defaultQuantiseRate = 20;
+    static constexpr double defaultCompressRate = 15;
+
+    void detachPictures();
+    /* VbfWriter::canRewrite() of the mapped file for the saves to come */
+    void checkRewritable();
+    /* the section is the saved one, its items tell which zips of the file are the pictures */
+    void attachPictures(const QString &path, ImageSection &section);
+
+    /* map the VBF and read its pictures and rows, throws runtime_error */
+    void unpackBase(const QString &path);
+    /* take pictures from the project index instead, false if it doesn't fit the mapped file */
+    bool unpackIndexed(const ThemeProject::sIndex &index);
+    /* the image section of the mapped file, parsed from a transient copy */
+    unique_ptr<ImageSection> parseSection();
+    /* zips of the mapped section in the item order, empty unless each one is its item of the table */
+    static std::vector<std::span<const uint8_t>> locateItems(ImageSection &section,
+                                                             std::span<const uint8_t> mapped);
+    /* base pictures and rows, nullopt if some picture isn't in the mapped file */
+    [[nodiscard]] std::optional<ThemeProject::sIndex> baseIndex() const;
+    void clearDocument();
+
+    /* objects of the state are in the store, see ThemeProject::eif() */
+    void setPictureState(sPictureIPC &picture, const ThemeProject::sPictureState &state);
+    /* move the pictures to the states as one edit, the caller holds the write lock */
+    void recordEdit(const QString &title, const std::vector<std::pair<int, ThemeProject::sPictureState>> &states,
+                    bool detach_duplicates, std::vector<ThemeProject::sRowChange> rows = {});
+    /* bring pictures and rows to one side of the edit */
+    sHistoryStep applyEdit(const ThemeProject::sEntry &entry, bool undo);
+
+    void reportProgress(const sProgress &progress);
+    ProgressMeter progressMeter(const char *stage, int total, qint64 total_bytes = 0);
+
+    /* JobScheduler::parallelFor() on the document's pool */
+    void parallelFor(int count, const std::function<void(int)> &fn);
+
+    template<class Sequence, class Function>
+    void parallelForEach(Sequence &items, Function fn) {
+        parallelFor((int) items.size(), [&items, &fn](int i) { fn(items[i]); });
+    }
+
+    static unsigned compressionLevel(enCompressionProfile profile);
+
+    static vector<uint8_t>
+    CompressEIF(const vector<uint8_t> &res_bin, const string &res_name, unsigned level, bool verify);
+
+    static void
+    ReplaceEIF(ImageSection &img_sec, int idx, const vector<uint8_t> &res_bin, const vector<uint8_t> &zip_bin);
+
+    static constexpr int exportWriteSlots = 4; // files written at once, the rest are encoding
+
+    // guards everything below, writers are open/save/replace/close
+    mutable QReadWriteLock lock;
+
+    std::map<int, sPictureIPC> images;
+    // bumped when a document is opened or closed and when a picture's content changes,
+    // tells work done under the read lock that it's stale once it takes the write lock
+    quint64 picturesGeneration = 0;
+    vector<ImageSection::HeaderRecord> headerLines;
+    vector<ImageSection::HeaderRecord> baseLines; // as they are in the opened file
+    ThemeProject project;
+    std::vector<int> repackedIndexes;
+    sPackStats packStats;
+
+    enCompressionProfile compressionProfile = COMPRESSION_DEFAULT;
+    bool verifyCompression = false;
+    enPaletteMapper paletteMapper = PALETTE_MAPPER_MEDIAN_CUT;
+
+    VbfMap vbfMap;
+    bool vbfRewritable = false; // VbfWriter::canRewrite() of the opened file
+    QString docPath;
+
+    QThreadPool pool;
+    ProgressCallback progressCallback;
+    Profiler stageProfiler;
+    mutable DecodeCache decodeCache;
+};
+
+#endif //FOCUSIPC_THEMEDOCUMENT_H
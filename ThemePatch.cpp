@@ -0,0 +1,274 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "ThemePatch.h"
+#include "DecodeCache.h"
+#include "ThemeDocument.h"
+
+#include <miniz_zip.h>
+
+#include <set>
+#include <stdexcept>
+
+using namespace std;
+
+static const char *manifestName = "patch.json";
+
+QJsonObject ThemePatch::recordToJson(const ImageSection::HeaderRecord &record) {
+
+    return {
+        {"width", (int) record.width},
+        {"height", (int) record.height},
+        {"X", (int) record.X},
+        {"Y", (int) record.Y},
+        {"type", (int) record.type},
+        {"Z", (int) record.Z},
+        {"intensity", (int) record.intensity},
+        {"R", (int) record.R},
+        {"G", (int) record.G},
+        {"B", (int) record.B},
+        {"palette_id", (int) record.palette_id},
+    };
+}
+
+ImageSection::HeaderRecord ThemePatch::recordFromJson(const QJsonObject &object) {
+
+    ImageSection::HeaderRecord record{};
+    record.width = (decltype(record.width)) object["width"].toInt();
+    record.height = (decltype(record.height)) object["height"].toInt();
+    record.X = (decltype(record.X)) object["X"].toInt();
+    record.Y = (decltype(record.Y)) object["Y"].toInt();
+    record.type = (decltype(record.type)) object["type"].toInt();
+    record.Z = (decltype(record.Z)) object["Z"].toInt();
+    record.intensity = (decltype(record.intensity)) object["intensity"].toInt();
+    record.R = (decltype(record.R)) object["R"].toInt();
+    record.G = (decltype(record.G)) object["G"].toInt();
+    record.B = (decltype(record.B)) object["B"].toInt();
+    record.palette_id = (decltype(record.palette_id)) object["palette_id"].toInt();
+    return record;
+}
+
+bool ThemePatch::sameRecord(const ImageSection::HeaderRecord &a, const ImageSection::HeaderRecord &b) {
+
+    return a.width == b.width && a.height == b.height && a.X == b.X && a.Y == b.Y && a.type == b.type &&
+           a.Z == b.Z && a.intensity == b.intensity && a.R == b.R && a.G == b.G && a.B == b.B &&
+           a.palette_id == b.palette_id;
+}
+
+qint64 ThemePatch::itemsBytes() const {
+
+    qint64 bytes = 0;
+    for (const auto &item : items) {
+        bytes += (qint64) item.zip.size();
+    }
+    return bytes;
+}
+
+ThemePatch ThemePatch::diff(ThemeDocument &base, ThemeDocument &theme) {
+
+    if (!base.isOpen() || !theme.isOpen()) {
+        throw runtime_error("Both VBFs must be open");
+    }
+
+    auto base_list = base.pictureList();
+    auto theme_list = theme.pictureList();
+
+    // pictures are matched by name, so names must tell them apart
+    map<string, size_t> base_pos;
+    for (size_t i = 0; i < base_list.size(); ++i) {
+        if (base_list[i].changed) {
+            throw runtime_error("Save the base first, " + base_list[i].name + " is replaced");
+        }
+        if (!base_pos.emplace(base_list[i].name, i).second) {
+            throw runtime_error("The base has two pictures named " + base_list[i].name);
+        }
+    }
+    set<string> theme_names;
+    for (const auto &info : theme_list) {
+        if (info.changed) {
+            throw runtime_error("Save the theme first, " + info.name + " is replaced");
+        }
+        if (!theme_names.insert(info.name).second) {
+            throw runtime_error("The theme has two pictures named " + info.name);
+        }
+        if (!base_pos.count(info.name)) {
+            throw runtime_error(info.name + " isn't in the base, a patch can't add pictures");
+        }
+    }
+    if (theme_list.size() != base_list.size()) {
+        throw runtime_error(QString("The theme lacks %1 pictures of the base")
+                                    .arg(base_list.size() - theme_list.size()).toStdString());
+    }
+
+    ThemePatch patch;
+    patch.base_items = (int) base_list.size();
+
+    auto base_hashes = base.pictureHashes();
+    auto theme_hashes = theme.pictureHashes();
+    for (size_t i = 0; i < theme_list.size(); ++i) {
+        const auto &info = theme_list[i];
+        auto pos = base_pos.at(info.name);
+        const auto &base_info = base_list[pos];
+        auto theme_hash_it = theme_hashes.find(info.index);
+        auto base_hash_it = base_hashes.find(base_info.index);
+        if (theme_hash_it == theme_hashes.end() || base_hash_it == base_hashes.end()) {
+            throw runtime_error(info.name + " changed while the patch was made");
+        }
+        const auto &theme_hash = theme_hash_it->second;
+        const auto &base_hash = base_hash_it->second;
+        if (theme_hash == base_hash) continue;
+
+        if (info.width != base_info.width || info.height != base_info.height || info.type != base_info.type) {
+            throw runtime_error(QString("%1 is %2x%3 type %4 in the theme, but %5x%6 type %7 in the base")
+                                        .arg(info.name.c_str()).arg(info.width).arg(info.height).arg(info.type)
+                                        .arg(base_info.width).arg(base_info.height).arg(base_info.type)
+                                        .toStdString());
+        }
+        patch.items.push_back({info.name, base_hash, theme_hash, info.width, info.height, info.type,
+                               info.palette_crc, theme.zippedPicture(info.index)});
+    }
+
+    auto base_rows = base.getHeaderLines();
+    auto theme_rows = theme.getHeaderLines();
+    if (base_rows.size() != theme_rows.size()) {
+        throw runtime_error(QString("The theme has %1 header rows, the base has %2")
+                                    .arg(theme_rows.size()).arg(base_rows.size()).toStdString());
+    }
+    patch.base_rows = (int) base_rows.size();
+    for (size_t i = 0; i < theme_rows.size(); ++i) {
+        if (!sameRecord(base_rows[i], theme_rows[i])) {
+            patch.rows.push_back({(int) i, theme_rows[i]});
+        }
+    }
+
+    return patch;
+}
+
+void ThemePatch::save(const QString &path) const {
+
+    QJsonArray items_json;
+    for (size_t i = 0; i < items.size(); ++i) {
+        const auto &item = items[i];
+        items_json.append(QJsonObject{
+            {"name", item.name.c_str()},
+            {"file", QString("items/%1").arg(i)},
+            {"base_hash", item.base_hash},
+            {"hash", item.hash},
+            {"width", item.width},
+            {"height", item.height},
+            {"type", item.type},
+            {"palette_crc", item.palette_crc},
+        });
+    }
+    QJsonArray rows_json;
+    for (const auto &row : rows) {
+        auto row_json = recordToJson(row.record);
+        row_json["index"] = row.index;
+        rows_json.append(row_json);
+    }
+    auto manifest = QJsonDocument(QJsonObject{
+        {"version", formatVersion},
+        {"base_items", base_items},
+        {"base_rows", base_rows},
+        {"items", items_json},
+        {"rows", rows_json},
+    }).toJson();
+
+    mz_zip_archive zip_archive{};
+    if (!mz_zip_writer_init_heap(&zip_archive, 0, (size_t) itemsBytes() + manifest.size() + 4096)) {
+        throw runtime_error("mz_zip_writer_init_heap failed");
+    }
+    auto end = qScopeGuard([&zip_archive]() { mz_zip_writer_end(&zip_archive); });
+
+    bool ok = mz_zip_writer_add_mem(&zip_archive, manifestName, manifest.constData(), manifest.size(),
+                                    MZ_DEFAULT_LEVEL);
+    // items are deflated already
+    for (size_t i = 0; ok && i < items.size(); ++i) {
+        auto name = QString("items/%1").arg(i).toStdString();
+        ok = mz_zip_writer_add_mem(&zip_archive, name.c_str(), items[i].zip.data(), items[i].zip.size(),
+                                   MZ_NO_COMPRESSION);
+    }
+    void *archive = nullptr;
+    size_t archive_size = 0;
+    if (!ok || !mz_zip_writer_finalize_heap_archive(&zip_archive, &archive, &archive_size)) {
+        throw runtime_error("Can't build the patch archive");
+    }
+    auto free_archive = qScopeGuard([archive]() { mz_free(archive); });
+
+    QSaveFile file(path);
+    bool written = file.open(QIODevice::WriteOnly) &&
+                   file.write((const char *) archive, (qint64) archive_size) == (qint64) archive_size &&
+                   file.commit();
+    if (!written) {
+        throw runtime_error("Can't write " + path.toStdString() + ": " + file.errorString().toStdString());
+    }
+}
+
+ThemePatch ThemePatch::load(const QString &path) {
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw runtime_error("Can't open patch " + path.toStdString());
+    }
+    auto data = file.readAll();
+
+    mz_zip_archive zip_archive{};
+    if (!mz_zip_reader_init_mem(&zip_archive, data.constData(), data.size(), 0)) {
+        throw runtime_error(path.toStdString() + " isn't a patch");
+    }
+    auto end = qScopeGuard([&zip_archive]() { mz_zip_reader_end(&zip_archive); });
+
+    auto extract = [&zip_archive](const string &name) {
+        size_t size = 0;
+        auto p = (uint8_t *) mz_zip_reader_extract_file_to_heap(&zip_archive, name.c_str(), &size, 0);
+        if (nullptr == p) {
+            throw runtime_error("Patch has no " + name);
+        }
+        vector<uint8_t> out(p, p + size);
+        mz_free(p);
+        return out;
+    };
+
+    auto manifest_bin = extract(manifestName);
+    QJsonParseError error{};
+    auto json = QJsonDocument::fromJson(QByteArray((const char *) manifest_bin.data(), (int) manifest_bin.size()),
+                                        &error);
+    if (error.error != QJsonParseError::NoError || !json.isObject()) {
+        throw runtime_error("Broken patch manifest: " + error.errorString().toStdString());
+    }
+    auto manifest = json.object();
+    if (manifest["version"].toInt() != formatVersion) {
+        throw runtime_error("Unsupported patch version " + to_string(manifest["version"].toInt()));
+    }
+
+    ThemePatch patch;
+    patch.base_items = manifest["base_items"].toInt();
+    patch.base_rows = manifest["base_rows"].toInt();
+    for (const auto &value : manifest["items"].toArray()) {
+        auto object = value.toObject();
+        sItem item;
+        item.name = object["name"].toString().toStdString();
+        item.base_hash = object["base_hash"].toString();
+        item.hash = object["hash"].toString();
+        item.width = (uint16_t) object["width"].toInt();
+        item.height = (uint16_t) object["height"].toInt();
+        item.type = (uint8_t) object["type"].toInt();
+        item.palette_crc = (uint16_t) object["palette_crc"].toInt();
+        item.zip = extract(object["file"].toString().toStdString());
+        if (DecodeCache::key(item.zip) != item.hash) {
+            throw runtime_error("Patch item " + item.name + " is broken");
+        }
+        patch.items.push_back(std::move(item));
+    }
+    for (const auto &value : manifest["rows"].toArray()) {
+        auto object = value.toObject();
+        sRow row{object["index"].toInt(-1), recordFromJson(object)};
+        if (row.index < 0 || row.index >= patch.base_rows) {
+            throw runtime_error("Patch header row " + to_string(row.index) + " is out of range");
+        }
+        patch.rows.push_back(row);
+    }
+
+    return patch;
+}
@@ -0,0 +1,70 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_THEMEPATCH_H
+#define FOCUSIPC_THEMEPATCH_H
+
+#include <QtCore>
+
+#include <string>
+#include <vector>
+
+#include <ImageSection.h>
+
+class ThemeDocument;
+
+/*
+ * Difference between two saved VBF themes: zipped pictures that changed,
+ * matched by name, and header rows that changed, matched by position.
+ *
+ * The file is a zip of patch.json and the changed items exactly as they are
+ * stored in the image section, so neither making nor applying a patch
+ * decodes or compresses a picture. See ThemeDocument::applyPatch().
+ * All functions throw runtime_error.
+ */
+class ThemePatch {
+
+public:
+    struct sItem {
+        std::string name;
+        QString base_hash; // the picture in the base the patch was made against
+        QString hash;      // see DecodeCache::key()
+        uint16_t width = 0;
+        uint16_t height = 0;
+        uint8_t type = 0;
+        uint16_t palette_crc = 0;
+        std::vector<uint8_t> zip;
+    };
+
+    struct sRow {
+        int index;
+        ImageSection::HeaderRecord record;
+    };
+
+    std::vector<sItem> items;
+    std::vector<sRow> rows;
+    int base_items = 0;
+    int base_rows = 0;
+
+    static constexpr const char *fileSuffix = ".vbfpatch";
+
+    /* changes turning base into theme, neither may have unsaved pictures */
+    static ThemePatch diff(ThemeDocument &base, ThemeDocument &theme);
+
+    void save(const QString &path) const;
+    static ThemePatch load(const QString &path);
+
+    [[nodiscard]] bool isEmpty() const { return items.empty() && rows.empty(); }
+    [[nodiscard]] qint64 itemsBytes() const;
+
+    static bool sameRecord(const ImageSection::HeaderRecord &a, const ImageSection::HeaderRecord &b);
+    /* header row fields by name, shared with the ThemeProject journal */
+    static QJsonObject recordToJson(const ImageSection::HeaderRecord &record);
+    static ImageSection::HeaderRecord recordFromJson(const QJsonObject &object);
+
+private:
+    static constexpr int formatVersion = 1;
+};
+
+#endif //FOCUSIPC_THEMEPATCH_H
@@ -0,0 +1,619 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "ThemeProject.h"
+#include "DecodeCache.h"
+#include "ThemePatch.h"
+
+#include <set>
+#include <stdexcept>
+
+using namespace std;
+
+static const char *journalName = "project.json";
+static const char *journalLogName = "journal.log";
+static const char *indexName = "index.json";
+static const char *objectsDir = "objects";
+
+static QJsonObject baseToJson(const ThemeProject::sBase &base) {
+
+    return {
+        {"path", base.path},
+        {"size", base.size},
+        {"modified_ms", base.modified_ms},
+        {"images_size", base.images_size},
+        {"images_crc", base.images_crc},
+    };
+}
+
+static ThemeProject::sBase baseFromJson(const QJsonObject &object) {
+
+    ThemeProject::sBase base;
+    base.path = object["path"].toString();
+    base.size = (qint64) object["size"].toDouble();
+    base.modified_ms = (qint64) object["modified_ms"].toDouble();
+    base.images_size = (qint64) object["images_size"].toDouble();
+    base.images_crc = (uint16_t) object["images_crc"].toInt();
+    return base;
+}
+
+static QJsonObject stateToJson(const ThemeProject::sPictureState &state) {
+
+    static const char *names[] = {"original", "eif", "zip"};
+    return {
+        {"state", names[state.state]},
+        {"hash", state.hash},
+        {"palette_crc", state.palette_crc},
+    };
+}
+
+static ThemeProject::sPictureState stateFromJson(const QJsonObject &object) {
+
+    ThemeProject::sPictureState state;
+    auto name = object["state"].toString();
+    if (name == "eif") {
+        state.state = ThemeProject::STATE_EIF;
+    } else if (name == "zip") {
+        state.state = ThemeProject::STATE_ZIP;
+    } else if (name != "original") {
+        throw runtime_error("Unknown picture state " + name.toStdString());
+    }
+    state.hash = object["hash"].toString();
+    state.palette_crc = (uint16_t) object["palette_crc"].toInt();
+    return state;
+}
+
+static QJsonObject entryToJson(const ThemeProject::sEntry &entry) {
+
+    QJsonArray pictures;
+    for (const auto &change : entry.pictures) {
+        pictures.append(QJsonObject{
+            {"index", change.index},
+            {"before", stateToJson(change.before)},
+            {"after", stateToJson(change.after)},
+        });
+    }
+    QJsonArray rows;
+    for (const auto &change : entry.rows) {
+        rows.append(QJsonObject{
+            {"index", change.index},
+            {"before", ThemePatch::recordToJson(change.before)},
+            {"after", ThemePatch::recordToJson(change.after)},
+        });
+    }
+    return {
+        {"title", entry.title},
+        {"pictures", pictures},
+        {"rows", rows},
+    };
+}
+
+static ThemeProject::sEntry entryFromJson(const QJsonObject &entry_json) {
+
+    ThemeProject::sEntry entry;
+    entry.title = entry_json["title"].toString();
+    for (const auto &value : entry_json["pictures"].toArray()) {
+        auto object = value.toObject();
+        entry.pictures.push_back({object["index"].toInt(-1), stateFromJson(object["before"].toObject()),
+                                  stateFromJson(object["after"].toObject())});
+    }
+    for (const auto &value : entry_json["rows"].toArray()) {
+        auto object = value.toObject();
+        entry.rows.push_back({object["index"].toInt(-1), ThemePatch::recordFromJson(object["before"].toObject()),
+                              ThemePatch::recordFromJson(object["after"].toObject())});
+    }
+    return entry;
+}
+
+static QJsonObject readJson(const QString &path) {
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw runtime_error("Can't open " + path.toStdString());
+    }
+    QJsonParseError error{};
+    auto json = QJsonDocument::fromJson(file.readAll(), &error);
+    if (error.error != QJsonParseError::NoError || !json.isObject()) {
+        throw runtime_error("Broken " + path.toStdString() + ": " + error.errorString().toStdString());
+    }
+    return json.object();
+}
+
+static void writeFile(const QString &path, const char *data, qint64 size) {
+
+    QSaveFile file(path);
+    bool written = file.open(QIODevice::WriteOnly) && file.write(data, size) == size && file.commit();
+    if (!written) {
+        throw runtime_error("Can't write " + path.toStdString() + ": " + file.errorString().toStdString());
+    }
+}
+
+ThemeProject::sBase ThemeProject::sBase::of(const VbfMap &map) {
+
+    QFileInfo info(map.path());
+    sBase base;
+    base.path = info.absoluteFilePath();
+    base.size = info.size();
+    base.modified_ms = info.lastModified().toMSecsSinceEpoch();
+    base.images_size = (qint64) map.section(1).size();
+    base.images_crc = map.sectionCrc(1);
+    return base;
+}
+
+bool ThemeProject::sBase::operator==(const sBase &other) const {
+    return path == other.path && size == other.size && modified_ms == other.modified_ms &&
+           images_size == other.images_size && images_crc == other.images_crc;
+}
+
+void ThemeProject::start(const sBase &base) {
+
+    {
+        QMutexLocker locker(&m_storeMutex);
+        m_dir.clear();
+        m_eifs.clear();
+        m_zips.clear();
+    }
+    m_base = base;
+    m_entries.clear();
+    m_cursor = 0;
+    m_seq = 0;
+    m_logLines = 0;
+}
+
+void ThemeProject::close() {
+    start({});
+}
+
+void ThemeProject::attach(const QString &dir, const std::optional<sIndex> &index) {
+
+    if (!QDir().mkpath(QDir(dir).filePath(objectsDir))) {
+        throw runtime_error("Can't create " + dir.toStdString());
+    }
+
+    // a reopened history keeps the pictures it didn't get to in the old directory
+    for (const auto &entry : m_entries) {
+        for (const auto &change : entry.pictures) {
+            for (const auto &state : {change.before, change.after}) {
+                if (state.state == STATE_EIF) {
+                    (void) eif(state.hash);
+                } else if (state.state == STATE_ZIP) {
+                    (void) zip(state.hash);
+                }
+            }
+        }
+    }
+
+    // objects so far were kept in memory only
+    std::map<QString, std::shared_ptr<EIF::EifImageBase>> eifs;
+    std::map<QString, std::shared_ptr<const std::vector<uint8_t>>> zips;
+    {
+        QMutexLocker locker(&m_storeMutex);
+        m_dir = QDir(dir).absolutePath();
+        eifs = m_eifs;
+        zips = m_zips;
+    }
+    for (const auto &[hash, eif] : eifs) {
+        writeObject(hash, STATE_EIF, eif->saveEifToVector());
+    }
+    for (const auto &[hash, zip] : zips) {
+        writeObject(hash, STATE_ZIP, *zip);
+    }
+
+    writeJournal();
+    writeIndex(index);
+    prune();
+}
+
+void ThemeProject::open(const QString &dir) {
+
+    start({});
+
+    // version 1 rewrote the whole history on every step, it has no log
+    auto journal = readJson(QDir(dir).filePath(journalName));
+    const auto version = journal["version"].toInt();
+    if (version != 1 && version != formatVersion) {
+        throw runtime_error("Unsupported project version " + to_string(version));
+    }
+
+    std::vector<sEntry> entries;
+    for (const auto &entry_value : journal["entries"].toArray()) {
+        entries.push_back(entryFromJson(entry_value.toObject()));
+    }
+
+    auto cursor = journal["cursor"].toInt(-1);
+    if (cursor < 0 || cursor > (int) entries.size()) {
+        throw runtime_error("Broken project history");
+    }
+
+    // steps after the snapshot, the ones it has folded in already are skipped
+    auto seq = (qint64) journal["seq"].toDouble();
+    int log_lines = 0;
+    QFile log(QDir(dir).filePath(journalLogName));
+    if (log.open(QIODevice::ReadOnly)) {
+        while (!log.atEnd()) {
+            const auto line = log.readLine().trimmed();
+            if (line.isEmpty()) continue;
+            auto step = QJsonDocument::fromJson(line).object();
+            if (step.isEmpty()) {
+                // a step cut short by a crash can only be the last one
+                qWarning() << "Project journal ends with a broken step";
+                break;
+            }
+            log_lines++;
+            const auto step_seq = (qint64) step["seq"].toDouble();
+            if (step_seq <= seq) continue;
+            seq = step_seq;
+
+            const auto op = step["op"].toString();
+            if (op == "record") {
+                entries.resize(cursor);
+                entries.push_back(entryFromJson(step["entry"].toObject()));
+                cursor++;
+            } else if (op == "undo" && cursor > 0) {
+                cursor--;
+            } else if (op == "redo" && cursor < (int) entries.size()) {
+                cursor++;
+            } else {
+                throw runtime_error("Broken project journal");
+            }
+        }
+    }
+
+    {
+        QMutexLocker locker(&m_storeMutex);
+        m_dir = QDir(dir).absolutePath();
+    }
+    m_base = baseFromJson(journal["base"].toObject());
+    m_entries = std::move(entries);
+    m_cursor = cursor;
+    m_seq = seq;
+    m_logLines = log_lines;
+}
+
+std::optional<ThemeProject::sIndex> ThemeProject::index() const {
+
+    auto path = QDir(m_dir).filePath(indexName);
+    if (m_dir.isEmpty() || !QFileInfo::exists(path)) {
+        return std::nullopt;
+    }
+
+    try {
+        auto json = readJson(path);
+        // the index is the same in both versions
+        const auto version = json["version"].toInt();
+        if (version < 1 || version > formatVersion || baseFromJson(json["base"].toObject()) != m_base) {
+            return std::nullopt;
+        }
+
+        sIndex index;
+        for (const auto &value : json["items"].toArray()) {
+            auto object = value.toObject();
+            sIndexItem item;
+            item.name = object["name"].toString().toStdString();
+            item.type = (uint8_t) object["type"].toInt();
+            item.width = (uint16_t) object["width"].toInt();
+            item.height = (uint16_t) object["height"].toInt();
+            item.palette_crc = (uint16_t) object["palette_crc"].toInt();
+            item.offset = (qint64) object["offset"].toDouble();
+            item.size = (qint64) object["size"].toDouble();
+            index.items.push_back(std::move(item));
+        }
+        for (const auto &value : json["rows"].toArray()) {
+            index.rows.push_back(ThemePatch::recordFromJson(value.toObject()));
+        }
+        return index;
+    } catch (const std::runtime_error &ex) {
+        // the base is unpacked then, the index is only a shortcut
+        qWarning() << "Project index is ignored:" << ex.what();
+        return std::nullopt;
+    }
+}
+
+void ThemeProject::saveIndex(const std::optional<sIndex> &index) {
+
+    if (!isAttached()) return;
+    try {
+        writeIndex(index);
+    } catch (const std::runtime_error &ex) {
+        qWarning() << "Project index isn't saved:" << ex.what();
+    }
+}
+
+void ThemeProject::rebase(const sBase &base, const std::optional<sIndex> &index) {
+
+    {
+        QMutexLocker locker(&m_storeMutex);
+        m_eifs.clear();
+        m_zips.clear();
+    }
+    m_base = base;
+    m_entries.clear();
+    m_cursor = 0;
+
+    if (!isAttached()) return;
+    try {
+        writeJournal();
+        writeIndex(index);
+        prune();
+    } catch (const std::runtime_error &ex) {
+        qWarning() << "Project isn't updated:" << ex.what();
+    }
+}
+
+void ThemeProject::record(sEntry entry) {
+
+    const bool forgets = m_cursor < (int) m_entries.size();
+    m_entries.resize(m_cursor);
+    m_entries.push_back(std::move(entry));
+    m_cursor++;
+
+    try {
+        if (forgets) {
+            prune();
+        }
+        appendStep(QJsonObject{{"op", "record"}, {"entry", entryToJson(m_entries.back())}});
+    } catch (const std::runtime_error &ex) {
+        qWarning() << "Project history isn't saved:" << ex.what();
+    }
+}
+
+const ThemeProject::sEntry *ThemeProject::undo() {
+
+    if (m_cursor == 0) {
+        return nullptr;
+    }
+    m_cursor--;
+    try {
+        appendStep(QJsonObject{{"op", "undo"}});
+    } catch (const std::runtime_error &ex) {
+        qWarning() << "Project history isn't saved:" << ex.what();
+    }
+    return &m_entries[m_cursor];
+}
+
+const ThemeProject::sEntry *ThemeProject::redo() {
+
+    if (m_cursor == (int) m_entries.size()) {
+        return nullptr;
+    }
+    m_cursor++;
+    try {
+        appendStep(QJsonObject{{"op", "redo"}});
+    } catch (const std::runtime_error &ex) {
+        qWarning() << "Project history isn't saved:" << ex.what();
+    }
+    return &m_entries[m_cursor - 1];
+}
+
+QString ThemeProject::undoTitle() const {
+    return m_cursor > 0 ? m_entries[m_cursor - 1].title : QString();
+}
+
+QString ThemeProject::redoTitle() const {
+    return m_cursor < (int) m_entries.size() ? m_entries[m_cursor].title : QString();
+}
+
+ThemeProject::sPictureState ThemeProject::storeEif(std::shared_ptr<EIF::EifImageBase> eif, uint16_t palette_crc) {
+
+    auto bin = eif->saveEifToVector();
+    sPictureState state{STATE_EIF, DecodeCache::key(bin), palette_crc};
+
+    QString dir;
+    {
+        QMutexLocker locker(&m_storeMutex);
+        if (m_eifs.count(state.hash)) {
+            return state;
+        }
+        dir = m_dir;
+    }
+    // written outside of the lock, the same picture stored twice is written twice at worst
+    if (!dir.isEmpty()) {
+        writeObject(state.hash, STATE_EIF, bin);
+    }
+
+    QMutexLocker locker(&m_storeMutex);
+    m_eifs.emplace(state.hash, std::move(eif));
+    return state;
+}
+
+ThemeProject::sPictureState ThemeProject::storeZip(std::vector<uint8_t> zip, uint16_t palette_crc) {
+
+    sPictureState state{STATE_ZIP, DecodeCache::key(zip), palette_crc};
+
+    QString dir;
+    {
+        QMutexLocker locker(&m_storeMutex);
+        if (m_zips.count(state.hash)) {
+            return state;
+        }
+        dir = m_dir;
+    }
+    if (!dir.isEmpty()) {
+        writeObject(state.hash, STATE_ZIP, zip);
+    }
+
+    QMutexLocker locker(&m_storeMutex);
+    m_zips.emplace(state.hash, std::make_shared<const std::vector<uint8_t>>(std::move(zip)));
+    return state;
+}
+
+std::shared_ptr<EIF::EifImageBase> ThemeProject::eif(const QString &hash) {
+
+    {
+        QMutexLocker locker(&m_storeMutex);
+        auto it = m_eifs.find(hash);
+        if (it != m_eifs.end()) {
+            return it->second;
+        }
+    }
+
+    // a reopened project loads the EIFs as the history gets to them
+    auto bin = readObject(hash, STATE_EIF);
+    if (bin.size() < 8 || DecodeCache::key(bin) != hash) {
+        throw runtime_error("Stored picture " + hash.toStdString() + " is broken");
+    }
+    std::shared_ptr<EIF::EifImageBase> eif = EIF::EifConverter::makeEif(static_cast<EIF::EIF_TYPE>(bin[7]));
+    eif->openEif(bin);
+
+    QMutexLocker locker(&m_storeMutex);
+    return m_eifs.emplace(hash, std::move(eif)).first->second;
+}
+
+std::shared_ptr<const std::vector<uint8_t>> ThemeProject::zip(const QString &hash) {
+
+    {
+        QMutexLocker locker(&m_storeMutex);
+        auto it = m_zips.find(hash);
+        if (it != m_zips.end()) {
+            return it->second;
+        }
+    }
+
+    auto zip = readObject(hash, STATE_ZIP);
+    if (DecodeCache::key(zip) != hash) {
+        throw runtime_error("Stored picture " + hash.toStdString() + " is broken");
+    }
+
+    QMutexLocker locker(&m_storeMutex);
+    return m_zips.emplace(hash, std::make_shared<const std::vector<uint8_t>>(std::move(zip))).first->second;
+}
+
+QString ThemeProject::objectPath(const QString &hash, enState state) const {
+    return QDir(m_dir).filePath(QString("%1/%2%3").arg(objectsDir, hash, state == STATE_ZIP ? ".zip" : ".eif"));
+}
+
+void ThemeProject::writeObject(const QString &hash, enState state, const std::vector<uint8_t> &data) const {
+
+    QString path;
+    {
+        QMutexLocker locker(&m_storeMutex);
+        path = objectPath(hash, state);
+    }
+    // objects are named by their content, an existing one is the same
+    if (QFileInfo::exists(path)) return;
+    writeFile(path, (const char *) data.data(), (qint64) data.size());
+}
+
+std::vector<uint8_t> ThemeProject::readObject(const QString &hash, enState state) const {
+
+    QString path;
+    {
+        QMutexLocker locker(&m_storeMutex);
+        if (m_dir.isEmpty()) {
+            throw runtime_error("Picture " + hash.toStdString() + " isn't in the history");
+        }
+        path = objectPath(hash, state);
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw runtime_error("Can't open " + path.toStdString());
+    }
+    auto data = file.readAll();
+    return {data.begin(), data.end()};
+}
+
+void ThemeProject::prune() {
+
+    std::set<QString> used;
+    for (const auto &entry : m_entries) {
+        for (const auto &change : entry.pictures) {
+            used.insert(change.before.hash);
+            used.insert(change.after.hash);
+        }
+    }
+
+    QString dir;
+    {
+        QMutexLocker locker(&m_storeMutex);
+        for (auto it = m_eifs.begin(); it != m_eifs.end();) {
+            it = used.count(it->first) ? std::next(it) : m_eifs.erase(it);
+        }
+        for (auto it = m_zips.begin(); it != m_zips.end();) {
+            it = used.count(it->first) ? std::next(it) : m_zips.erase(it);
+        }
+        dir = m_dir;
+    }
+
+    if (dir.isEmpty()) return;
+    QDir objects(QDir(dir).filePath(objectsDir));
+    for (const auto &file : objects.entryInfoList(QDir::Files)) {
+        if (!used.count(file.completeBaseName())) {
+            objects.remove(file.fileName());
+        }
+    }
+}
+
+void ThemeProject::writeJournal() {
+
+    QJsonArray entries;
+    for (const auto &entry : m_entries) {
+        entries.append(entryToJson(entry));
+    }
+
+    auto json = QJsonDocument(QJsonObject{
+        {"version", formatVersion},
+        {"base", baseToJson(m_base)},
+        {"cursor", m_cursor},
+        {"seq", m_seq},
+        {"entries", entries},
+    }).toJson(QJsonDocument::Compact);
+    writeFile(QDir(m_dir).filePath(journalName), json.constData(), json.size());
+
+    // the snapshot has every step now, a log left behind by a crash here is skipped by seq
+    QFile::remove(QDir(m_dir).filePath(journalLogName));
+    m_logLines = 0;
+}
+
+void ThemeProject::appendStep(QJsonObject step) {
+
+    m_seq++;
+    if (!isAttached()) return;
+    if (m_logLines >= compactSteps) {
+        writeJournal();
+        return;
+    }
+
+    step["seq"] = m_seq;
+    auto line = QJsonDocument(step).toJson(QJsonDocument::Compact) + '\n';
+    QFile log(QDir(m_dir).filePath(journalLogName));
+    if (!log.open(QIODevice::WriteOnly | QIODevice::Append) || log.write(line) != line.size() || !log.flush()) {
+        throw runtime_error("Can't write " + log.fileName().toStdString() + ": " + log.errorString().toStdString());
+    }
+    m_logLines++;
+}
+
+void ThemeProject::writeIndex(const std::optional<sIndex> &index) const {
+
+    auto path = QDir(m_dir).filePath(indexName);
+    if (!index) {
+        QFile::remove(path);
+        return;
+    }
+
+    QJsonArray items;
+    for (const auto &item : index->items) {
+        items.append(QJsonObject{
+            {"name", item.name.c_str()},
+            {"type", item.type},
+            {"width", item.width},
+            {"height", item.height},
+            {"palette_crc", item.palette_crc},
+            {"offset", item.offset},
+            {"size", item.size},
+        });
+    }
+    QJsonArray rows;
+    for (const auto &row : index->rows) {
+        rows.append(ThemePatch::recordToJson(row));
+    }
+
+    auto json = QJsonDocument(QJsonObject{
+        {"version", formatVersion},
+        {"base", baseToJson(m_base)},
+        {"items", items},
+        {"rows", rows},
+    }).toJson(QJsonDocument::Compact);
+    writeFile(path, json.constData(), json.size());
+}
@@ -0,0 +1,181 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_THEMEPROJECT_H
+#define FOCUSIPC_THEMEPROJECT_H
+
+#include <QtCore>
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <ImageSection.h>
+#include <EifConverter.h>
+
+#include "VbfMap.h"
+
+/*
+ * Edit history of an opened theme and the project directory it's kept in.
+ *
+ * An edit is a list of picture and header row changes. A picture change
+ * only names its states before and after: the picture of the base VBF,
+ * a replaced EIF or a patched zip. EIFs and zips are kept in the object
+ * store once per content hash, so undo and redo swap shared references
+ * and the history never holds a copy of a picture.
+ *
+ * Without a directory the history lives in memory until the document is
+ * saved or closed. Attached to a directory every edit, undo and redo is
+ * appended to a journal log there, and the history is written out whole
+ * only when it's attached, rebased or the log grows long. An index of the
+ * base pictures is kept along, so the project reopens without unpacking
+ * the base again, see ThemeDocument::openProject().
+ *
+ * The object store may be used from any thread, the rest is guarded by
+ * the document's lock. Failed loads and object writes throw runtime_error,
+ * a failed journal write is only logged, the edit is done already then.
+ */
+class ThemeProject {
+
+public:
+    enum enState {
+        STATE_ORIGINAL, // as it is in the base VBF
+        STATE_EIF,      // replaced, zipped on save
+        STATE_ZIP       // taken from a patch, saved as it is
+    };
+
+    struct sPictureState {
+        enState state = STATE_ORIGINAL;
+        QString hash;             // of the object in the store, see DecodeCache::key()
+        uint16_t palette_crc = 0; // palette group of a replaced or patched picture
+    };
+
+    struct sPictureChange {
+        int index;
+        sPictureState before;
+        sPictureState after;
+    };
+
+    struct sRowChange {
+        int index;
+        ImageSection::HeaderRecord before;
+        ImageSection::HeaderRecord after;
+    };
+
+    /* duplicate_of of a picture, see ThemeDocument::findDuplicates() */
+    struct sDuplicateChange {
+        int index;
+        int before;
+        int after;
+    };
+
+    struct sEntry {
+        QString title;
+        std::vector<sPictureChange> pictures;
+        std::vector<sRowChange> rows;
+        // found duplicates live only as long as the session, so these aren't saved
+        std::vector<sDuplicateChange> duplicates;
+    };
+
+    /* the project only opens over the very same base file */
+    struct sBase {
+        QString path;
+        qint64 size = 0;
+        qint64 modified_ms = 0;
+        qint64 images_size = 0;
+        uint16_t images_crc = 0;
+
+        static sBase of(const VbfMap &map);
+        bool operator==(const sBase &other) const;
+        bool operator!=(const sBase &other) const { return !(*this == other); }
+    };
+
+    /* base pictures where unpackVBF() found them, offsets are in the image section */
+    struct sIndexItem {
+        std::string name;
+        uint8_t type = 0;
+        uint16_t width = 0;
+        uint16_t height = 0;
+        uint16_t palette_crc = 0;
+        qint64 offset = 0;
+        qint64 size = 0;
+    };
+
+    struct sIndex {
+        std::vector<sIndexItem> items;
+        std::vector<ImageSection::HeaderRecord> rows;
+    };
+
+    static constexpr const char *dirSuffix = ".vbfproj";
+
+    ThemeProject() = default;
+    ThemeProject(const ThemeProject &) = delete;
+    ThemeProject &operator=(const ThemeProject &) = delete;
+
+    /* empty history over the base, not attached to any directory */
+    void start(const sBase &base);
+    /* keep the history in the directory from now on, the index lets it reopen quickly */
+    void attach(const QString &dir, const std::optional<sIndex> &index);
+    /* read the history of the directory, see base() and index() to open it */
+    void open(const QString &dir);
+    /* the base was saved, the history starts over from it */
+    void rebase(const sBase &base, const std::optional<sIndex> &index);
+    void close();
+
+    [[nodiscard]] bool isAttached() const { return !m_dir.isEmpty(); }
+    [[nodiscard]] QString dir() const { return m_dir; }
+    [[nodiscard]] const sBase &base() const { return m_base; }
+    /* nullopt if the project has none or it's for another base */
+    [[nodiscard]] std::optional<sIndex> index() const;
+    void saveIndex(const std::optional<sIndex> &index);
+
+    /* edits up to cursor() are applied */
+    [[nodiscard]] const std::vector<sEntry> &entries() const { return m_entries; }
+    [[nodiscard]] int cursor() const { return m_cursor; }
+
+    /* append the edit, the undone ones are forgotten */
+    void record(sEntry entry);
+    /* step the cursor back or forth, nullptr if there's nothing to undo or redo */
+    const sEntry *undo();
+    const sEntry *redo();
+    [[nodiscard]] QString undoTitle() const;
+    [[nodiscard]] QString redoTitle() const;
+
+    /* keep the object, a copy already in the store is returned instead */
+    sPictureState storeEif(std::shared_ptr<EIF::EifImageBase> eif, uint16_t palette_crc);
+    sPictureState storeZip(std::vector<uint8_t> zip, uint16_t palette_crc);
+    [[nodiscard]] std::shared_ptr<EIF::EifImageBase> eif(const QString &hash);
+    [[nodiscard]] std::shared_ptr<const std::vector<uint8_t>> zip(const QString &hash);
+
+private:
+    [[nodiscard]] QString objectPath(const QString &hash, enState state) const;
+    void writeObject(const QString &hash, enState state, const std::vector<uint8_t> &data) const;
+    std::vector<uint8_t> readObject(const QString &hash, enState state) const;
+    /* drop objects no edit refers to */
+    void prune();
+    /* the whole history, the log starts over */
+    void writeJournal();
+    /* one step to the log, a long log is folded into the history instead */
+    void appendStep(QJsonObject step);
+    void writeIndex(const std::optional<sIndex> &index) const;
+
+    static constexpr int formatVersion = 2;
+    static constexpr int compactSteps = 256;
+
+    QString m_dir;
+    sBase m_base;
+    std::vector<sEntry> m_entries;
+    int m_cursor = 0;
+    qint64 m_seq = 0;      // steps taken, see appendStep()
+    int m_logLines = 0;    // steps in the log since the history was written
+
+    // the store, guarded on its own
+    mutable QMutex m_storeMutex;
+    std::map<QString, std::shared_ptr<EIF::EifImageBase>> m_eifs;
+    std::map<QString, std::shared_ptr<const std::vector<uint8_t>>> m_zips;
+};
+
+#endif //FOCUSIPC_THEMEPROJECT_H
@@ -0,0 +1,161 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "VbfMap.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+static inline uint32_t readBE32(const uint8_t *p) {
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+static inline uint32_t readLE32(const uint8_t *p) {
+    return (uint32_t) p[3] << 24 | (uint32_t) p[2] << 16 | (uint32_t) p[1] << 8 | p[0];
+}
+
+static inline uint16_t readLE16(const uint8_t *p) {
+    return (uint16_t) (p[1] << 8 | p[0]);
+}
+
+VbfMap::~VbfMap() {
+    close();
+}
+
+void VbfMap::open(const QString &path) {
+
+    close();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        throw runtime_error("Can't open " + path.toStdString());
+    }
+
+    m_size = m_file.size();
+    m_data = m_file.map(0, (qint64) m_size);
+    if (nullptr == m_data) {
+        m_file.close();
+        throw runtime_error("Can't map " + path.toStdString());
+    }
+
+    try {
+        // binary part is a sequence of blocks:
+        // [u32 BE address][u32 BE length][data][u16 BE crc]
+        m_headerSize = headerSize();
+        size_t pos = m_headerSize;
+        while (pos < m_size) {
+            if (m_size - pos < 8) {
+                throw runtime_error("Truncated VBF block header");
+            }
+            uint32_t len = readBE32(m_data + pos + 4);
+            pos += 8;
+            if (m_size - pos < (size_t) len + 2) {
+                throw runtime_error("Truncated VBF block");
+            }
+            m_sections.emplace_back(m_data + pos, len);
+            m_addresses.push_back(readBE32(m_data + pos - 8));
+            m_crcs.push_back((uint16_t) (m_data[pos + len] << 8 | m_data[pos + len + 1]));
+            pos += len + 2;
+        }
+    } catch (const runtime_error &) {
+        close();
+        throw;
+    }
+}
+
+void VbfMap::close() {
+
+    m_sections.clear();
+    m_addresses.clear();
+    m_crcs.clear();
+    m_headerSize = 0;
+    if (nullptr != m_data) {
+        m_file.unmap(const_cast<uchar *>(m_data));
+        m_data = nullptr;
+    }
+    m_size = 0;
+    m_file.close();
+}
+
+std::span<const uint8_t> VbfMap::section(int idx) const {
+
+    if (idx < 0 || idx >= sectionsCount()) {
+        throw runtime_error("Can't get image section");
+    }
+    return m_sections[idx];
+}
+
+size_t VbfMap::headerSize() const {
+
+    // ASCII header ends with the brace closing the 'header' block
+    int depth = 0;
+    bool started = false;
+    for (size_t i = 0; i < m_size; ++i) {
+        auto c = m_data[i];
+        if (c == '/' && i + 1 < m_size && m_data[i + 1] == '/') {
+            while (i < m_size && m_data[i] != '\n') ++i;
+        } else if (c == '/' && i + 1 < m_size && m_data[i + 1] == '*') {
+            for (i += 2; i + 1 < m_size && !(m_data[i] == '*' && m_data[i + 1] == '/'); ++i);
+            ++i;
+        } else if (c == '"') {
+            for (++i; i < m_size && m_data[i] != '"'; ++i);
+        } else if (c == '{') {
+            ++depth;
+            started = true;
+        } else if (c == '}') {
+            if (--depth == 0 && started) {
+                return i + 1;
+            }
+        }
+    }
+
+    throw runtime_error("Can't find VBF header end");
+}
+
+std::vector<std::span<const uint8_t>> VbfMap::findZipItems(std::span<const uint8_t> section) {
+
+    // Every zipped item is a single file archive:
+    // local header, data, central directory entry and end of central directory.
+    // Walk that structure strictly, anything else between the items is skipped.
+    static const uint8_t local_sig[] = {'P', 'K', 3, 4};
+    std::vector<std::span<const uint8_t>> items;
+
+    const uint8_t *p = section.data();
+    const uint8_t *sec_end = section.data() + section.size();
+
+    while ((p = std::search(p, sec_end, std::begin(local_sig), std::end(local_sig))) != sec_end) {
+
+        const uint8_t *item = p;
+        auto left = [sec_end](const uint8_t *at) { return (size_t) (sec_end - at); };
+
+        if (left(p) < 30 || (readLE16(p + 6) & 0x08)) { // sizes are in a data descriptor
+            ++p;
+            continue;
+        }
+        size_t local_size = 30 + readLE16(p + 26) + readLE16(p + 28) + readLE32(p + 18);
+        if (left(p) < local_size + 46 || readLE32(p + local_size) != 0x02014b50) {
+            ++p;
+            continue;
+        }
+        const uint8_t *cd = p + local_size;
+        size_t cd_size = 46 + readLE16(cd + 28) + readLE16(cd + 30) + readLE16(cd + 32);
+        if (left(cd) < cd_size + 22 || readLE32(cd + cd_size) != 0x06054b50) {
+            ++p;
+            continue;
+        }
+        const uint8_t *eocd = cd + cd_size;
+        size_t eocd_size = 22 + readLE16(eocd + 20);
+        if (left(eocd) < eocd_size) {
+            ++p;
+            continue;
+        }
+
+        p = eocd + eocd_size;
+        items.emplace_back(item, p);
+    }
+
+    return items;
+}
@@ -0,0 +1,53 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_VBFMAP_H
+#define FOCUSIPC_VBFMAP_H
+
+#include <QFile>
+#include <span>
+#include <vector>
+
+/*
+ * Read-only view of a VBF file mapped into memory.
+ * Sections and zipped items are handed out as spans pointing into the mapping,
+ * they stay valid until close() or the next open().
+ */
+class VbfMap {
+
+public:
+    VbfMap() = default;
+    VbfMap(const VbfMap &) = delete;
+    VbfMap &operator=(const VbfMap &) = delete;
+    ~VbfMap();
+
+    void open(const QString &path);
+    void close();
+
+    [[nodiscard]] bool isOpen() const { return nullptr != m_data; }
+    [[nodiscard]] QString path() const { return m_file.fileName(); }
+    [[nodiscard]] int sectionsCount() const { return (int) m_sections.size(); }
+    [[nodiscard]] std::span<const uint8_t> section(int idx) const;
+    [[nodiscard]] uint32_t sectionAddress(int idx) const { return m_addresses.at(idx); }
+    [[nodiscard]] uint16_t sectionCrc(int idx) const { return m_crcs.at(idx); }
+
+    /* ASCII header and the blocks following it */
+    [[nodiscard]] std::span<const uint8_t> header() const { return {m_data, m_headerSize}; }
+    [[nodiscard]] std::span<const uint8_t> binary() const { return {m_data + m_headerSize, m_size - m_headerSize}; }
+
+    static std::vector<std::span<const uint8_t>> findZipItems(std::span<const uint8_t> section);
+
+private:
+    size_t headerSize() const;
+
+    QFile m_file;
+    const uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_headerSize = 0;
+    std::vector<std::span<const uint8_t>> m_sections;
+    std::vector<uint32_t> m_addresses;
+    std::vector<uint16_t> m_crcs;
+};
+
+#endif //FOCUSIPC_VBFMAP_H
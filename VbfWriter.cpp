@@ -0,0 +1,133 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include "VbfWriter.h"
+
+#include <CRC.h>
+
+#include <QRegularExpression>
+#include <stdexcept>
+
+using namespace std;
+
+static const CRC::Table<crcpp_uint16, 16> &blockCrcTable() {
+    static const CRC::Table<crcpp_uint16, 16> table(CRC::CRC_16_CCITTFALSE());
+    return table;
+}
+
+static const CRC::Table<crcpp_uint32, 32> &fileCrcTable() {
+    static const CRC::Table<crcpp_uint32, 32> table(CRC::CRC_32());
+    return table;
+}
+
+static const QRegularExpression &fileChecksumRe() {
+    static const QRegularExpression re(R"(file_checksum\s*=\s*0x([0-9A-Fa-f]+)\s*;)");
+    return re;
+}
+
+bool VbfWriter::canRewrite(const VbfMap &source) {
+
+    // block CRC16-CCITT over the data and CRC32 over the whole binary part,
+    // make sure the source agrees before writing anything this way
+    for (int i = 0; i < source.sectionsCount(); ++i) {
+        auto data = source.section(i);
+        if (CRC::Calculate(data.data(), data.size(), blockCrcTable()) != source.sectionCrc(i)) {
+            return false;
+        }
+    }
+
+    auto header = QByteArray::fromRawData((const char *) source.header().data(), (int) source.header().size());
+    auto match = fileChecksumRe().match(QString::fromLatin1(header));
+    if (match.hasMatch()) {
+        if (match.capturedLength(1) != 8) {
+            return false;
+        }
+        auto binary = source.binary();
+        if (CRC::Calculate(binary.data(), binary.size(), fileCrcTable()) != match.captured(1).toUInt(nullptr, 16)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+VbfWriter::VbfWriter(const VbfMap &source, const QString &path) : m_source(source), m_file(path) {
+
+    if (!m_file.open(QIODevice::WriteOnly)) {
+        throw runtime_error("Can't write " + path.toStdString() + ": " + m_file.errorString().toStdString());
+    }
+
+    auto header = source.header();
+    auto match = fileChecksumRe().match(QString::fromLatin1((const char *) header.data(), (int) header.size()));
+    if (match.hasMatch()) {
+        m_checksumPos = match.capturedStart(1);
+        m_checksumDigits = match.capturedLength(1);
+    }
+
+    if (m_file.write((const char *) header.data(), (qint64) header.size()) != (qint64) header.size()) {
+        throw runtime_error("Can't write VBF header: " + m_file.errorString().toStdString());
+    }
+    m_fileCrc = CRC::Calculate(nullptr, 0, fileCrcTable());
+}
+
+void VbfWriter::write(const void *data, size_t size) {
+
+    if (m_file.write((const char *) data, (qint64) size) != (qint64) size) {
+        throw runtime_error("Can't write VBF: " + m_file.errorString().toStdString());
+    }
+    m_fileCrc = CRC::Calculate(data, size, fileCrcTable(), m_fileCrc);
+    if (m_progress) {
+        m_progress((qint64) size);
+    }
+}
+
+void VbfWriter::writeBlock(uint32_t address, std::span<const uint8_t> data) {
+
+    const uint8_t head[8] = {
+            (uint8_t) (address >> 24), (uint8_t) (address >> 16), (uint8_t) (address >> 8), (uint8_t) address,
+            (uint8_t) (data.size() >> 24), (uint8_t) (data.size() >> 16), (uint8_t) (data.size() >> 8),
+            (uint8_t) data.size()};
+    write(head, sizeof(head));
+
+    auto crc = CRC::Calculate(nullptr, 0, blockCrcTable());
+    for (size_t pos = 0; pos < data.size(); pos += chunkSize) {
+        auto chunk = data.subspan(pos, min(chunkSize, data.size() - pos));
+        crc = CRC::Calculate(chunk.data(), chunk.size(), blockCrcTable(), crc);
+        write(chunk.data(), chunk.size());
+    }
+
+    const uint8_t tail[2] = {(uint8_t) (crc >> 8), (uint8_t) crc};
+    write(tail, sizeof(tail));
+}
+
+void VbfWriter::copySections(int from, int to) {
+
+    for (int i = from; i < to; ++i) {
+        writeSection(i, m_source.section(i));
+    }
+}
+
+void VbfWriter::writeSection(int idx, std::span<const uint8_t> data) {
+
+    if (idx != m_nextSection) {
+        throw runtime_error("VBF sections are written out of order");
+    }
+    writeBlock(m_source.sectionAddress(idx), data);
+    m_nextSection++;
+}
+
+void VbfWriter::commit() {
+
+    if (m_checksumPos >= 0) {
+        auto digits = QString("%1").arg(m_fileCrc, m_checksumDigits, 16, QChar('0')).toUpper().toLatin1();
+        if (digits.size() != m_checksumDigits || !m_file.seek(m_checksumPos) ||
+            m_file.write(digits) != digits.size() || !m_file.seek(m_file.size())) {
+            throw runtime_error("Can't update VBF file_checksum");
+        }
+    }
+
+    if (!m_file.commit()) {
+        throw runtime_error("Can't save VBF: " + m_file.errorString().toStdString());
+    }
+}
@@ -0,0 +1,58 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#ifndef FOCUSIPC_VBFWRITER_H
+#define FOCUSIPC_VBFWRITER_H
+
+#include <QSaveFile>
+
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "VbfMap.h"
+
+/*
+ * Writes a VBF block by block, taking unchanged blocks from the mapped source.
+ *
+ * Block CRC16 and the header file_checksum are updated as bytes go out,
+ * nothing is assembled in memory. The file appears at its path only on
+ * commit(), until then it's a temporary file next to it.
+ *
+ * Use it only when canRewrite() confirms the source checksums can be
+ * reproduced, VbfFile is the reference implementation otherwise.
+ */
+class VbfWriter {
+
+public:
+    static bool canRewrite(const VbfMap &source);
+
+    VbfWriter(const VbfMap &source, const QString &path);
+
+    /* called with the number of bytes after every write */
+    void setProgress(std::function<void(qint64 bytes)> progress) { m_progress = std::move(progress); }
+
+    /* blocks must go in the source order */
+    void copySections(int from, int to);
+    void writeSection(int idx, std::span<const uint8_t> data);
+
+    /* source mapping isn't used anymore, so it may be closed before the commit */
+    void commit();
+
+private:
+    void writeBlock(uint32_t address, std::span<const uint8_t> data);
+    void write(const void *data, size_t size);
+
+    static constexpr size_t chunkSize = 1 << 20;
+
+    const VbfMap &m_source;
+    QSaveFile m_file;
+    int m_nextSection = 0;
+    uint32_t m_fileCrc;
+    qint64 m_checksumPos = -1; // position of file_checksum digits in the header
+    int m_checksumDigits = 0;
+    std::function<void(qint64 bytes)> m_progress;
+};
+
+#endif //FOCUSIPC_VBFWRITER_H
@@ -0,0 +1,100 @@
+//
+// Created by user on 17.10.2026.
+//
+
+#include <QtTest>
+
+#include <CRC.h>
+
+#include "VbfMap.h"
+#include "VbfWriter.h"
+
+/*
+ * Rewriting a VBF: block and file checksums follow the replaced sections.
+ */
+class VbfWriterTests : public QObject {
+
+    Q_OBJECT
+
+private slots:
+    void checksums();
+
+private:
+    static QByteArray vbfBlock(uint32_t address, const QByteArray &data);
+};
+
+QByteArray VbfWriterTests::vbfBlock(uint32_t address, const QByteArray &data) {
+
+    QByteArray block;
+    for (uint32_t value : {address, (uint32_t) data.size()}) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            block += (char) (value >> shift);
+        }
+    }
+    block += data;
+    auto crc = CRC::Calculate(data.constData(), data.size(), CRC::CRC_16_CCITTFALSE());
+    block += (char) (crc >> 8);
+    block += (char) crc;
+    return block;
+}
+
+void VbfWriterTests::checksums() {
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // a header with the checksum of the blocks following it
+    const QByteArray binary = vbfBlock(0x1000, "first block") + vbfBlock(0x2000, QByteArray(3000, 'x'));
+    auto file_crc = CRC::Calculate(binary.constData(), binary.size(), CRC::CRC_32());
+    const auto digits = QString("%1").arg(file_crc, 8, 16, QChar('0')).toUpper();
+    const QByteArray header = QString("vbf_version = 2.6;\nheader {\n  // \"}\" in a comment\n"
+                                      "  file_checksum = 0x%1;\n}").arg(digits).toLatin1();
+
+    const auto source_path = dir.filePath("source.vbf");
+    QFile source_file(source_path);
+    QVERIFY(source_file.open(QIODevice::WriteOnly));
+    source_file.write(header + binary);
+    source_file.close();
+
+    VbfMap source;
+    source.open(source_path);
+    QCOMPARE(source.sectionsCount(), 2);
+    QVERIFY(VbfWriter::canRewrite(source));
+
+    // the second block changes, both checksums have to follow
+    const QByteArray replaced(5000, 'y');
+    const auto out_path = dir.filePath("out.vbf");
+    qint64 written = 0;
+    {
+        VbfWriter writer(source, out_path);
+        writer.setProgress([&written](qint64 bytes) { written += bytes; });
+        writer.copySections(0, 1);
+        QVERIFY_EXCEPTION_THROWN(writer.copySections(0, 1), std::runtime_error);
+        writer.writeSection(1, {(const uint8_t *) replaced.constData(), (size_t) replaced.size()});
+        writer.commit();
+    }
+
+    VbfMap out;
+    out.open(out_path);
+    QCOMPARE(out.sectionsCount(), 2);
+    QCOMPARE(out.sectionAddress(1), 0x2000u);
+    QCOMPARE(out.sectionCrc(1), CRC::Calculate(replaced.constData(), replaced.size(), CRC::CRC_16_CCITTFALSE()));
+    QCOMPARE(out.sectionCrc(0), source.sectionCrc(0));
+    QCOMPARE((qint64) out.binary().size(), written);
+    QCOMPARE(out.header().size(), source.header().size());
+    QVERIFY(VbfWriter::canRewrite(out));
+
+    // a wrong block CRC in the source is refused, the mapping goes before the file changes
+    source.close();
+    QByteArray broken = header + binary;
+    broken[broken.size() - 1] = (char) (broken[broken.size() - 1] ^ 1);
+    QVERIFY(source_file.open(QIODevice::WriteOnly));
+    source_file.write(broken);
+    source_file.close();
+    source.open(source_path);
+    QVERIFY(!VbfWriter::canRewrite(source));
+}
+
+QTEST_GUILESS_MAIN(VbfWriterTests)
+
+#include "VbfWriterTests.moc"
@@ -1,11 +1,52 @@
 #include "mainwindow.h"
+#include "BatchRunner.h"
+#include "Profiler.h"
 #include <QApplication>
 
+#include <cstdlib>
+#include <new>
+
+// Allocations of the diagnostics are counted here and in ThemeBench: replacing the global
+// operator new in themedoc would swap the allocator of every binary that links it.
+// A plain counter, operator new can't afford anything that allocates itself
+static thread_local quint64 t_allocations = 0;
+
+void *operator new(std::size_t size) {
+    ++t_allocations;
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+static quint64 threadAllocations() {
+    return t_allocations;
+}
+
 int main(int argc, char *argv[])
 {
+    Profiler::setAllocationCounter(&threadAllocations);
+
+    if (BatchRunner::isBatchMode(argc, argv)) {
+        QCoreApplication a(argc, argv);
+        QCoreApplication::setOrganizationName("FocusIPC");
+        QCoreApplication::setApplicationName("FocusIPC");
+        return BatchRunner::run(QCoreApplication::arguments());
+    }
+
     QApplication a(argc, argv);
+    QApplication::setOrganizationName("FocusIPC");
+    QApplication::setApplicationName("FocusIPC");
     MainWindow w;
     w.show();
 
     return QApplication::exec();
-}
\ No newline at end of file
+}
@@ -1,9 +1,8 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "version.h"
+#include "DiagnosticsDialog.h"
 
-#include <miniz_zip.h>
-#include <CRC.h>
 #include <filesystem>
 
 namespace fs = std::filesystem;
@@ -16,10 +15,248 @@ MainWindow::MainWindow(QWidget *parent) :
 
 	ui->tableView->setModel(&m_model);
 
+    // the objects laid out as on the screen next to the table
+    layoutPreview = new LayoutPreview(doc, m_model);
+    auto layoutSplitter = new QSplitter(Qt::Horizontal);
+    ui->verticalLayout_11->replaceWidget(ui->tableView, layoutSplitter);
+    layoutSplitter->addWidget(ui->tableView);
+    layoutSplitter->addWidget(layoutPreview);
+    layoutSplitter->setStretchFactor(1, 1);
+    connect(ui->tableView->selectionModel(), &QItemSelectionModel::currentChanged, this,
+            [this](const QModelIndex &current) { layoutPreview->setCurrentRow(current.row()); });
+    connect(layoutPreview, &LayoutPreview::rowClicked, ui->tableView, &QTableView::selectRow);
+    connect(&m_pictures, &PictureListModel::pictureChanged, layoutPreview, &LayoutPreview::pictureChanged);
+    connect(&m_pictures, &QAbstractItemModel::modelReset, this,
+            [this]() { layoutPreview->picturesReset((int) m_pictures.pictures().size()); });
+
+    ui->lw->setModel(&m_filter);
+    ui->lw->setUniformItemSizes(true);
+    ui->lw->setLayoutMode(QListView::Batched);
+    ui->lw->setIconSize({PictureListModel::thumbnailSize, PictureListModel::thumbnailSize});
+    ui->lineEdit_search->setToolTip(PictureFilterModel::queryHelp());
+    connect(ui->lw->selectionModel(), &QItemSelectionModel::currentChanged, this, &MainWindow::slotPictureSelected);
+
 	ui->statusBar->addPermanentWidget(ui->label_Width);
     ui->statusBar->addPermanentWidget(ui->label_Height);
     ui->statusBar->addPermanentWidget(ui->label_Type);
     ui->statusBar->addWidget(ui->label_Status);
+
+    // stage of the running job, bytes are counted where the stage knows them
+    progressBar = new QProgressBar();
+    progressBar->setMaximumWidth(160);
+    progressBar->setTextVisible(false);
+    progressBar->setVisible(false);
+    throughputLabel = new QLabel();
+    throughputLabel->setVisible(false);
+    ui->statusBar->addPermanentWidget(throughputLabel);
+    ui->statusBar->addPermanentWidget(progressBar);
+
+    // stops everything but the previews, a save is dropped before the destination is touched
+    cancelButton = new QToolButton();
+    cancelButton->setText("Cancel");
+    cancelButton->setVisible(false);
+    ui->statusBar->addPermanentWidget(cancelButton);
+    connect(cancelButton, &QToolButton::clicked, this, [this]() {
+        scheduler.cancelAll(JobScheduler::PRIORITY_NORMAL);
+    });
+
+    setCacheBudget(QSettings().value("cacheBudgetMb", defaultCacheBudgetMb).toInt());
+    auto settingsMenu = ui->menuBar->addMenu("Settings");
+    settingsMenu->addAction("Image cache size...", this, [this]() {
+        bool ok;
+        int budget = QInputDialog::getInt(this, "Image cache size", "Decoded images cache, MB:",
+                                          pixmapCache.maxCost() / 1024, 1, 4096, 1, &ok);
+        if (!ok) return;
+
+        QSettings().setValue("cacheBudgetMb", budget);
+        setCacheBudget(budget);
+    });
+
+    auto decodeCacheEnabled = QSettings().value("decodeCache", true).toBool();
+    doc.setDecodeCacheEnabled(decodeCacheEnabled);
+    auto decodeCacheAction = settingsMenu->addAction("Keep decoded images on disk", this, [this](bool checked) {
+        doc.setDecodeCacheEnabled(checked);
+        QSettings().setValue("decodeCache", checked);
+    });
+    decodeCacheAction->setCheckable(true);
+    decodeCacheAction->setChecked(decodeCacheEnabled);
+
+    auto compressionProfile = static_cast<ThemeDocument::enCompressionProfile>(
+            QSettings().value("compressionProfile", ThemeDocument::COMPRESSION_DEFAULT).toInt());
+    auto verifyCompression = QSettings().value("verifyCompression", false).toBool();
+    doc.setCompressionProfile(compressionProfile);
+    doc.setVerifyCompression(verifyCompression);
+
+    auto compressionMenu = settingsMenu->addMenu("Compression");
+    auto compressionGroup = new QActionGroup(this);
+    for (auto [profile, title] : {std::pair{ThemeDocument::COMPRESSION_FAST, "Fast"},
+                                  std::pair{ThemeDocument::COMPRESSION_DEFAULT, "Default"},
+                                  std::pair{ThemeDocument::COMPRESSION_MAX, "Maximum"}}) {
+        auto action = compressionMenu->addAction(title, this, [this, profile = profile]() {
+            doc.setCompressionProfile(profile);
+            QSettings().setValue("compressionProfile", profile);
+        });
+        action->setCheckable(true);
+        action->setChecked(profile == compressionProfile);
+        compressionGroup->addAction(action);
+    }
+    compressionMenu->addSeparator();
+    auto verifyAction = compressionMenu->addAction("Verify compressed images", this, [this](bool checked) {
+        doc.setVerifyCompression(checked);
+        QSettings().setValue("verifyCompression", checked);
+    });
+    verifyAction->setCheckable(true);
+    verifyAction->setChecked(verifyCompression);
+
+    auto paletteMapper = static_cast<ThemeDocument::enPaletteMapper>(
+            QSettings().value("paletteMapper", ThemeDocument::PALETTE_MAPPER_MEDIAN_CUT).toInt());
+    doc.setPaletteMapper(paletteMapper);
+
+    // the palette groups dialog measures the colour error of the one chosen here
+    auto paletteMenu = settingsMenu->addMenu("Shared palettes");
+    auto paletteGroup = new QActionGroup(this);
+    for (auto [mapper, title] : {std::pair{ThemeDocument::PALETTE_MAPPER_MEDIAN_CUT, "Median cut"},
+                                 std::pair{ThemeDocument::PALETTE_MAPPER_FTOOLS, "FTools"}}) {
+        auto action = paletteMenu->addAction(title, this, [this, mapper = mapper]() {
+            doc.setPaletteMapper(mapper);
+            QSettings().setValue("paletteMapper", mapper);
+        });
+        action->setCheckable(true);
+        action->setChecked(mapper == paletteMapper);
+        paletteGroup->addAction(action);
+    }
+
+    // edits are undone until the next save, a project keeps them between sessions
+    openProjectAction = new QAction("Open project...", this);
+    ui->menu->insertAction(ui->actionSave, openProjectAction);
+    ui->menu->insertSeparator(ui->actionSave);
+    connect(openProjectAction, &QAction::triggered, this, &MainWindow::slotOpenProject);
+    saveProjectAction = new QAction("Save project as...", this);
+    ui->menu->insertAction(ui->actionClose, saveProjectAction);
+    ui->menu->insertSeparator(ui->actionClose);
+    connect(saveProjectAction, &QAction::triggered, this, &MainWindow::slotSaveProject);
+
+    auto editMenu = new QMenu("Edit", this);
+    ui->menuBar->insertMenu(settingsMenu->menuAction(), editMenu);
+    undoAction = editMenu->addAction("Undo", this, &MainWindow::slotUndo);
+    undoAction->setShortcut(QKeySequence::Undo);
+    redoAction = editMenu->addAction("Redo", this, &MainWindow::slotRedo);
+    redoAction->setShortcut(QKeySequence::Redo);
+
+    // every edited cell is an edit of the document history
+    connect(&m_model, &HeaderObjectsModel::lineEdited, this, [this](int row) {
+        if (!doc.isOpen()) return;
+
+        auto res = doc.setHeaderLines(m_model.exportLines(), QString("Edit header row %1").arg(row + 1));
+        if (!res.isEmpty()) {
+            ui->label_Status->setText(res);
+        }
+        updateGui();
+    });
+
+    auto toolsMenu = ui->menuBar->addMenu("Tools");
+    dedupAction = toolsMenu->addAction("Find duplicate images", this, [this]() {
+        if (!doc.isOpen()) return;
+
+        startJob("Searching duplicates", JobScheduler::PRIORITY_BACKGROUND, false,
+                 [this]() { return doc.findDuplicates(); },
+                 [this](const ThemeDocument::sDuplicatesStats &stats, bool cancelled) {
+                     dedupFinished(stats, cancelled);
+                 });
+    });
+    dedupAction->setEnabled(false);
+    replaceDirAction = toolsMenu->addAction("Replace images from folder...", this, [this]() {
+        if (!doc.isOpen()) return;
+
+        auto dir = QFileDialog::getExistingDirectory(this, tr("Replace images from folder"));
+        if (dir.isEmpty()) return;
+
+        startJob("Replacing pictures", JobScheduler::PRIORITY_NORMAL, true,
+                 [this, dir]() { return doc.ReplaceFromDirectory(dir); },
+                 [this](const ThemeDocument::sBatchReplace &res, bool cancelled) {
+                     replaceDirFinished(res, cancelled);
+                 });
+    });
+    replaceDirAction->setEnabled(false);
+    toolsMenu->addSeparator();
+    makePatchAction = toolsMenu->addAction("Make patch against base...", this, [this]() {
+        if (!doc.isOpen()) return;
+
+        auto base_path = QFileDialog::getOpenFileName(this, tr("Base VBF"), "", tr("VBF File (*.vbf)"));
+        if (base_path.isEmpty()) return;
+        auto suggested_name = fs::path(vbfPath.toStdWString()).stem().concat(ThemePatch::fileSuffix);
+        auto patch_path = QFileDialog::getSaveFileName(this, tr("Save patch"), suggested_name.string().c_str(),
+                                                       tr("Theme patch (*.vbfpatch)"));
+        if (patch_path.isEmpty()) return;
+
+        // header rows as they are in the table, pictures as they are saved
+        doc.setHeaderLines(m_model.exportLines());
+        startJob("Making patch", JobScheduler::PRIORITY_BACKGROUND, false,
+                 [this, base_path, patch_path]() -> QString {
+                     ThemeDocument base;
+                     auto res = base.unpackVBF(base_path);
+                     if (!res.isEmpty()) return res;
+                     try {
+                         auto patch = ThemePatch::diff(base, doc);
+                         patch.save(patch_path);
+                         return QString("Patch of %1 images and %2 header rows, %3 KB")
+                                 .arg(patch.items.size()).arg(patch.rows.size()).arg(patch.itemsBytes() / 1024);
+                     } catch (const std::runtime_error &ex) {
+                         return ex.what();
+                     }
+                 },
+                 [this](const QString &res, bool cancelled) {
+                     ui->label_Status->setText(cancelled ? "Patch cancelled" : res);
+                 });
+    });
+    makePatchAction->setEnabled(false);
+    applyPatchAction = toolsMenu->addAction("Apply patch...", this, [this]() {
+        if (!doc.isOpen()) return;
+
+        auto patch_path = QFileDialog::getOpenFileName(this, tr("Apply patch"), "", tr("Theme patch (*.vbfpatch)"));
+        if (patch_path.isEmpty()) return;
+
+        // rows edited in the table would be lost otherwise
+        doc.setHeaderLines(m_model.exportLines());
+        startJob("Applying patch", JobScheduler::PRIORITY_NORMAL, true,
+                 [this, patch_path]() {
+                     try {
+                         return doc.applyPatch(ThemePatch::load(patch_path));
+                     } catch (const std::runtime_error &ex) {
+                         ThemeDocument::sPatchResult res;
+                         res.errors << ex.what();
+                         return res;
+                     }
+                 },
+                 [this](const ThemeDocument::sPatchResult &res, bool cancelled) { patchFinished(res, cancelled); });
+    });
+    applyPatchAction->setEnabled(false);
+    toolsMenu->addSeparator();
+    paletteGroupsAction = toolsMenu->addAction("Palette groups...", this, [this]() {
+        if (!paletteGroupsDialog) {
+            paletteGroupsDialog = new PaletteGroupsDialog(doc, scheduler, m_pictures, this);
+            paletteGroupsDialog->setAttribute(Qt::WA_DeleteOnClose);
+            connect(paletteGroupsDialog, &PaletteGroupsDialog::pictureActivated, this, [this](int picture_idx) {
+                auto index = m_filter.mapFromSource(m_pictures.index(picture_idx));
+                if (!index.isValid()) {
+                    // hidden by the search
+                    ui->lineEdit_search->clear();
+                    index = m_filter.mapFromSource(m_pictures.index(picture_idx));
+                }
+                ui->lw->setCurrentIndex(index);
+                ui->lw->scrollTo(index);
+            });
+        }
+        paletteGroupsDialog->show();
+        paletteGroupsDialog->raise();
+        paletteGroupsDialog->activateWindow();
+    });
+    paletteGroupsAction->setEnabled(false);
+
+    ui->menuBar->addAction("Diagnostics", this, [this]() {
+        DiagnosticsDialog(doc.profiler(), this).exec();
+    });
+
     ui->menuBar->addAction("About", this, [this]() {
 
         QString about_str = QString(R"about(
@@ -31,11 +268,9 @@ Date: %2
         QMessageBox::about(this, "Ford focus mk 3.* IPC theme editor", about_str);
     });
 
-    connect(&watcherPack, &QFutureWatcher<int>::finished, this, &MainWindow::packFinished);
-    connect(&watcherReplace, &QFutureWatcher<int>::finished, this, &MainWindow::replaceFinished);
-    connect(&watcherUnpack, &QFutureWatcher<int>::finished, this, &MainWindow::unpackFinished);
-    connect(&watcherExportAll, &QFutureWatcher<int>::finished, this, &MainWindow::exportFinished);
-    connect(this, &MainWindow::progressChanged, this, &MainWindow::onProgressChanged);
+    connect(&scheduler, &JobScheduler::jobProgress, this, &MainWindow::onJobProgress);
+    connect(&scheduler, &JobScheduler::jobFailed, this, &MainWindow::onJobFailed);
+    connect(&scheduler, &JobScheduler::jobFinished, this, &MainWindow::onJobFinished);
 
 	connect(ui->actionOpen, &QAction::triggered, this, &MainWindow::slotOpen);
     connect(ui->actionClose, &QAction::triggered, this, &MainWindow::slotClose);
@@ -44,38 +279,42 @@ Date: %2
     connect(ui->actionExit, &QAction::triggered, this, []{QApplication::quit();});
     connect(ui->pushButton_exportAll, QOverload<bool>::of(&QPushButton::clicked),[this]()
     {
-        if (images.empty()) return;
+        if (doc.pictureList().empty()) return;
 
         auto dest_dir = QFileDialog::getExistingDirectory(nullptr, tr("Export all images"));
         if (dest_dir.isEmpty()) return;
 
-        enableGui(false);
+        bool ok;
+        auto format = QInputDialog::getItem(this, tr("Export all images"), tr("Format:"),
+                                            {"BMP", "PNG"}, 0, false, &ok);
+        if (!ok) return;
 
-        futureExport = QtConcurrent::run(this, &MainWindow::exportAll, dest_dir);
-        watcherExportAll.setFuture(futureExport);
+        // export only reads the document, so browsing stays available meanwhile
+        auto export_format = format == "PNG" ? ThemeDocument::EXPORT_PNG : ThemeDocument::EXPORT_BMP;
+        startJob("Exporting", JobScheduler::PRIORITY_BACKGROUND, false,
+                 [this, dest_dir, export_format]() { return doc.exportAll(dest_dir, export_format); },
+                 [this](const QStringList &res, bool cancelled) { exportFinished(res, cancelled); });
     });
     connect(ui->pushButton_exportImage, QOverload<bool>::of(&QPushButton::clicked),[this]()
     {
-        QList<QListWidgetItem*> list = ui->lw->selectedItems();
-        if (list.isEmpty())
+        auto picture_idx = selectedPicture();
+        if (picture_idx < 0)
         {
             QMessageBox(QMessageBox::Information,
                         "", "Select any picture", QMessageBox::Ok, this).exec();
             return;
         }
-        auto picture_idx = list.at(0)->data(Qt::UserRole).toInt();
-        if(images.find(picture_idx) != images.end())
+        if(auto picture = doc.pictureInfo(picture_idx))
         {
-            auto& picture = images[picture_idx];
 
             auto store_path = QFileDialog::getSaveFileName(this, tr("Export images"),
-                                                           fs::path(picture.name).replace_extension(".bmp").string().c_str(),
+                                                           fs::path(picture->name).replace_extension(".bmp").string().c_str(),
                                                            tr("BMP image (*.bmp);;All Files (*)"));
 
             if (store_path.isEmpty()) return;
 
             try {
-                picture.eif->saveBmp(store_path.toStdWString());
+                doc.exportPicture(picture_idx, store_path);
             }
             catch (const runtime_error& ex) {
                 QMessageBox(QMessageBox::Warning, "", ex.what(), QMessageBox::Ok, this).exec();
@@ -85,18 +324,17 @@ Date: %2
     connect(ui->pushButton_replaceImage, QOverload<bool>::of(&QPushButton::clicked),[this]()
     {
         try {
-            if(!vbf.IsOpen()) {
+            if(!doc.isOpen()) {
                 throw runtime_error("VBF not open");
             }
 
-            QList<QListWidgetItem*> list = ui->lw->selectedItems();
-            if (list.isEmpty())
+            auto picture_idx = selectedPicture();
+            if (picture_idx < 0)
             {
                 throw runtime_error("Select any picture");
             }
-            auto picture_idx = list.at(0)->data(Qt::UserRole).toInt();
 
-            if(images.find(picture_idx) == images.end()) {
+            if(!doc.pictureInfo(picture_idx)) {
                 throw runtime_error("Wrong selected picture");
             }
 
@@ -104,11 +342,24 @@ Date: %2
                                                                  tr("Replace picture"), "", tr("Image (*.bmp)"));
             if(new_picture_path.isEmpty()) return;
 
-            enableGui(false);
+            auto replace = &ThemeDocument::ReplacePicture;
+            auto copies = doc.duplicatesOf(picture_idx).size();
+            if (copies > 1) {
+                auto answer = QMessageBox::question(this, "Replace picture",
+                                                    QString("The picture has %1 copies, replace all of them?")
+                                                            .arg(copies - 1),
+                                                    QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel);
+                if (answer == QMessageBox::Cancel) return;
+                if (answer == QMessageBox::Yes) {
+                    replace = &ThemeDocument::ReplaceDuplicates;
+                }
+            }
 
-            ui->label_Status->setText("Replacing picture...");
-            futureReplace = QtConcurrent::run(this, &MainWindow::ReplacePicture, picture_idx, new_picture_path);
-            watcherReplace.setFuture(futureReplace);
+            startJob("Replacing picture", JobScheduler::PRIORITY_NORMAL, true,
+                     [this, replace, picture_idx, new_picture_path]() {
+                         return (doc.*replace)(picture_idx, new_picture_path);
+                     },
+                     [this](const QPair<int, QString> &res, bool cancelled) { replaceFinished(res, cancelled); });
 
         } catch (const std::runtime_error& ex) {
             QMessageBox(QMessageBox::Warning,
@@ -119,40 +370,87 @@ Date: %2
     connect(ui->pushButton_exportCSV, QOverload<bool>::of(&QPushButton::clicked),[this]()
     {
         auto suggested_name = fs::path(vbfPath.toStdWString()).stem().concat("_objects.csv");
+        const auto named_filter = tr("CSV with column names (*.csv)");
+        QString filter;
         auto store_path = QFileDialog::getSaveFileName(this, tr("Export objects"),
                                                        suggested_name.string().c_str(),
-                                                       tr("CSV (*.csv);;All Files (*)"));
+                                                       tr("CSV (*.csv);;") + named_filter + tr(";;All Files (*)"),
+                                                       &filter);
 
         if (store_path.isEmpty())
             return;
 
-        ImageSection::HeaderToCsv(m_model.exportLines(), store_path.toStdWString());
+        const auto format = filter == named_filter ? HeaderCsv::FORMAT_NAMED : HeaderCsv::FORMAT_FTOOLS;
+        startJob("Exporting objects", JobScheduler::PRIORITY_BACKGROUND, false,
+                 [lines = m_model.exportLines(), store_path, format]() {
+                     return HeaderCsv::write(lines, store_path, format);
+                 },
+                 [this](const QString &res, bool cancelled) {
+                     if (!cancelled && !res.isEmpty()) {
+                         QMessageBox(QMessageBox::Warning, "", res, QMessageBox::Ok, this).exec();
+                     }
+                 });
     });
     connect(ui->pushButton_importCSV, QOverload<bool>::of(&QPushButton::clicked),[this]()
     {
         auto path = QFileDialog::getOpenFileName(this,
                                                tr("Open objects CSV"), "", tr("CSV (*.csv)"));
 
-        if(vbfPath.isEmpty())
+        if(vbfPath.isEmpty() || path.isEmpty())
             return;
 
-        try {
-            m_model.importLines(ImageSection::HeaderFromCsv(path.toStdWString()));
-        } catch (const std::runtime_error& ex) {
-            QMessageBox(QMessageBox::Warning,
-                        "", ex.what(), QMessageBox::Ok, this).exec();
-            return;
+        // parsed and checked off the GUI thread, the table gets only the rows that differ
+        startJob("Importing objects", JobScheduler::PRIORITY_NORMAL, true,
+                 [this, path]() {
+                     auto csv = HeaderCsv::read(path);
+                     if (csv.errors.isEmpty()) {
+                         auto res = doc.setHeaderLines(csv.rows, "Import objects CSV");
+                         if (!res.isEmpty()) {
+                             csv.errors << res;
+                         }
+                     }
+                     return csv.errors;
+                 },
+                 [this](const QStringList &errors, bool cancelled) {
+                     if (!cancelled && !errors.isEmpty()) {
+                         QMessageBox box(QMessageBox::Warning, "", "The objects weren't imported", QMessageBox::Ok, this);
+                         box.setInformativeText(errors.first());
+                         box.setDetailedText(errors.join("\n"));
+                         box.exec();
+                     }
+                     m_model.importLines(doc.getHeaderLines());
+                     updateGui();
+                 });
+    });
+    connect(ui->lineEdit_search, &QLineEdit::textChanged, this, [this](const QString &text)
+    {
+        m_filter.setQuery(text);
+        auto current = ui->lw->currentIndex();
+        if (current.isValid()) {
+            ui->lw->scrollTo(current);
         }
     });
-    connect(ui->lineEdit_search, &QLineEdit::textEdited,[this]()
+    ui->lw->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(ui->lw, &QListView::customContextMenuRequested, this, [this](const QPoint &pos)
     {
-        auto find_str = ui->lineEdit_search->text().toStdString();
-        for (const auto& it : images) {
-            if (it.second.name.find(find_str) != string::npos) {
-                ui->lw->scrollToItem(ui->lw->item(it.first));
-                ui->lw->item(it.first)->setSelected(true);
-                break;
-            }
+        auto index = ui->lw->indexAt(pos);
+        if (!index.isValid()) return;
+        auto picture = doc.pictureInfo(index.data(PictureListModel::PictureIndexRole).toInt());
+        if (!picture) return;
+
+        QMenu menu;
+        if (picture->palette_crc) {
+            menu.addAction("Show palette group", this, [this, crc = picture->palette_crc]() {
+                ui->lineEdit_search->setText("palette:" + QString::number(crc, 16));
+            });
+        }
+        if (doc.duplicatesOf(picture->index).size() > 1) {
+            menu.addAction("Show duplicates", this, [this, idx = picture->index]() {
+                ui->lineEdit_search->setText("dup:" + QString::number(idx));
+            });
+        }
+        if (!menu.isEmpty()) {
+            menu.exec(ui->lw->viewport()->mapToGlobal(pos));
         }
     });
 	scrollArea = new QScrollArea();
@@ -165,10 +463,14 @@ Date: %2
 	scrollArea->setAlignment(Qt::AlignHCenter | Qt::AlignVCenter);
 	ui->horizontalLayout->addWidget(scrollArea);
 
+    updateGui();
 }
 
 MainWindow::~MainWindow()
 {
+    // their jobs read the document, stop them before the members go
+    delete paletteGroupsDialog;
+    delete layoutPreview;
 	delete ui;
 }
 
@@ -179,435 +481,505 @@ void MainWindow::slotOpen()
 
     if(vbfPath.isEmpty()) return;
 
-    try {
-        //unpack vbf and get section with image resources
-        vbf.OpenFile(vbfPath.toStdWString());
-
-        enableGui(false);
-        future = QtConcurrent::run(this, &MainWindow::unpackVBF);
-        watcherUnpack.setFuture(future);
-
-    } catch (const runtime_error& ex) {
-        QMessageBox(QMessageBox::Warning,
-                    "", ex.what(), QMessageBox::Ok, this).exec();
-    }
+    //map vbf and get section with image resources, the opened one is dropped right away
+    clearGui();
+    startJob("Opening", JobScheduler::PRIORITY_NORMAL, true,
+             [this, path = vbfPath]() { return doc.unpackVBF(path); },
+             [this](const QString &res, bool cancelled) { unpackFinished(res, cancelled); });
 }
 
 void MainWindow::slotClose() {
 
-    if(vbf.IsOpen()) {
-
-        m_model.importLines(vector <ImageSection::HeaderRecord>()); // cleanup objects model content
-        images.clear();
+    if(doc.isOpen()) {
 
-        ui->lw->clear();
-        label = new QLabel();
-        scrollArea->setWidget(label);
-        ui->label_Width->setText("");
-        ui->label_Height->setText("");
-        ui->label_Type->setText("");
+        clearGui();
+        doc.close();
         ui->label_Status->setText("No file selected");
 
-        enableGui(false);
+        updateGui();
     }
 }
 
 void MainWindow::slotSave() {
 
-    if (vbf.IsOpen()) {
-
-        enableGui(false);
-        ui->label_Status->setText("Saving...");
-        futurePack = QtConcurrent::run(this, &MainWindow::packVBF, vbfPath);
-        watcherPack.setFuture(futurePack);
+    if (doc.isOpen()) {
+        startSave(vbfPath);
     }
 }
 
+void MainWindow::startSave(const QString &path) {
+
+    doc.setHeaderLines(m_model.exportLines());
+    startJob("Saving", JobScheduler::PRIORITY_NORMAL, true,
+             [this, path]() { return doc.packVBF(path); },
+             [this](const QString &res, bool cancelled) { packFinished(res, cancelled); });
+}
+
 void MainWindow::slotSaveAs() {
 
-    if(vbf.IsOpen()) {
+    if(doc.isOpen()) {
         auto store_path = QFileDialog::getSaveFileName(this, tr("Save VBF"),
                                                        "",
                                                        tr("VBF file (*.vbf);;All Files (*)"));
 
         if (store_path.isEmpty()) return;
 
-        enableGui(false);
-        ui->label_Status->setText("Saving...");
-        futurePack = QtConcurrent::run(this, &MainWindow::packVBF, store_path);
-        watcherPack.setFuture(futurePack);
+        startSave(store_path);
     }
 }
 
-void MainWindow::on_lw_itemSelectionChanged()
-{
-	QList<QListWidgetItem*> list = ui->lw->selectedItems();
-	if (!list.isEmpty()) {
-		auto picture_idx = list.at(0)->data(Qt::UserRole);
-		if(images.find(picture_idx.toInt()) != images.end()) {
-            auto& picture = images[picture_idx.toInt()];
-            label = new QLabel();
-            label->setPixmap(picture.image_pixmap);
-            scrollArea->setWidget(label);
-            ui->label_Width->setText("Width: " + QString::number(picture.width));
-            ui->label_Height->setText("Height: " + QString::number(picture.height));
-            ui->label_Type->setText(eitTypeToString(picture.type));
-		}
-	}
-}
+void MainWindow::slotOpenProject() {
 
-vector<uint8_t> unzipEIF(const std::vector<uint8_t>& zipped_data, std::string *p_eif_name = nullptr) {
+    auto dir = QFileDialog::getExistingDirectory(this, tr("Open project"));
+    if (dir.isEmpty()) return;
 
-    // unzip EIF
-    mz_zip_archive zip_archive{};
-    if (!mz_zip_reader_init_mem(&zip_archive,
-                                (const void *) zipped_data.data(), zipped_data.size(), 0)) {
-        throw runtime_error("Can't get image name form archive");
-    }
-    mz_zip_archive_file_stat file_stat;
-    mz_zip_reader_file_stat(&zip_archive, 0, &file_stat);
-    vector<uint8_t> eif(file_stat.m_uncomp_size);
-    mz_zip_reader_extract_to_mem(&zip_archive, 0, (void *) eif.data(), eif.size(), 0);
-    mz_zip_reader_end(&zip_archive);
-
-    if (nullptr != p_eif_name) {
-        *p_eif_name = file_stat.m_filename;
-    }
+    // the base VBF isn't unpacked again if it hasn't changed
+    clearGui();
+    startJob("Opening project", JobScheduler::PRIORITY_NORMAL, true,
+             [this, dir]() { return doc.openProject(dir); },
+             [this](const QString &res, bool cancelled) { unpackFinished(res, cancelled); });
+}
 
-    return eif;
+void MainWindow::slotSaveProject() {
+
+    if (!doc.isOpen()) return;
+
+    auto suggested_name = fs::path(vbfPath.toStdWString()).stem().concat(ThemeProject::dirSuffix);
+    auto dir = QFileDialog::getSaveFileName(this, tr("Save project"), suggested_name.string().c_str(),
+                                            tr("Theme project (*.vbfproj)"));
+    if (dir.isEmpty()) return;
+
+    startJob("Saving project", JobScheduler::PRIORITY_NORMAL, true,
+             [this, dir]() { return doc.createProject(dir); },
+             [this, dir](const QString &res, bool cancelled) {
+                 if (!res.isEmpty()) {
+                     if (!cancelled) {
+                         QMessageBox(QMessageBox::Warning, "", res, QMessageBox::Ok, this).exec();
+                     }
+                     ui->label_Status->setText("Project error");
+                     return;
+                 }
+                 ui->label_Status->setText("Edits are kept in " + QDir::toNativeSeparators(dir));
+             });
 }
 
-QString MainWindow::unpackVBF() {
+void MainWindow::slotUndo() {
 
-    images.clear();
+    // a reopened project reads and decodes the stored pictures, so it's a job
+    if (!exclusiveJobs.isEmpty() || !sharedJobs.isEmpty()) return;
+    startJob("Undo", JobScheduler::PRIORITY_INTERACTIVE, true,
+             [this]() { return doc.undo(); },
+             [this](const ThemeDocument::sHistoryStep &step, bool cancelled) {
+                 if (!cancelled) historyStepDone(step, "Undone");
+             });
+}
 
-    try {
-        std::vector<uint8_t> img_sec_bin;
-        if(vbf.GetSectionRaw(1, img_sec_bin)) {
-            throw runtime_error("Can't get image section");
-        }
+void MainWindow::slotRedo() {
+
+    if (!exclusiveJobs.isEmpty() || !sharedJobs.isEmpty()) return;
+    startJob("Redo", JobScheduler::PRIORITY_INTERACTIVE, true,
+             [this]() { return doc.redo(); },
+             [this](const ThemeDocument::sHistoryStep &step, bool cancelled) {
+                 if (!cancelled) historyStepDone(step, "Redone");
+             });
+}
 
-        /* parse images section */
-        ImageSection section;
-        section.Parse(img_sec_bin);
+void MainWindow::historyStepDone(const ThemeDocument::sHistoryStep &step, const QString &done) {
 
-        /* extract header lines */
-        m_model.importLines(section.getHeaderData());
+    if (!step.error.isEmpty()) {
+        QMessageBox(QMessageBox::Warning, "", step.error, QMessageBox::Ok, this).exec();
+        return;
+    }
+    if (step.title.isEmpty()) return;
 
-        /* extract images */
-        int zipped_items = section.GetItemsCount(ImageSection::RT_ZIP);
+    for (auto idx : step.pictures) {
+        pixmapCache.remove(idx);
+        m_pictures.updatePicture(idx);
+    }
+    m_pictures.refreshInfo();
+    if (step.rows) {
+        m_model.importLines(doc.getHeaderLines());
+    }
+    slotPictureSelected();
 
-        for(int i = 0; i < zipped_items; i++) {
+    ui->label_Status->setText(done + ": " + step.title);
+    updateGui();
+}
 
-            progressChanged({i, zipped_items});
-            auto& picture = images[i];
+int MainWindow::selectedPicture() const {
 
-            // get zipped EIF from image section
-            std::vector<uint8_t> img_zip_bin;
-            section.GetItemData(ImageSection::RT_ZIP, i, img_zip_bin);
+    auto current = ui->lw->currentIndex();
+    return current.isValid() ? current.data(PictureListModel::PictureIndexRole).toInt() : -1;
+}
 
-            std::string eif_name;
-            auto eif_data = unzipEIF(img_zip_bin, &eif_name);
+void MainWindow::slotPictureSelected()
+{
+    // the running job holds the document, it shows the selection when it's done
+    if (!exclusiveJobs.isEmpty()) return;
+
+	auto picture_idx = selectedPicture();
+	if (picture_idx >= 0) {
+		if(auto picture = doc.pictureInfo(picture_idx)) {
+            showPicture(picture->index);
+            ui->label_Width->setText("Width: " + QString::number(picture->width));
+            ui->label_Height->setText("Height: " + QString::number(picture->height));
+            ui->label_Type->setText(eitTypeToString(picture->type));
+		}
+	}
+}
 
-            picture.eif = EIF::EifConverter::makeEif(static_cast<EIF::EIF_TYPE>(eif_data[7]));
-            picture.eif->openEif(eif_data);
-            auto bitmap = picture.eif->getBitmapRBGA();
+void MainWindow::showPicture(int picture_idx) {
 
-            picture.image_pixmap = QPixmap::fromImage(
-                    QImage(bitmap.data(), picture.eif->getWidth(), picture.eif->getHeight(),
-                           QImage::Format_RGBA8888).convertToFormat(QImage::Format_ARGB32));
+    // copies share the pixmap of the first one
+    auto info = doc.pictureInfo(picture_idx);
+    if (info && info->duplicate_of >= 0) {
+        picture_idx = info->duplicate_of;
+    }
 
-            if (picture.eif->getType() == EIF_TYPE_MULTICOLOR) {
-                auto crc16 = CRC::Calculate((char *) eif_data.data() + 0x10, 768, CRC::CRC_16_CCITTFALSE());
-                picture.palette_crc = crc16;
-            }
+    if (previewJob) {
+        scheduler.cancel(previewJob);
+        previewJob = 0;
+    }
 
-            picture.index = i;
-            picture.name = eif_name;
-            picture.type = picture.eif->getType();
-            picture.width = picture.eif->getWidth();
-            picture.height = picture.eif->getHeight();
+    label = new QLabel();
+    scrollArea->setWidget(label);
+    if (auto cached = pixmapCache.object(picture_idx)) {
+        label->setPixmap(*cached);
+        return;
+    }
 
+    // goes ahead of queued exports and saves, a newer selection cancels it
+    label->setText("Decoding...");
+    previewJob = scheduler.submit("Decoding", JobScheduler::PRIORITY_INTERACTIVE,
+                                  [this, picture_idx]() -> QPair<QImage, QString> {
+        try {
+            return {doc.decodePicture(picture_idx), {}};
+        } catch (const std::runtime_error &ex) {
+            return {{}, ex.what()};
+        }
+    }, [this, picture_idx, target = QPointer<QLabel>(label)](const QPair<QImage, QString> &res, bool cancelled) {
+        // the label of this picture, it's gone if another picture or document was shown meanwhile
+        const bool show = !cancelled && target;
+        if (!res.second.isEmpty()) {
+            if (show) target->setText(res.second);
+            return;
         }
-    } catch (const std::runtime_error& ex) {
-        return ex.what();
-    }
 
-    return "";
+        // the cache may drop a too large pixmap right away, so keep own copy
+        QPixmap pixmap = QPixmap::fromImage(res.first);
+        pixmapCache.insert(picture_idx, new QPixmap(pixmap), std::max(1, pixmap.width() * pixmap.height() * 4 / 1024));
+        if (show) target->setPixmap(pixmap);
+    });
 }
 
-int MainWindow::compressVector(const std::vector<uint8_t> &data, const char *data_name,
-                               std::vector<uint8_t> &compressed_data) {
-
-    mz_bool status;
-    mz_zip_archive zip_archive = {};
-    unsigned flags = MZ_DEFAULT_LEVEL | MZ_ZIP_FLAG_ASCII_FILENAME;
+void MainWindow::setCacheBudget(int megabytes) {
+    pixmapCache.setMaxCost(megabytes * 1024);
+}
 
-    status = mz_zip_writer_init_heap(&zip_archive, 0, 0);
-    if (!status) {
-        qWarning("mz_zip_writer_init_heap failed!");
-        return -1;
+QString MainWindow::eitTypeToString(uint8_t eif_t)
+{
+    switch (eif_t) {
+        case EIF_TYPE_MONOCHROME: return "(8bit)";
+        case EIF_TYPE_MULTICOLOR: return "(16bit)";
+        case EIF_TYPE_SUPERCOLOR: return "(32bit)";
+        default: return "";
     }
+}
 
-    status = mz_zip_writer_add_mem_ex(&zip_archive, data_name, (void*)data.data(), data.size(), "", 0, flags, 0, 0);
-    if (!status) {
-        qWarning("mz_zip_writer_add_mem_ex failed!");
-        return -1;
+void MainWindow::updateGui() {
+
+    // an exclusive job holds the document locked, so don't even ask it then
+    const bool idle = exclusiveJobs.isEmpty();
+    const bool open = idle && doc.isOpen();
+    const bool editable = open && sharedJobs.isEmpty();
+
+    ui->actionOpen->setEnabled(idle && sharedJobs.isEmpty());
+    openProjectAction->setEnabled(idle && sharedJobs.isEmpty());
+    saveProjectAction->setEnabled(editable);
+    ui->lineEdit_search->setEnabled(open);
+    ui->pushButton_exportImage->setEnabled(open);
+    ui->pushButton_exportAll->setEnabled(editable);
+    ui->pushButton_replaceImage->setEnabled(editable);
+    ui->actionSave->setEnabled(editable);
+    ui->actionSave_As->setEnabled(editable);
+    ui->actionClose->setEnabled(editable);
+    dedupAction->setEnabled(editable);
+    replaceDirAction->setEnabled(editable);
+    makePatchAction->setEnabled(editable);
+    applyPatchAction->setEnabled(editable);
+    paletteGroupsAction->setEnabled(open);
+    if (paletteGroupsDialog) {
+        paletteGroupsDialog->setDocumentBusy(!idle);
     }
-
-    std::size_t size;
-    void *pBuf;
-    status = mz_zip_writer_finalize_heap_archive(&zip_archive, &pBuf, &size);
-    if (!status) {
-        qWarning("mz_zip_writer_finalize_heap_archive failed!");
-        return -1;
+    ui->tab_lines->setEnabled(editable);
+
+    const auto undo_title = editable ? doc.undoTitle() : QString();
+    const auto redo_title = editable ? doc.redoTitle() : QString();
+    undoAction->setEnabled(!undo_title.isEmpty());
+    undoAction->setText(undo_title.isEmpty() ? "Undo" : "Undo " + undo_title);
+    redoAction->setEnabled(!redo_title.isEmpty());
+    redoAction->setText(redo_title.isEmpty() ? "Redo" : "Redo " + redo_title);
+    const bool busy = !idle || !sharedJobs.isEmpty();
+    cancelButton->setVisible(busy);
+    progressBar->setVisible(busy);
+    throughputLabel->setVisible(busy);
+    if (!busy) {
+        progressBar->reset();
+        throughputLabel->clear();
     }
+}
 
-    //copy compressed data to vector
-    compressed_data.resize(size);
-    copy((uint8_t*)pBuf, (uint8_t*)pBuf + size, compressed_data.begin());
+void MainWindow::clearGui() {
 
-    status = mz_zip_writer_end(&zip_archive);
-    if (!status) {
-        qWarning("mz_zip_writer_end failed!");
-        return -1;
+    if (previewJob) {
+        scheduler.cancel(previewJob);
+        previewJob = 0;
     }
 
-    return 0;
+    m_model.importLines(vector <ImageSection::HeaderRecord>()); // cleanup objects model content
+    pixmapCache.clear();
+
+    m_pictures.reset({});
+    label = new QLabel();
+    scrollArea->setWidget(label);
+    ui->label_Width->setText("");
+    ui->label_Height->setText("");
+    ui->label_Type->setText("");
 }
 
-void MainWindow::CompressAndReplaceEIF(ImageSection& img_sec, int idx, const vector<uint8_t>& res_bin, const std::string& res_name) {
+void MainWindow::jobStarted(int job_id, bool exclusive) {
 
-    //get header data
-    auto eif_header_p = reinterpret_cast<const EIF::EifBaseHeader*>(res_bin.data());
+    (exclusive ? exclusiveJobs : sharedJobs).insert(job_id);
+    ui->label_Status->setText(scheduler.name(job_id) + "...");
+    progressBar->setRange(0, 0);
+    updateGui();
+}
+
+void MainWindow::onJobProgress(int job_id, const sProgress &progress) {
+
+    if (job_id == previewJob) return;
 
-    //compress
-    vector<uint8_t> zip_bin;
-    if(compressVector(res_bin, res_name.c_str(), zip_bin)) {
-        throw runtime_error("Can't compress resource " + res_name);
+    ui->label_Status->setText(QString("%1: %2 %3 of %4").arg(scheduler.name(job_id), progress.stage)
+                                      .arg(progress.done).arg(progress.total));
+    auto fraction = progress.fraction();
+    if (fraction < 0) {
+        progressBar->setRange(0, 0); // busy indicator
+    } else {
+        progressBar->setRange(0, 1000);
+        progressBar->setValue((int) (fraction * 1000));
     }
+    throughputLabel->setText(formatThroughput(progress));
+}
 
-    //replace
-    img_sec.ReplaceItem(ImageSection::RT_ZIP, idx, zip_bin,
-                        eif_header_p->width, eif_header_p->height, eif_header_p->type);
-    qDebug() << "Replace eif " << res_name.c_str();
+QString MainWindow::formatThroughput(const sProgress &progress) {
+
+    QString text;
+    if (progress.bytes) {
+        text = QString("%1 MB/s").arg(progress.bytesPerSecond() / (1024 * 1024), 0, 'f', 1);
+    }
+    auto eta = progress.etaMs();
+    if (eta >= 0) {
+        if (!text.isEmpty()) text += ", ";
+        text += eta < 60000 ? QString("%1 s left").arg((eta + 999) / 1000)
+                            : QString("%1 min left").arg((eta + 59999) / 60000);
+    }
+    return text;
 }
 
-QString MainWindow::eitTypeToString(uint8_t eif_t)
-{
-    switch (eif_t) {
-        case EIF_TYPE_MONOCHROME: return "(8bit)";
-        case EIF_TYPE_MULTICOLOR: return "(16bit)";
-        case EIF_TYPE_SUPERCOLOR: return "(32bit)";
-        default: return "";
+void MainWindow::onJobFailed(int job_id, const QString &error) {
+
+    // done() isn't called for it, so nothing else replaces the "..." text
+    if (job_id == previewJob) {
+        label->setText("Decoding failed: " + error);
+    } else if (exclusiveJobs.contains(job_id) || sharedJobs.contains(job_id)) {
+        ui->label_Status->setText(scheduler.name(job_id) + " failed: " + error);
     }
 }
 
-void MainWindow::enableGui(bool doEnable) {
+void MainWindow::onJobFinished(int job_id, bool cancelled) {
 
-    ui->lineEdit_search->setEnabled(doEnable);
-    ui->pushButton_exportAll->setEnabled(doEnable);
-    ui->pushButton_exportImage->setEnabled(doEnable);
-    ui->pushButton_replaceImage->setEnabled(doEnable);
-    ui->actionSave->setEnabled(doEnable);
-    ui->actionSave_As->setEnabled(doEnable);
-    ui->actionClose->setEnabled(doEnable);
-    ui->tab_lines->setEnabled(doEnable);
+    if (job_id == previewJob) {
+        previewJob = 0;
+    }
+    const bool tracked = exclusiveJobs.remove(job_id) || sharedJobs.remove(job_id);
+    if (tracked && cancelled) {
+        ui->label_Status->setText("Cancelled");
+    }
+    updateGui();
 }
 
 void MainWindow::reloadGui() {
 
-    ui->lw->clear();
     ui->label_Status->setText(QString("Done"));
-
-    for (const auto& picture : images) {
-        auto newItem = new QListWidgetItem;
-        newItem->setData(Qt::UserRole, picture.second.index);
-        newItem->setText(picture.second.name.c_str());
-        ui->lw->addItem(newItem);
-    }
+    m_pictures.reset(doc.pictureList());
 }
 
-void MainWindow::unpackFinished() {
+void MainWindow::unpackFinished(const QString &res, bool cancelled) {
 
-    if (!future.result().isEmpty()) {
-        QMessageBox(QMessageBox::Warning,
-                    "", future.result(), QMessageBox::Ok, this).exec();
-        ui->label_Status->setText(QString("Unpack error"));
-        enableGui(true);
+    if (!res.isEmpty()) {
+        if (!cancelled) {
+            QMessageBox(QMessageBox::Warning,
+                        "", res, QMessageBox::Ok, this).exec();
+        }
+        ui->label_Status->setText(cancelled ? "Open cancelled" : "Unpack error");
         return;
     }
 
+    vbfPath = doc.path();
+    m_model.importLines(doc.getHeaderLines());
+    pixmapCache.clear();
     reloadGui();
-
-    enableGui(true);
 }
 
-void MainWindow::replaceFinished() {
-
-    const auto &res = futureReplace.result();
+void MainWindow::replaceFinished(const QPair<int, QString> &res, bool cancelled) {
 
     if (not res.second.isEmpty()) {
-        QMessageBox(QMessageBox::Warning,
-                    "", res.second, QMessageBox::Ok, this).exec();
-        ui->label_Status->setText(QString("Replace error"));
-        enableGui(true);
+        if (!cancelled) {
+            QMessageBox(QMessageBox::Warning,
+                        "", res.second, QMessageBox::Ok, this).exec();
+        }
+        ui->label_Status->setText(cancelled ? "Replace cancelled" : "Replace error");
         return;
     }
 
-    /* colorize line */
-    ui->lw->item(res.first)->setBackground(Qt::gray);
+    /* colorize lines, a copy may have got its own pixmap */
+    for (auto idx : doc.duplicatesOf(res.first)) {
+        pixmapCache.remove(idx);
+        m_pictures.updatePicture(idx);
+    }
+    pixmapCache.remove(res.first);
+    m_pictures.refreshInfo();
 
     /* reload image */
-    auto& picture = images[res.first];
-    label = new QLabel();
-    label->setPixmap(picture.image_pixmap);
-    scrollArea->setWidget(label);
+    showPicture(res.first);
 
-    enableGui(true);
     ui->label_Status->setText(QString("Done"));
 }
 
-void MainWindow::exportFinished() {
+void MainWindow::exportFinished(const QStringList &res, bool cancelled) {
 
-    const auto &res = futureExport.result();
-    if (res) {
-        QMessageBox(QMessageBox::Warning, "", "Export error", QMessageBox::Ok, this).exec();
+    if (cancelled) {
+        ui->label_Status->setText("Export cancelled");
+        return;
+    }
+    if (!res.isEmpty()) {
+        QMessageBox box(QMessageBox::Warning, "",
+                        QString("%1 images were not exported").arg(res.size()), QMessageBox::Ok, this);
+        box.setDetailedText(res.join('\n'));
+        box.exec();
     }
-    enableGui(true);
     ui->label_Status->setText(QString("Done"));
 }
 
-void MainWindow::onProgressChanged(QPoint progress) {
-    ui->label_Status->setText(QString("Processing %1 of %2").arg(progress.x() + 1).arg(progress.y()));
-}
-
-int MainWindow::exportAll(const QString &dest_dir) {
+void MainWindow::dedupFinished(const ThemeDocument::sDuplicatesStats &stats, bool cancelled) {
 
-    int i = 1;
-    const int pics_count = images.size();
-    for(const auto& picture :images) {
-        progressChanged({i++, pics_count});
-        fs::path store_path(dest_dir.toStdWString() / fs::path(picture.second.name).replace_extension(".bmp"));
-        try {
-            picture.second.eif->saveBmp(store_path);
-        }
-        catch (const runtime_error& ex) {
-            qWarning() << ex.what();
-            return -1;
+    if (!stats.error.isEmpty()) {
+        if (!cancelled) {
+            QMessageBox(QMessageBox::Warning, "", stats.error, QMessageBox::Ok, this).exec();
         }
+        ui->label_Status->setText(cancelled ? "Duplicates search cancelled" : "Duplicates search error");
+        return;
     }
 
-    return 0;
+    m_pictures.refreshInfo();
+    ui->label_Status->setText(QString("%1 duplicates in %2 groups, %3 MB of decoded pixels shared")
+                                      .arg(stats.duplicates).arg(stats.groups)
+                                      .arg((double) stats.bytes / (1024 * 1024), 0, 'f', 1));
+    if (stats.duplicates) {
+        ui->lineEdit_search->setText("dup");
+    }
 }
 
-QPair<int, QString> MainWindow::ReplacePicture(int picture_idx, const QString &new_picture_path) {
+void MainWindow::replaceDirFinished(const ThemeDocument::sBatchReplace &res, bool cancelled) {
 
-    try {
-        auto &picture = images[picture_idx];
-
-        auto new_eif = EIF::EifConverter::makeEif(static_cast<EIF::EIF_TYPE>(picture.type));
-
-        new_eif->openBmp(new_picture_path.toStdWString());
+    if (cancelled && !res.errors.isEmpty()) {
+        ui->label_Status->setText("Replace cancelled");
+        return;
+    }
+    if (!res.errors.isEmpty()) {
+        QMessageBox box(QMessageBox::Warning, "",
+                        QString("%1 problems found, no images were replaced").arg(res.errors.size()),
+                        QMessageBox::Ok, this);
+        box.setDetailedText(res.errors.join('\n'));
+        box.exec();
+        ui->label_Status->setText("Replace error");
+        return;
+    }
 
-        if (new_eif->getWidth() != picture.width || new_eif->getHeight() != picture.height) {
-            throw runtime_error("Replaced picture size mismatch");
+    pixmapCache.clear();
+    for (const auto &picture : doc.pictureList()) {
+        if (picture.changed) {
+            m_pictures.updatePicture(picture.index);
         }
-
-        picture.eif = std::move(new_eif);
-        auto bitmap = picture.eif->getBitmapRBGA();
-        picture.image_pixmap = QPixmap::fromImage(
-                QImage(bitmap.data(), picture.eif->getWidth(), picture.eif->getHeight(),
-                       QImage::Format_RGBA8888).convertToFormat(QImage::Format_ARGB32));
-        picture.changed = true;
-    } catch (const std::runtime_error& ex) {
-        return {picture_idx, ex.what()};
     }
-
-    return {picture_idx, ""};
+    m_pictures.refreshInfo();
+    slotPictureSelected();
+    ui->label_Status->setText(QString("%1 images replaced, save to apply them").arg(res.replaced));
 }
 
-QString MainWindow::packVBF(const QString &path) {
-
-    try {
-        // get an image section
-        std::vector<uint8_t> img_sec_bin;
-        if (vbf.GetSectionRaw(1, img_sec_bin)) {
-            throw runtime_error("Can't get image section");
-        }
-        ImageSection section;
-        section.Parse(img_sec_bin);
-
-        // setup head objects
-        section.setHeaderData(m_model.exportLines());
-
-        // find a changed pictures
-        for (auto &it : images) {
-
-            if (!it.second.changed) continue;
-
-            auto &orig_picture = it.second;
-
-            if (0 == orig_picture.palette_crc) {
-                // replaced pic is 8 or 32 bit eif
-                // no additional actions required
-                // just make eif from bmp and replace the
-                // original pic
-                CompressAndReplaceEIF(section, orig_picture.index, orig_picture.eif->saveEifToVector(),
-                                      orig_picture.name);
-                orig_picture.changed = false;
+void MainWindow::patchFinished(const ThemeDocument::sPatchResult &res, bool cancelled) {
 
-            } else {
-                // replaced pic is definitely 16 bit eif.
-                // 16bits eif may be bonded into a set and share one palette
-                // so we need to recalculate a new palette for each eif included in that set
-
-
-                // find all pictures with the same palette
-                vector<EIF::EifImage16bit> eifs_set;
-                vector<int> eifs_set_indexes;
-
-                for (auto &itt :images) {
-                    auto &picture = itt.second;
-                    if (picture.palette_crc == orig_picture.palette_crc) {
-                        picture.changed = false;
-                        eifs_set_indexes.push_back(picture.index);
-                        eifs_set.push_back(*reinterpret_cast<const EIF::EifImage16bit *>(picture.eif.get())); // 🤢
-                    }
-                }
-
-                // calc new 'multipalette'
-                EIF::EifConverter::mapMultiPalette(eifs_set);
+    if (cancelled && !res.errors.isEmpty()) {
+        ui->label_Status->setText("Patch cancelled");
+        return;
+    }
+    if (!res.errors.isEmpty()) {
+        QMessageBox box(QMessageBox::Warning, "",
+                        QString("%1 problems found, the patch wasn't applied").arg(res.errors.size()),
+                        QMessageBox::Ok, this);
+        box.setDetailedText(res.errors.join('\n'));
+        box.exec();
+        ui->label_Status->setText("Patch error");
+        return;
+    }
 
-                for (int i = 0; i < eifs_set.size(); ++i) {
-                    auto eif_idx = eifs_set_indexes[i];
-                    progressChanged({i, (int) eifs_set.size()});
-                    CompressAndReplaceEIF(section, eif_idx, eifs_set[i].saveEifToVector(), images[eif_idx].name);
-                }
-            }
+    m_model.importLines(doc.getHeaderLines());
+    pixmapCache.clear();
+    for (const auto &picture : doc.pictureList()) {
+        if (picture.changed) {
+            m_pictures.updatePicture(picture.index);
         }
+    }
+    m_pictures.refreshInfo();
+    slotPictureSelected();
+
+    if (!res.warnings.isEmpty()) {
+        QMessageBox box(QMessageBox::Information, "",
+                        QString("%1 images differed from the patch base and were replaced anyway")
+                                .arg(res.warnings.size()), QMessageBox::Ok, this);
+        box.setDetailedText(res.warnings.join('\n'));
+        box.exec();
+    }
+    ui->label_Status->setText(QString("%1 images and %2 header rows patched, save to apply them")
+                                      .arg(res.items).arg(res.rows));
+}
 
-        //replace vbf image content
-        section.SaveToVector(img_sec_bin);
-        vbf.ReplaceSectionRaw(1, img_sec_bin);
+void MainWindow::packFinished(const QString &res, bool cancelled) {
 
-        vbf.SaveToFile(path.toStdWString());
-    } catch (const std::runtime_error& ex) {
-        return ex.what();
+    if (!res.isEmpty()) {
+        if (!cancelled) {
+            QMessageBox(QMessageBox::Warning,
+                        "", res, QMessageBox::Ok, this).exec();
+        }
+        ui->label_Status->setText(cancelled ? "Save cancelled, the file is untouched" : "Pack error");
+        return;
     }
 
-    return "";
-}
-
-void MainWindow::packFinished() {
+    vbfPath = doc.path();
 
-    if (!futurePack.result().isEmpty()) {
-        QMessageBox(QMessageBox::Warning,
-                    "", futurePack.result(), QMessageBox::Ok, this).exec();
-        ui->label_Status->setText(QString("Pack error"));
-        enableGui(true);
-    } else {
-        future = QtConcurrent::run(this, &MainWindow::unpackVBF);
-        watcherUnpack.setFuture(future);
+    for (auto idx : doc.repacked()) {
+        pixmapCache.remove(idx);
+        m_pictures.updatePicture(idx);
     }
-}
\ No newline at end of file
+    m_pictures.refreshInfo();
+    slotPictureSelected();
+
+    const auto &packStats = doc.lastPackStats();
+    ui->label_Status->setText(QString("Saved %1 images in %2 ms, %3 -> %4 bytes, palette dE %5%6")
+                                      .arg(packStats.items).arg(packStats.elapsed_ms)
+                                      .arg(packStats.bytes_in).arg(packStats.bytes_out)
+                                      .arg(packStats.palette_delta_e, 0, 'f', 2)
+                                      .arg(packStats.palette_fallbacks
+                                           ? QString(", %1 groups by FTools").arg(packStats.palette_fallbacks)
+                                           : QString()));
+}
@@ -6,10 +6,14 @@
 #include <QtWidgets>
 #include <QtConcurrent/QtConcurrent>
 
-#include <VbfFile.h>
-#include <EifConverter.h>
-
 #include "HeaderObjectsModel.h"
+#include "JobScheduler.h"
+#include "LayoutPreview.h"
+#include "PaletteGroupsDialog.h"
+#include "PictureFilterModel.h"
+#include "PictureListModel.h"
+#include "ThemeDocument.h"
+#include "ThemePatch.h"
 
 namespace Ui {
 class MainWindow;
@@ -28,67 +32,82 @@ private slots:
     void slotClose();
     void slotSave();
     void slotSaveAs();
-	void on_lw_itemSelectionChanged();
-    void onProgressChanged(QPoint progress);
-
-signals:
-    void progressChanged(QPoint progress);
+    void slotOpenProject();
+    void slotSaveProject();
+    void slotUndo();
+    void slotRedo();
+	void slotPictureSelected();
+    void onJobProgress(int job_id, const sProgress &progress);
+    void onJobFailed(int job_id, const QString &error);
+    void onJobFinished(int job_id, bool cancelled);
 
 private:
 
     HeaderObjectsModel m_model;
 
-    struct sPictureIPC {
-        int index;
-        std::string name;
-        uint16_t palette_crc;
-        uint8_t  type;
-        uint16_t width;
-        uint16_t height;
-        unique_ptr<EIF::EifImageBase> eif;
-        QPixmap image_pixmap;
-        bool changed = false;
-    };
+    ThemeDocument doc;
 
-    std::map<int, sPictureIPC> images;
+    /* declared after the document, so its jobs are stopped before the document goes */
+    JobScheduler scheduler;
+    /* exclusive jobs change the document and lock the GUI, shared ones only read it */
+    QSet<int> exclusiveJobs;
+    QSet<int> sharedJobs;
+    int previewJob = 0;
 
-    static QString eitTypeToString(uint8_t eif_t);
+    template<class Work, class Done>
+    void startJob(const QString &name, JobScheduler::enPriority priority, bool exclusive, Work work, Done done) {
+        jobStarted(scheduler.submit(name, priority, std::move(work), std::move(done)), exclusive);
+    }
+    void jobStarted(int job_id, bool exclusive);
 
-    void reloadGui();
-    void enableGui(bool doEnable);
+    PictureListModel m_pictures{doc};
+    PictureFilterModel m_filter{m_pictures};
 
-    int exportAll(const QString &dest_dir);
+    /* decoded pixmaps of recently viewed pictures, cost is in KiB */
+    QCache<int, QPixmap> pixmapCache;
+    static constexpr int defaultCacheBudgetMb = 256;
 
-    QString packVBF(const QString &path);
-    QString unpackVBF();
-    QPair<int, QString> ReplacePicture(int picture_idx, const QString &new_picture_path);
-
-    static int
-    compressVector(const vector<uint8_t> &data, const char *data_name, vector<uint8_t> &compressed_data);
+    static QString eitTypeToString(uint8_t eif_t);
+    static QString formatThroughput(const sProgress &progress);
 
-    static void
-    CompressAndReplaceEIF(ImageSection &img_sec, int idx, const vector<uint8_t> &res_bin,
-                          const string &res_name);
+    /* decodes a not cached picture on the scheduler and shows it when it's ready */
+    void showPicture(int picture_idx);
+    int selectedPicture() const;
+    void setCacheBudget(int megabytes);
 
-    void unpackFinished();
-    void exportFinished();
-    void replaceFinished();
-    void packFinished();
+    void reloadGui();
+    void clearGui();
+    void updateGui();
+    void startSave(const QString &path);
+
+    void unpackFinished(const QString &res, bool cancelled);
+    void exportFinished(const QStringList &res, bool cancelled);
+    void replaceFinished(const QPair<int, QString> &res, bool cancelled);
+    void packFinished(const QString &res, bool cancelled);
+    void dedupFinished(const ThemeDocument::sDuplicatesStats &stats, bool cancelled);
+    void replaceDirFinished(const ThemeDocument::sBatchReplace &res, bool cancelled);
+    void patchFinished(const ThemeDocument::sPatchResult &res, bool cancelled);
+    void historyStepDone(const ThemeDocument::sHistoryStep &step, const QString &done);
 
     Ui::MainWindow *ui;
 	QLabel *label{};
 	QScrollArea *scrollArea;
-    VbfFile vbf;
+    LayoutPreview *layoutPreview;
+    QPointer<PaletteGroupsDialog> paletteGroupsDialog;
+    QAction *dedupAction;
+    QAction *replaceDirAction;
+    QAction *makePatchAction;
+    QAction *applyPatchAction;
+    QAction *paletteGroupsAction;
+    QAction *openProjectAction;
+    QAction *saveProjectAction;
+    QAction *undoAction;
+    QAction *redoAction;
+    QToolButton *cancelButton;
+    QProgressBar *progressBar;
+    QLabel *throughputLabel;
     QString vbfPath;
     QThread thread;
-    QFuture<QString> future;
-    QFuture<int> futureExport;
-    QFutureWatcher<QString> watcherUnpack;
-    QFutureWatcher<int> watcherExportAll;
-    QFuture<QPair<int, QString>> futureReplace;
-    QFutureWatcher<QPair<int, QString>> watcherReplace;
-    QFuture<QString> futurePack;
-    QFutureWatcher<QString> watcherPack;
 };
 
 #endif // MAINWINDOW_H